@@ -16,28 +16,82 @@
 #define UNUSED(x) ((x) = (x))
 #endif
 
+/**
+ * Lower case the ASCII upper case letters in each byte of a word.
+ */
+static inline uint32_t
+lwc__lower_word(uint32_t w)
+{
+	uint32_t heptets = w & 0x7f7f7f7f;
+	/* top bit of each byte set if above 'Z' */
+	uint32_t is_gt_Z = heptets + 0x25252525;
+	/* top bit of each byte set if 'A' or above */
+	uint32_t is_ge_A = heptets + 0x3f3f3f3f;
+	uint32_t is_ascii = ~w & 0x80808080;
+	uint32_t is_upper = is_ascii & (is_ge_A ^ is_gt_Z);
+
+	return w | (is_upper >> 2);
+}
+
 static inline lwc_hash
-lwc__calculate_hash(const char *str, size_t len)
+lwc__hash_step(lwc_hash z, uint32_t w)
+{
+	z ^= w;
+	z *= 0x01000193;
+	return (z << 13) | (z >> 19);
+}
+
+/**
+ * Hash a string four bytes at a time.
+ *
+ * Strings of up to four bytes, which most tag and attribute names
+ * are, take a single step. The result is mixed so the low bits are
+ * suitable for indexing a power of two sized table.
+ */
+static inline lwc_hash
+lwc__hash(const char *str, size_t len, bool lower)
 {
-	lwc_hash z = 0x811c9dc5;
+	lwc_hash z = 0x811c9dc5 ^ (lwc_hash)len;
+	uint32_t w;
+
+	while (len >= 4) {
+		memcpy(&w, str, 4);
+		z = lwc__hash_step(z, lower ? lwc__lower_word(w) : w);
+		str += 4;
+		len -= 4;
+	}
 
-	while (len > 0) {
-		z *= 0x01000193;
-		z ^= *str++;
-		len--;
+	if (len > 0) {
+		w = 0;
+		memcpy(&w, str, len);
+		z = lwc__hash_step(z, lower ? lwc__lower_word(w) : w);
 	}
 
+	z ^= z >> 16;
+	z *= 0x85ebca6b;
+	z ^= z >> 13;
+	z *= 0xc2b2ae35;
+	z ^= z >> 16;
+
 	return z;
 }
 
+static inline lwc_hash
+lwc__calculate_hash(const char *str, size_t len)
+{
+	return lwc__hash(str, len, false);
+}
+
 #define STR_OF(str) ((char *)(str + 1))
 #define CSTR_OF(str) ((const char *)(str + 1))
 
-#define NR_BUCKETS_DEFAULT	(4091)
+/** Initial number of buckets, must be a power of two */
+#define NR_BUCKETS_DEFAULT	(4096)
 
 typedef struct lwc_context_s {
 	lwc_string **		buckets;
 	lwc_hash		bucketcount;
+	size_t			stringcount;
 } lwc_context;
 
 static lwc_context *ctx = NULL;
@@ -49,6 +103,49 @@ typedef lwc_hash (*lwc_hasher)(const char *, size_t);
 typedef int (*lwc_strncmp)(const char *, const char *, size_t);
 typedef void * (*lwc_memcpy)(void * restrict, const void * restrict, size_t);
 
+static int
+lwc__memcmp(const char *s1, const char *s2, size_t n)
+{
+	return memcmp(s1, s2, n);
+}
+
+/**
+ * Double the number of buckets and rehash the chains into them.
+ *
+ * Failure to allocate the larger table is not an error, the chains
+ * simply remain longer.
+ */
+static void
+lwc__grow(void)
+{
+	lwc_hash newcount = ctx->bucketcount * 2;
+	lwc_string **newbuckets;
+	lwc_string *str, *next;
+	lwc_hash n, bucket;
+
+	newbuckets = LWC_ALLOC(sizeof(lwc_string *) * newcount);
+	if (newbuckets == NULL)
+		return;
+
+	memset(newbuckets, 0, sizeof(lwc_string *) * newcount);
+
+	for (n = 0; n < ctx->bucketcount; ++n) {
+		for (str = ctx->buckets[n]; str != NULL; str = next) {
+			next = str->next;
+			bucket = str->hash & (newcount - 1);
+			str->prevptr = &(newbuckets[bucket]);
+			str->next = newbuckets[bucket];
+			if (str->next != NULL)
+				str->next->prevptr = &(str->next);
+			newbuckets[bucket] = str;
+		}
+	}
+
+	LWC_FREE(ctx->buckets);
+	ctx->buckets = newbuckets;
+	ctx->bucketcount = newcount;
+}
+
 static lwc_error
 lwc__initialise(void)
 {
@@ -100,7 +197,7 @@ lwc__intern(const char *s, size_t slen,
 	}
 
 	h = hasher(s, slen);
-	bucket = h % ctx->bucketcount;
+	bucket = h & (ctx->bucketcount - 1);
 	str = ctx->buckets[bucket];
 
 	while (str != NULL) {
@@ -120,6 +217,13 @@ lwc__intern(const char *s, size_t slen,
 	if (str == NULL)
 		return lwc_error_oom;
 
+	/* keep the average chain no longer than one string */
+	if (ctx->stringcount >= ctx->bucketcount) {
+		lwc__grow();
+		bucket = h & (ctx->bucketcount - 1);
+	}
+	ctx->stringcount++;
+
 	str->prevptr = &(ctx->buckets[bucket]);
 	str->next = ctx->buckets[bucket];
 	if (str->next != NULL)
@@ -145,7 +249,7 @@ lwc_intern_string(const char *s, size_t slen,
 {
 	return lwc__intern(s, slen, ret,
 			   lwc__calculate_hash,
-			   strncmp, (lwc_memcpy)memcpy);
+			   lwc__memcmp, (lwc_memcpy)memcpy);
 }
 
 lwc_error
@@ -193,6 +297,8 @@ lwc_string_destroy(lwc_string *str)
 	if (str->next != NULL)
 		str->next->prevptr = str->prevptr;
 
+	ctx->stringcount--;
+
 	if (str->insensitive != NULL && str->refcnt == 0)
 		lwc_string_unref(str->insensitive);
 
@@ -213,18 +319,15 @@ lwc__dolower(const char c)
 	return c;
 }
 
+/**
+ * Hash a string as if lower cased.
+ *
+ * This must match the hash of the lower cased string.
+ */
 static inline lwc_hash
 lwc__calculate_lcase_hash(const char *str, size_t len)
 {
-	lwc_hash z = 0x811c9dc5;
-
-	while (len > 0) {
-		z *= 0x01000193;
-		z ^= lwc__dolower(*str++);
-		len--;
-	}
-
-	return z;
+	return lwc__hash(str, len, true);
 }
 
 static int
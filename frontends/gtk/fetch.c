@@ -39,6 +39,7 @@
 #include <string.h>
 #include <strings.h>
 #include <gtk/gtk.h>
+#include <glib-unix.h>
 
 #include <neosurf/utils/log.h>
 #include <neosurf/utils/hashtable.h>
@@ -47,6 +48,7 @@
 #include <neosurf/utils/nsurl.h>
 #include <neosurf/utils/ascii.h>
 #include <neosurf/fetch.h>
+#include <neosurf/content/fetch.h>
 
 #include "gtk/gui.h"
 #include "gtk/resources.h"
@@ -262,11 +264,126 @@ static nsurl *nsgtk_get_resource_url(const char *path)
 	return url;
 }
 
+/** Main loop sources for watched fetch file descriptors keyed by fd */
+static GHashTable *fetch_fd_sources = NULL;
+
+
+/**
+ * Main loop callback for activity on a watched fetch file descriptor.
+ */
+static gboolean
+nsgtk_fetch_fd_ready(gint fd, GIOCondition condition, gpointer user_data)
+{
+	unsigned int events = 0;
+
+	if (condition & G_IO_IN) {
+		events |= FETCH_FD_READ;
+	}
+	if (condition & G_IO_OUT) {
+		events |= FETCH_FD_WRITE;
+	}
+	if (condition & (G_IO_ERR | G_IO_HUP | G_IO_NVAL)) {
+		events |= FETCH_FD_ERROR;
+	}
+
+	fetch_fd_ready(fd, events);
+
+	/* the source is removed through unwatch when no longer wanted */
+	return G_SOURCE_CONTINUE;
+}
+
+
+/**
+ * Watch a fetch file descriptor with a main loop source.
+ *
+ * The conditions of a unix fd source cannot be changed so an
+ * existing source is replaced.
+ */
+static nserror nsgtk_fetch_watch_fd(int fd, unsigned int events)
+{
+	GIOCondition condition = G_IO_ERR | G_IO_HUP;
+	gpointer source;
+
+	if (fetch_fd_sources == NULL) {
+		fetch_fd_sources = g_hash_table_new(g_direct_hash,
+						    g_direct_equal);
+	}
+
+	source = g_hash_table_lookup(fetch_fd_sources, GINT_TO_POINTER(fd));
+	if (source != NULL) {
+		g_source_remove(GPOINTER_TO_UINT(source));
+	}
+
+	if (events & FETCH_FD_READ) {
+		condition |= G_IO_IN;
+	}
+	if (events & FETCH_FD_WRITE) {
+		condition |= G_IO_OUT;
+	}
+
+	source = GUINT_TO_POINTER(g_unix_fd_add_full(G_PRIORITY_DEFAULT,
+						     fd,
+						     condition,
+						     nsgtk_fetch_fd_ready,
+						     NULL,
+						     NULL));
+	g_hash_table_insert(fetch_fd_sources, GINT_TO_POINTER(fd), source);
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Stop watching a fetch file descriptor.
+ */
+static nserror nsgtk_fetch_unwatch_fd(int fd)
+{
+	gpointer source;
+
+	if (fetch_fd_sources == NULL) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	source = g_hash_table_lookup(fetch_fd_sources, GINT_TO_POINTER(fd));
+	if (source == NULL) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	g_source_remove(GPOINTER_TO_UINT(source));
+	g_hash_table_remove(fetch_fd_sources, GINT_TO_POINTER(fd));
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in gtk/fetch.h */
+void gtk_fetch_fd_fin(void)
+{
+	GHashTableIter iter;
+	gpointer source;
+
+	if (fetch_fd_sources == NULL) {
+		return;
+	}
+
+	g_hash_table_iter_init(&iter, fetch_fd_sources);
+	while (g_hash_table_iter_next(&iter, NULL, &source)) {
+		g_source_remove(GPOINTER_TO_UINT(source));
+	}
+
+	g_hash_table_destroy(fetch_fd_sources);
+	fetch_fd_sources = NULL;
+}
+
+
 static struct gui_fetch_table fetch_table = {
 	.filetype = fetch_filetype,
 
 	.get_resource_url = nsgtk_get_resource_url,
 	.get_resource_data = nsgtk_data_from_resname,
+
+	.watch_fd = nsgtk_fetch_watch_fd,
+	.unwatch_fd = nsgtk_fetch_unwatch_fd,
 };
 
 struct gui_fetch_table *nsgtk_fetch_table = &fetch_table;
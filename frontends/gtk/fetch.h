@@ -25,4 +25,9 @@ void gtk_fetch_filetype_init(const char *mimefile);
 void gtk_fetch_filetype_fin(void);
 const char *fetch_filetype(const char *unix_path);
 
+/**
+ * Remove any remaining fetch file descriptor watches.
+ */
+void gtk_fetch_fd_fin(void);
+
 #endif
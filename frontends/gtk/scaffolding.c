@@ -217,6 +217,9 @@ static void scaffolding_window_destroy(GtkWidget *widget, gpointer data)
 	if (scaf_list == NULL) {
 		/* no more open windows - stop the browser */
 		nsgtk_complete = true;
+		if (gtk_main_level() > 0) {
+			gtk_main_quit();
+		}
 	}
 }
 
@@ -39,6 +39,30 @@ static GList *pending_callbacks = NULL;
 static GList *queued_callbacks = NULL;
 /** List of callbacks which are about to be run in this ::schedule_run. */
 static GList *this_run = NULL;
+/** Main loop idle source which will call ::schedule_run or 0 if none. */
+static guint schedule_run_source = 0;
+/** Whether ::schedule_run is running callbacks. */
+static bool schedule_running = false;
+
+static gboolean
+nsgtk_schedule_run_callback(gpointer data)
+{
+        schedule_run_source = 0;
+        schedule_run();
+        return FALSE;
+}
+
+/**
+ * Ensure pending callbacks are run from the main loop.
+ */
+static void
+nsgtk_schedule_run_queue(void)
+{
+        if ((pending_callbacks != NULL) && (schedule_run_source == 0)) {
+                schedule_run_source = g_idle_add(nsgtk_schedule_run_callback,
+                                                 NULL);
+        }
+}
 
 static gboolean
 nsgtk_schedule_generic_callback(gpointer data)
@@ -50,6 +74,7 @@ nsgtk_schedule_generic_callback(gpointer data)
         }
         queued_callbacks = g_list_remove(queued_callbacks, cb);
         pending_callbacks = g_list_append(pending_callbacks, cb);
+        nsgtk_schedule_run_queue();
         return FALSE;
 }
 
@@ -127,12 +152,20 @@ nserror nsgtk_schedule(int t, void (*callback)(void *p), void *cbctx)
 bool
 schedule_run(void)
 {
+        /* A callback running a nested main loop must not start
+         * another run, the pending callbacks wait for this one.
+         */
+        if (schedule_running)
+                return false;
+
         /* Capture this run of pending callbacks into the list. */
         this_run = pending_callbacks;
 
         if (this_run == NULL)
                 return false; /* Nothing to do */
 
+        schedule_running = true;
+
         /* Clear the pending list. */
         pending_callbacks = NULL;
 
@@ -148,5 +181,11 @@ schedule_run(void)
                         cb->callback(cb->context);
                 free(cb);
         }
+
+        schedule_running = false;
+
+        /* Callbacks which became pending during the run */
+        nsgtk_schedule_run_queue();
+
 	return true;
 }
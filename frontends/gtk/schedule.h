@@ -21,6 +21,13 @@
 
 nserror nsgtk_schedule(int t, void (*callback)(void *p), void *p);
 
+/**
+ * Run callbacks whose scheduled time has passed.
+ *
+ * Called from the main loop whenever callbacks become pending.
+ *
+ * \return true if any callbacks were run else false.
+ */
 bool schedule_run(void);
 
 #endif /* NETSURF_GTK_CALLBACK_H */
@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
+#include <poll.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -16,6 +17,7 @@
 #include <neosurf/utils/nsurl.h>
 #include <neosurf/fetch.h>
 #include "visurf/fetch.h"
+#include "visurf/visurf.h"
 
 extern char **respaths;
 
@@ -225,7 +227,62 @@ nsvi_fetch_get_resource_url(const char *path)
 	return url;
 }
 
+static short
+nsvi_fetch_poll_events(unsigned int events)
+{
+	short pev = 0;
+	if (events & FETCH_FD_READ) {
+		pev |= POLLIN;
+	}
+	if (events & FETCH_FD_WRITE) {
+		pev |= POLLOUT;
+	}
+	return pev;
+}
+
+/* Fetch file descriptors follow the Wayland display at fds[0] */
+static nserror
+nsvi_fetch_watch_fd(int fd, unsigned int events)
+{
+	struct nsvi_state *state = global_state;
+	for (size_t i = 1; i < state->nfd; ++i) {
+		if (state->fds[i].fd == fd) {
+			state->fds[i].events = nsvi_fetch_poll_events(events);
+			return NSERROR_OK;
+		}
+	}
+
+	struct pollfd *fds = realloc(state->fds,
+		sizeof(struct pollfd) * (state->nfd + 1));
+	if (!fds) {
+		return NSERROR_NOMEM;
+	}
+	state->fds = fds;
+	state->fds[state->nfd] = (struct pollfd){
+		.fd = fd,
+		.events = nsvi_fetch_poll_events(events),
+	};
+	++state->nfd;
+	return NSERROR_OK;
+}
+
+static nserror
+nsvi_fetch_unwatch_fd(int fd)
+{
+	struct nsvi_state *state = global_state;
+	for (size_t i = 1; i < state->nfd; ++i) {
+		if (state->fds[i].fd == fd) {
+			state->fds[i] = state->fds[state->nfd - 1];
+			--state->nfd;
+			return NSERROR_OK;
+		}
+	}
+	return NSERROR_NOT_FOUND;
+}
+
 struct gui_fetch_table vi_fetch_table = {
 	.filetype = nsvi_fetch_filetype,
 	.get_resource_url = nsvi_fetch_get_resource_url,
+	.watch_fd = nsvi_fetch_watch_fd,
+	.unwatch_fd = nsvi_fetch_unwatch_fd,
 };
@@ -58,46 +58,205 @@ fatal(const char *why)
 	exit(1);
 }
 
+#define NSVI_TIMER_BUCKETS_INITIAL 64
+
+static size_t
+nsvi_timer_hash(void (*callback)(void *p), void *p, size_t nbuckets)
+{
+	uintptr_t h = (uintptr_t)callback >> 4;
+	h = h * 31 + ((uintptr_t)p >> 3);
+	h ^= h >> 11;
+	return h & (nbuckets - 1);
+}
+
+static bool
+nsvi_timer_before(const struct nsvi_callback *a, const struct nsvi_callback *b)
+{
+	int64_t ns = timespec_sub_to_nsec(&a->due, &b->due);
+	if (ns != 0) {
+		return ns < 0;
+	}
+	return a->seq < b->seq;
+}
+
+static void
+nsvi_timer_set(struct nsvi_callback *cb, size_t index)
+{
+	global_state->timers[index] = cb;
+	cb->index = index;
+}
+
+static void
+nsvi_timer_sift_up(size_t index)
+{
+	struct nsvi_callback **timers = global_state->timers;
+	struct nsvi_callback *cb = timers[index];
+	while (index > 0) {
+		size_t parent = (index - 1) / 2;
+		if (!nsvi_timer_before(cb, timers[parent])) {
+			break;
+		}
+		nsvi_timer_set(timers[parent], index);
+		index = parent;
+	}
+	nsvi_timer_set(cb, index);
+}
+
+static void
+nsvi_timer_sift_down(size_t index)
+{
+	struct nsvi_callback **timers = global_state->timers;
+	size_t n = global_state->ntimers;
+	struct nsvi_callback *cb = timers[index];
+	while (true) {
+		size_t child = index * 2 + 1;
+		if (child >= n) {
+			break;
+		}
+		if (child + 1 < n && nsvi_timer_before(timers[child + 1], timers[child])) {
+			++child;
+		}
+		if (!nsvi_timer_before(timers[child], cb)) {
+			break;
+		}
+		nsvi_timer_set(timers[child], index);
+		index = child;
+	}
+	nsvi_timer_set(cb, index);
+}
+
+static struct nsvi_callback *
+nsvi_timer_find(void (*callback)(void *p), void *p)
+{
+	if (!global_state->timer_buckets) {
+		return NULL;
+	}
+	size_t bucket = nsvi_timer_hash(callback, p, global_state->timer_nbuckets);
+	struct nsvi_callback *cb = global_state->timer_buckets[bucket];
+	while (cb && (cb->callback != callback || cb->p != p)) {
+		cb = cb->hash_next;
+	}
+	return cb;
+}
+
+static bool
+nsvi_timer_rehash(size_t nbuckets)
+{
+	struct nsvi_callback **buckets = calloc(nbuckets, sizeof(*buckets));
+	if (!buckets) {
+		return false;
+	}
+	for (size_t i = 0; i < global_state->ntimers; ++i) {
+		struct nsvi_callback *cb = global_state->timers[i];
+		size_t bucket = nsvi_timer_hash(cb->callback, cb->p, nbuckets);
+		cb->hash_next = buckets[bucket];
+		buckets[bucket] = cb;
+	}
+	free(global_state->timer_buckets);
+	global_state->timer_buckets = buckets;
+	global_state->timer_nbuckets = nbuckets;
+	return true;
+}
+
+static nserror
+nsvi_timer_insert(struct nsvi_callback *cb)
+{
+	struct nsvi_state *state = global_state;
+	if (state->ntimers == state->timers_size) {
+		size_t size = state->timers_size ? state->timers_size * 2
+			: NSVI_TIMER_BUCKETS_INITIAL;
+		struct nsvi_callback **timers = realloc(state->timers,
+			size * sizeof(*timers));
+		if (!timers) {
+			return NSERROR_NOMEM;
+		}
+		state->timers = timers;
+		state->timers_size = size;
+	}
+	if (state->ntimers >= state->timer_nbuckets) {
+		size_t nbuckets = state->timer_nbuckets ? state->timer_nbuckets * 2
+			: NSVI_TIMER_BUCKETS_INITIAL;
+		if (!nsvi_timer_rehash(nbuckets)) {
+			return NSERROR_NOMEM;
+		}
+	}
+
+	size_t bucket = nsvi_timer_hash(cb->callback, cb->p, state->timer_nbuckets);
+	cb->hash_next = state->timer_buckets[bucket];
+	state->timer_buckets[bucket] = cb;
+
+	state->timers[state->ntimers] = cb;
+	cb->index = state->ntimers++;
+	nsvi_timer_sift_up(cb->index);
+	return NSERROR_OK;
+}
+
+static void
+nsvi_timer_remove(struct nsvi_callback *cb)
+{
+	struct nsvi_state *state = global_state;
+	size_t bucket = nsvi_timer_hash(cb->callback, cb->p, state->timer_nbuckets);
+	struct nsvi_callback **prev = &state->timer_buckets[bucket];
+	while (*prev != cb) {
+		prev = &(*prev)->hash_next;
+	}
+	*prev = cb->hash_next;
+
+	size_t index = cb->index;
+	struct nsvi_callback *last = state->timers[--state->ntimers];
+	if (last != cb) {
+		nsvi_timer_set(last, index);
+		nsvi_timer_sift_down(index);
+		nsvi_timer_sift_up(last->index);
+	}
+}
+
 static nserror
 nsvi_schedule_remove(void (*callback)(void *p), void *p)
 {
-	struct nsvi_callback **prev = &global_state->callbacks;
-	struct nsvi_callback *cb = global_state->callbacks;
-	nserror r = NSERROR_NOT_FOUND;
-	while (cb) {
-		if (cb->callback == callback && cb->p == p) {
-			struct nsvi_callback *next = cb->next;
-			*prev = next;
-			free(cb);
-			cb = next;
-			r = NSERROR_OK;
-		} else {
-			prev = &cb->next;
-			cb = cb->next;
-		}
+	struct nsvi_callback *cb = nsvi_timer_find(callback, p);
+	if (!cb) {
+		return NSERROR_NOT_FOUND;
 	}
-	return r;
+	nsvi_timer_remove(cb);
+	free(cb);
+	return NSERROR_OK;
 }
 
 static nserror
 nsvi_misc_schedule(int ms, void (*callback)(void *p), void *p)
 {
-	nserror r = nsvi_schedule_remove(callback, p);
 	if (ms < 0) {
-		return r;
+		return nsvi_schedule_remove(callback, p);
 	}
 
-	struct nsvi_callback *cb = calloc(1, sizeof(struct nsvi_callback));
-	cb->callback = callback;
-	cb->p = p;
-
 	struct timespec now;
 	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	struct nsvi_callback *cb = nsvi_timer_find(callback, p);
+	if (cb) {
+		/* Reschedule in place */
+		timespec_add_msec(&cb->due, &now, ms);
+		cb->seq = global_state->timer_seq++;
+		nsvi_timer_sift_down(cb->index);
+		nsvi_timer_sift_up(cb->index);
+		return NSERROR_OK;
+	}
+
+	cb = calloc(1, sizeof(struct nsvi_callback));
+	if (!cb) {
+		return NSERROR_NOMEM;
+	}
+	cb->callback = callback;
+	cb->p = p;
+	cb->seq = global_state->timer_seq++;
 	timespec_add_msec(&cb->due, &now, ms);
 
-	cb->next = global_state->callbacks;
-	global_state->callbacks = cb;
-	return NSERROR_OK;
+	nserror r = nsvi_timer_insert(cb);
+	if (r != NSERROR_OK) {
+		free(cb);
+	}
+	return r;
 }
 
 static struct gui_misc_table vi_misc_table = {
@@ -1367,90 +1526,64 @@ main(int argc, char *argv[]) {
 		struct timespec now;
 		clock_gettime(CLOCK_MONOTONIC, &now);
 
-		struct nsvi_callback *next = NULL;
-		struct nsvi_callback *cb = state.callbacks;
-		while (cb) {
-			int64_t ns = timespec_sub_to_nsec(&cb->due, &now);
-			if (ns <= 0) {
-				struct nsvi_callback copy = *cb;
-				nsvi_schedule_remove(copy.callback, copy.p);
-				copy.callback(copy.p);
-				cb = state.callbacks;
-				next = NULL;
-			} else if (!next) {
-				next = cb;
-				cb = cb->next;
-			} else {
-				ns = timespec_sub_to_nsec(&cb->due, &next->due);
-				if (ns <= 0) {
-					next = cb;
-				}
-				cb = cb->next;
+		/* Callbacks scheduled while running these wait for the
+		 * next iteration so a callback rescheduling itself with
+		 * no delay cannot starve the event loop.
+		 */
+		uint64_t seq_limit = state.timer_seq;
+		while (state.ntimers > 0) {
+			struct nsvi_callback *cb = state.timers[0];
+			if (cb->seq >= seq_limit
+					|| timespec_sub_to_nsec(&cb->due, &now) > 0) {
+				break;
 			}
+			void (*callback)(void *p) = cb->callback;
+			void *p = cb->p;
+			nsvi_timer_remove(cb);
+			free(cb);
+			callback(p);
 		}
 
 		int timeout = -1;
-		if (next) {
+		if (state.ntimers > 0) {
 			struct timespec diff;
-			timespec_sub(&diff, &next->due, &now);
+			timespec_sub(&diff, &state.timers[0]->due, &now);
 			timeout = timespec_to_msec(&diff);
 			if (timeout <= 0) {
 				timeout = 0;
 			}
 		}
 
-		int max_fd;
-		fd_set read_fd, write_fd, except_fd;
-		nserror err = fetch_fdset(&read_fd, &write_fd, &except_fd, &max_fd);
-		if (err != NSERROR_OK) {
-			fatal("fetch_fdset error");
-			break;
+		int r = poll(state.fds, state.nfd, timeout);
+		if (r < 0) {
+			fatal("poll(2) failed");
+		}
+		if (state.fds[0].revents & POLLIN) {
+			wl_display_dispatch(state.wl_display);
 		}
 
-		size_t nfetch = 0;
-		for (int fd = 0; fd <= max_fd; ++fd) {
-			bool present = FD_ISSET(fd, &read_fd)
-				|| FD_ISSET(fd, &write_fd)
-				|| FD_ISSET(fd, &except_fd);
-			if (present) {
-				++nfetch;
+		/* Fetchers may watch and unwatch descriptors as they
+		 * handle events so work from a copy of the results.
+		 */
+		size_t nready = 0;
+		struct pollfd ready[state.nfd];
+		for (size_t i = 1; i < state.nfd; ++i) {
+			if (state.fds[i].revents) {
+				ready[nready++] = state.fds[i];
 			}
 		}
-		if (state.nfd < nfetch + 1) {
-			state.nfd = nfetch + 1;
-			state.fds = realloc(state.fds,
-				sizeof(struct pollfd) * state.nfd);
-		}
-		int i = 1;
-		for (int fd = 0; nfetch && fd <= max_fd; ++fd) {
-			bool present = FD_ISSET(fd, &read_fd)
-				|| FD_ISSET(fd, &write_fd)
-				|| FD_ISSET(fd, &except_fd);
-			if (present) {
-				state.fds[i].events = 0;
-				state.fds[i].fd = fd;
-			}
-			if (FD_ISSET(fd, &read_fd)) {
-				state.fds[i].events |= POLLIN | POLLHUP | POLLERR;
+		for (size_t i = 0; i < nready; ++i) {
+			unsigned int events = 0;
+			if (ready[i].revents & POLLIN) {
+				events |= FETCH_FD_READ;
 			}
-			if (FD_ISSET(fd, &write_fd)) {
-				state.fds[i].events |= POLLOUT | POLLERR;
+			if (ready[i].revents & POLLOUT) {
+				events |= FETCH_FD_WRITE;
 			}
-			if (FD_ISSET(fd, &except_fd)) {
-				state.fds[i].events |= POLLERR;
+			if (ready[i].revents & (POLLERR | POLLHUP | POLLNVAL)) {
+				events |= FETCH_FD_ERROR;
 			}
-			if (present) {
-				++i;
-			}
-		}
-		assert((size_t)i == nfetch + 1);
-
-		int r = poll(state.fds, nfetch + 1, timeout);
-		if (r < 0) {
-			fatal("poll(2) failed");
-		}
-		if (state.fds[0].revents & POLLIN) {
-			wl_display_dispatch(state.wl_display);
+			fetch_fd_ready(ready[i].fd, events);
 		}
 	}
 
@@ -1479,12 +1612,11 @@ main(int argc, char *argv[]) {
 	nsvi_config_finish();
 	nsvi_bindings_finish(&state.bindings);
 
-	struct nsvi_callback *cb = state.callbacks;
-	while (cb) {
-		struct nsvi_callback *next = cb->next;
-		free(cb);
-		cb = next;
+	for (size_t i = 0; i < state.ntimers; ++i) {
+		free(state.timers[i]);
 	}
+	free(state.timers);
+	free(state.timer_buckets);
 
 	wl_cursor_theme_destroy(state.cursors);
 	xkb_keymap_unref(state.xkb_keymap);
@@ -109,7 +109,13 @@ struct nsvi_state {
 	int32_t repeat_rate, repeat_delay;
 	uint32_t repeat_key;
 
-	struct nsvi_callback *callbacks;
+	/* Scheduled callbacks, a binary min-heap ordered by due time */
+	struct nsvi_callback **timers;
+	size_t ntimers, timers_size;
+	/* Scheduled callbacks hashed by (callback, p) for cancellation */
+	struct nsvi_callback **timer_buckets;
+	size_t timer_nbuckets;
+	uint64_t timer_seq;
 	struct pollfd *fds;
 	size_t nfd;
 };
@@ -118,7 +124,9 @@ struct nsvi_callback {
 	void (*callback)(void *p);
 	void *p;
 	struct timespec due;
-	struct nsvi_callback *next;
+	uint64_t seq; // Orders callbacks due at the same time
+	size_t index; // Position in the timer heap
+	struct nsvi_callback *hash_next;
 };
 
 struct nsvi_output {
@@ -6,6 +6,7 @@
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <sys/mman.h>
 #include <unistd.h>
 #include <wayland-client.h>
@@ -429,6 +430,143 @@ draw_hints(struct nsvi_window *win, struct pool_buffer *buf)
 	cairo_restore(buf->cairo);
 }
 
+static void
+page_origin(struct nsvi_window *win, struct gui_window *gw, int *x, int *y)
+{
+	int bx = gw->sx;
+	int by = win->tab_height;
+
+	if (bx > 0) {
+		bx = 0;
+	}
+
+	if (gw->sy < 0) {
+		by += gw->sy;
+	}
+
+	*x = bx, *y = by;
+}
+
+static void
+damage_reset(struct nsvi_damage *damage)
+{
+	damage->full = false;
+	damage->nrect = 0;
+}
+
+static void
+rect_union(struct rect *r, const struct rect *other)
+{
+	r->x0 = other->x0 < r->x0 ? other->x0 : r->x0;
+	r->y0 = other->y0 < r->y0 ? other->y0 : r->y0;
+	r->x1 = other->x1 > r->x1 ? other->x1 : r->x1;
+	r->y1 = other->y1 > r->y1 ? other->y1 : r->y1;
+}
+
+// Returns false if the intersection is empty
+static bool
+rect_intersect(struct rect *r, const struct rect *clip)
+{
+	r->x0 = clip->x0 > r->x0 ? clip->x0 : r->x0;
+	r->y0 = clip->y0 > r->y0 ? clip->y0 : r->y0;
+	r->x1 = clip->x1 < r->x1 ? clip->x1 : r->x1;
+	r->y1 = clip->y1 < r->y1 ? clip->y1 : r->y1;
+	return r->x0 < r->x1 && r->y0 < r->y1;
+}
+
+static void
+damage_add(struct nsvi_damage *damage, const struct rect *rect)
+{
+	if (damage->full) {
+		return;
+	}
+
+	struct rect r = *rect;
+	for (size_t i = 0; i < damage->nrect;) {
+		struct rect *d = &damage->rects[i];
+		if (d->x0 > r.x1 || r.x0 > d->x1 || d->y0 > r.y1 || r.y0 > d->y1) {
+			++i;
+			continue;
+		}
+		// Merge, then start again as the union may now touch
+		// rectangles it missed before
+		rect_union(&r, d);
+		*d = damage->rects[--damage->nrect];
+		i = 0;
+	}
+
+	if (damage->nrect == NSVI_DAMAGE_RECTS) {
+		for (size_t i = 0; i < damage->nrect; ++i) {
+			rect_union(&r, &damage->rects[i]);
+		}
+		damage->nrect = 0;
+	}
+	damage->rects[damage->nrect++] = r;
+}
+
+static void
+damage_clip(cairo_t *cairo, const struct nsvi_damage *damage)
+{
+	for (size_t i = 0; i < damage->nrect; ++i) {
+		const struct rect *r = &damage->rects[i];
+		cairo_rectangle(cairo, r->x0, r->y0, r->x1 - r->x0, r->y1 - r->y0);
+	}
+	cairo_clip(cairo);
+}
+
+static void
+buffer_copy_rect(struct pool_buffer *dst, struct pool_buffer *src,
+		const struct rect *rect, int scale)
+{
+	struct rect r = {
+		.x0 = rect->x0 * scale, .y0 = rect->y0 * scale,
+		.x1 = rect->x1 * scale, .y1 = rect->y1 * scale,
+	};
+	struct rect bounds = { 0, 0, dst->width, dst->height };
+	if (!rect_intersect(&r, &bounds)) {
+		return;
+	}
+
+	size_t stride = dst->width * 4;
+	for (int y = r.y0; y < r.y1; ++y) {
+		size_t offs = y * stride + r.x0 * 4;
+		memcpy((char *)dst->data + offs, (char *)src->data + offs,
+				(r.x1 - r.x0) * 4);
+	}
+}
+
+// Brings the buffer up to date with the last presented frame, so that only
+// the new damage needs drawing. A buffer which was presented the frame
+// before last only lacks the last frame's damage; anything else is copied
+// in full.
+static void
+buffer_catch_up(struct nsvi_window *win, size_t index)
+{
+	size_t p = win->presented;
+	if (index == p) {
+		return;
+	}
+
+	struct pool_buffer *dst = &win->buffers[index];
+	struct pool_buffer *src = &win->buffers[p];
+	cairo_surface_flush(dst->surface);
+
+	if (!win->last_damage.full &&
+			win->drawn[index].width == dst->width &&
+			win->drawn[index].height == dst->height &&
+			win->drawn[index].scale == win->scale &&
+			win->drawn[index].frame + 1 == win->drawn[p].frame) {
+		for (size_t i = 0; i < win->last_damage.nrect; ++i) {
+			buffer_copy_rect(dst, src,
+				&win->last_damage.rects[i], win->scale);
+		}
+	} else {
+		memcpy(dst->data, src->data, dst->size);
+	}
+
+	cairo_surface_mark_dirty(dst->surface);
+}
+
 static bool
 draw_frame(struct nsvi_window *win)
 {
@@ -441,17 +579,40 @@ draw_frame(struct nsvi_window *win)
 	}
 	activebuffer = buffer;
 
+	size_t index = buffer - win->buffers;
+	bool partial = !win->damage.full && win->damage.nrect != 0 &&
+		win->presented >= 0 &&
+		win->drawn[win->presented].width == buffer->width &&
+		win->drawn[win->presented].height == buffer->height &&
+		win->drawn[win->presented].scale == win->scale;
+	if (partial) {
+		buffer_catch_up(win, index);
+	}
+
 	struct gui_window *gw = win->tabs[win->tab];
 
 	cairo_save(buffer->cairo);
 	cairo_scale(buffer->cairo, win->scale, win->scale);
+	if (partial) {
+		damage_clip(buffer->cairo, &win->damage);
+	}
+
 	int tab_height = draw_tabs(win, buffer);
+	int status_height = draw_status(win, buffer);
+	if (partial && (tab_height != win->tab_height
+			|| status_height != win->status_height)) {
+		// The page has moved, so all of it has to be redrawn
+		partial = false;
+		cairo_reset_clip(buffer->cairo);
+		tab_height = draw_tabs(win, buffer);
+		status_height = draw_status(win, buffer);
+	}
+
 	if (tab_height != win->tab_height) {
 		win->tab_height = tab_height;
 		browser_window_schedule_reformat(gw->bw);
 	}
 
-	int status_height = draw_status(win, buffer);
 	if (status_height != win->status_height) {
 		win->status_height = status_height;
 		browser_window_schedule_reformat(gw->bw);
@@ -469,21 +630,28 @@ draw_frame(struct nsvi_window *win)
 	clip.x1 = win->width;
 	clip.y1 = win->height - status_height;
 
-	int bx = gw->sx;
-	int by = win->tab_height;
+	int bx, by;
+	page_origin(win, gw, &bx, &by);
 
-	if (bx > 0) {
-		bx = 0;
-	}
+	if (partial) {
+		for (size_t i = 0; i < win->damage.nrect; ++i) {
+			struct rect r = win->damage.rects[i];
+			if (!rect_intersect(&r, &clip)) {
+				continue;
+			}
+			browser_window_redraw(gw->bw, bx, by, &r, &ctx);
+		}
 
-	if (gw->sy < 0) {
-		by += gw->sy;
+		// The plotters replace the clip, so restore it for the
+		// caret and hints
+		cairo_reset_clip(buffer->cairo);
+		damage_clip(buffer->cairo, &win->damage);
+	} else {
+		browser_window_redraw(gw->bw,
+				bx, by,
+				&clip, &ctx);
 	}
 
-	browser_window_redraw(gw->bw,
-			bx, by,
-			&clip, &ctx);
-
 	if (gw->caret.enabled) {
 		cairo_set_source_u32(buffer->cairo, config.caret.color);
 		int x = gw->caret.x + gw->sx,
@@ -499,9 +667,29 @@ draw_frame(struct nsvi_window *win)
 	}
 
 	wl_surface_set_buffer_scale(win->wl_surface, win->scale);
-	wl_surface_damage_buffer(win->wl_surface, 0, 0, INT32_MAX, INT32_MAX);
+	if (partial) {
+		for (size_t i = 0; i < win->damage.nrect; ++i) {
+			const struct rect *r = &win->damage.rects[i];
+			wl_surface_damage_buffer(win->wl_surface,
+				r->x0 * win->scale, r->y0 * win->scale,
+				(r->x1 - r->x0) * win->scale,
+				(r->y1 - r->y0) * win->scale);
+		}
+		win->last_damage = win->damage;
+	} else {
+		wl_surface_damage_buffer(win->wl_surface,
+				0, 0, INT32_MAX, INT32_MAX);
+		damage_reset(&win->last_damage);
+		win->last_damage.full = true;
+	}
 	wl_surface_attach(win->wl_surface, buffer->buffer, 0, 0);
 
+	win->drawn[index].width = buffer->width;
+	win->drawn[index].height = buffer->height;
+	win->drawn[index].scale = win->scale;
+	win->drawn[index].frame = ++win->frame;
+	win->presented = index;
+	damage_reset(&win->damage);
 	win->dirty = false;
 
 	if (!win->pending_frame) {
@@ -537,8 +725,8 @@ static const struct wl_callback_listener wl_surface_frame_listener = {
 	.done = wl_surface_frame_done,
 };
 
-void
-request_frame(struct nsvi_window *win)
+static void
+schedule_frame(struct nsvi_window *win)
 {
 	win->dirty = true;
 	if (win->pending_frame) {
@@ -552,6 +740,22 @@ request_frame(struct nsvi_window *win)
 	win->pending_frame = true;
 }
 
+void
+request_frame(struct nsvi_window *win)
+{
+	win->damage.full = true;
+	schedule_frame(win);
+}
+
+// Requests a frame redrawing only part of the window, in surface-local
+// coordinates
+static void
+request_frame_rect(struct nsvi_window *win, const struct rect *rect)
+{
+	damage_add(&win->damage, rect);
+	schedule_frame(win);
+}
+
 static const char *
 nsvi_window_xcursor(enum gui_pointer_shape shape)
 {
@@ -679,6 +883,7 @@ xdg_surface_configure(void *data,
 	struct nsvi_window *win = data;
 	xdg_surface_ack_configure(xdg_surface, serial);
 
+	win->damage.full = true;
 	if (!draw_frame(win)) {
 		return;
 	}
@@ -762,6 +967,7 @@ nsvi_window_create(void)
 	win->width = 640;
 	win->height = 480;
 	win->scale = 1;
+	win->presented = -1;
 	win->mouse.shape = GUI_POINTER_DEFAULT;
 
 	// TEMP
@@ -916,8 +1122,28 @@ nsvi_window_invalidate(struct gui_window *gw, const struct rect *rect)
 		return NSERROR_OK;
 	}
 
-	// TODO: Partial invaliation
-	request_frame(win);
+	if (!rect) {
+		request_frame(win);
+		return NSERROR_OK;
+	}
+
+	int bx, by;
+	page_origin(win, gw, &bx, &by);
+
+	// Only the page is redrawn for the core
+	struct rect r = {
+		.x0 = rect->x0 + bx, .y0 = rect->y0 + by,
+		.x1 = rect->x1 + bx, .y1 = rect->y1 + by,
+	};
+	struct rect page = {
+		0, win->tab_height,
+		win->width, win->height - win->status_height,
+	};
+	if (!rect_intersect(&r, &page)) {
+		return NSERROR_OK;
+	}
+
+	request_frame_rect(win, &r);
 	return NSERROR_OK;
 }
 
@@ -4,6 +4,7 @@
 #include <xkbcommon/xkbcommon.h>
 #include <neosurf/desktop/search.h>
 #include <neosurf/mouse.h>
+#include <neosurf/types.h>
 #include "visurf/pool-buffer.h"
 #include "visurf/visurf.h"
 #include <neosurf/utils/nsurl.h>
@@ -69,6 +70,17 @@ struct nsvi_window_touch {
 	};
 };
 
+#define NSVI_DAMAGE_RECTS 8
+
+// Area of a window which has to be redrawn, in surface-local coordinates.
+// Overlapping rectangles are merged, and once there are too many of them
+// they are replaced by their bounding box.
+struct nsvi_damage {
+	bool full;
+	size_t nrect;
+	struct rect rects[NSVI_DAMAGE_RECTS];
+};
+
 // An nsvi_window has one XDG toplevel and may have one or more tabs.
 struct nsvi_window {
 	struct nsvi_state *state;
@@ -79,6 +91,18 @@ struct nsvi_window {
 	struct zxdg_toplevel_decoration_v1 *xdg_toplevel_decoration;
 	struct pool_buffer buffers[2];
 
+	// Damage since the last frame was drawn, and the damage the last
+	// frame drew. Frames redraw only their damage, after bringing the
+	// buffer up to date with the last presented frame.
+	struct nsvi_damage damage, last_damage;
+	int presented; // index of the last presented buffer, or -1
+	uint64_t frame;
+	struct {
+		uint32_t width, height; // 0 if never drawn
+		int scale;
+		uint64_t frame;
+	} drawn[2];
+
 	struct gui_window **tabs;
 	size_t ntab, tab;
 
@@ -121,6 +121,12 @@ bool bitmap_test_opaque(void *bitmap);
 
 /**
  * Bitmap operations.
+ *
+ * When the core is built with thread support images may be decoded on
+ * worker threads. A worker may call any operation except render on a
+ * bitmap it created and has not yet handed back to the browser thread,
+ * so operations must only touch the state of the bitmap they are
+ * given. Every other call is made from the browser thread.
  */
 struct gui_bitmap_table {
 	/* Mandatory entries */
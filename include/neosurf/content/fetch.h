@@ -93,6 +93,19 @@ typedef struct fetch_msg {
 	} data;
 } fetch_msg;
 
+/**
+ * Fetch dispatch priority
+ *
+ * Queued fetches of a higher priority are dispatched before those of
+ * a lower priority whenever their host has a free fetch slot.
+ */
+typedef enum fetch_priority {
+	FETCH_PRIORITY_HIGH = 0, /**< Documents and render blocking resources */
+	FETCH_PRIORITY_NORMAL, /**< Resources not blocking rendering */
+	FETCH_PRIORITY_LOW, /**< Images and other deferrable resources */
+	FETCH_PRIORITY_COUNT /**< Number of fetch priorities */
+} fetch_priority;
+
 /**
  * Fetch POST multipart data
  */
@@ -135,6 +148,7 @@ typedef void (*fetch_callback)(const fetch_msg *msg, void *p);
  * \param post_multipart
  * \param verifiable
  * \param downgrade_tls
+ * \param priority Priority to dispatch the fetch with
  * \param headers
  * \param fetch_out ponter to recive new fetch object.
  * \return NSERROR_OK and fetch_out updated else appropriate error code
@@ -143,6 +157,7 @@ nserror fetch_start(nsurl *url, nsurl *referer, fetch_callback callback,
 		    void *p, bool only_2xx, const char *post_urlenc,
 		    const struct fetch_multipart_data *post_multipart,
 		    bool verifiable, bool downgrade_tls,
+		    fetch_priority priority,
 		    const char *headers[], struct fetch **fetch_out);
 
 /**
@@ -260,4 +275,18 @@ void fetch_set_cookie(struct fetch *fetch, const char *data);
  */
 nserror fetch_fdset(fd_set *read_fd_set, fd_set *write_fd_set, fd_set *except_fd_set, int *maxfd);
 
+/**
+ * Inform the fetchers of activity on a watched file descriptor.
+ *
+ * Frontends which provide the watch_fd and unwatch_fd fetch table
+ * entries call this from their event loop when a watched file
+ * descriptor becomes ready.
+ *
+ * \param fd The file descriptor which is ready.
+ * \param events Bitmask of ::fetch_fd_event which occurred.
+ * \return NSERROR_OK on success or NSERROR_NOT_FOUND if the file
+ *         descriptor is not being watched.
+ */
+nserror fetch_fd_ready(int fd, unsigned int events);
+
 #endif
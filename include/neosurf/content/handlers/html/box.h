@@ -35,6 +35,7 @@
 
 struct content;
 struct box;
+struct box_index;
 struct browser_window;
 struct html_content;
 struct nsurl;
@@ -88,7 +89,8 @@ typedef enum {
 	REPLACE_DIM = 1 << 9,	/* replaced element has given dimensions */
 	IFRAME      = 1 << 10,	/* box contains an iframe */
 	CONVERT_CHILDREN = 1 << 11,  /* wanted children converting */
-	IS_REPLACED = 1 << 12	/* box is a replaced element */
+	IS_REPLACED = 1 << 12,	/* box is a replaced element */
+	NEED_LAYOUT = 1 << 13	/* box or a descendant changed since layout */
 } box_flags;
 
 
@@ -260,6 +262,12 @@ struct box {
 	 */
 	struct box *float_container;
 
+	/**
+	 * Spatial index of children and float children, or NULL if
+	 * there are too few to be worth indexing. Built by layout.
+	 */
+	struct box_index *index;
+
 	/**
 	 * Level below which subsequent floats must be cleared.  This
 	 * is used only for boxes with float_children
@@ -35,6 +35,7 @@ struct gui_layout_table;
 struct scrollbar_msg_data;
 struct content_redraw_data;
 struct selection;
+struct html_display_list;
 
 typedef enum {
 	HTML_DRAG_NONE,			/** No drag */
@@ -124,6 +125,9 @@ typedef struct html_content {
 	/** Whether an initial layout has been done */
 	bool had_initial_layout;
 
+	/** Whether unchanged parts of the previous layout may be kept */
+	bool layout_reuse;
+
 	/** Whether scripts are enabled for this content */
 	bool enable_scripting;
 
@@ -138,6 +142,8 @@ typedef struct html_content {
 	void *box_conversion_context;
 	/** Box tree, or NULL. */
 	struct box *layout;
+	/** Recorded plot operations of the laid out box tree, or NULL. */
+	struct html_display_list *display_list;
 	/** Document background colour. */
 	colour background_colour;
 
@@ -299,6 +305,35 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 		const struct rect *clip, const struct redraw_context *ctx);
 
 
+bool html_redraw_box(const html_content *html, struct box *box,
+		int x_parent, int y_parent,
+		const struct rect *clip, float scale,
+		colour current_background_color,
+		const struct redraw_context *ctx);
+
+
+/**
+ * Draw the object, canvas or iframe occupying a box.
+ *
+ * \param  box       box to draw
+ * \param  tag_type  element type of the box's node
+ * \param  x         coordinate of the box's content edge
+ * \param  y         coordinate of the box's content edge
+ * \param  width     width of the box's content, scaled
+ * \param  height    height of the box's content, scaled
+ * \param  clip      clip rectangle
+ * \param  scale     scale for redraw
+ * \param  current_background_color  background colour under the box
+ * \param  ctx       current redraw context
+ * \return true if successful, false otherwise
+ */
+bool html_redraw_replaced(struct box *box, dom_html_element_type tag_type,
+		int x, int y, int width, int height,
+		const struct rect *clip, float scale,
+		colour current_background_color,
+		const struct redraw_context *ctx);
+
+
 /* in html/redraw_border.c */
 bool html_redraw_borders(struct box *box, int x_parent, int y_parent,
 		int p_width, int p_height, const struct rect *clip, float scale,
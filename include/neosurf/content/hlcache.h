@@ -68,6 +68,9 @@ enum hlcache_retrieve_flag {
 	/* Note: low-level cache retrieval flags occupy the bottom 16 bits of
 	 * the flags word. High-level cache flags occupy the top 16 bits.
 	 * To avoid confusion, high-level flags are allocated from bit 31 down.
+	 *
+	 * The low-level fetch priority flags are passed through so callers
+	 * may indicate how urgently a resource is required.
 	 */
 	/** It's permitted to convert this request into a download */
 	HLCACHE_RETRIEVE_MAY_DOWNLOAD = (1 << 31),
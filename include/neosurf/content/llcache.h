@@ -60,7 +60,11 @@ enum llcache_retrieve_flag {
 	/**< No error pages */
 	LLCACHE_RETRIEVE_NO_ERROR_PAGES = (1 << 2),
 	/**< Stream data (implies that object is not cacheable) */
-	LLCACHE_RETRIEVE_STREAM_DATA    = (1 << 3)
+	LLCACHE_RETRIEVE_STREAM_DATA    = (1 << 3),
+	/**< Fetch is for a document or render blocking resource */
+	LLCACHE_RETRIEVE_PRIORITY_HIGH  = (1 << 4),
+	/**< Fetch is for a deferrable resource such as an image */
+	LLCACHE_RETRIEVE_PRIORITY_LOW   = (1 << 5)
 };
 
 /** Low-level cache event types */
@@ -180,6 +180,9 @@ NSOPTION_BOOL(incremental_reflow, true)
 /* Minimum time (in cs) between HTML reflows while objects are fetching */
 NSOPTION_UINT(min_reflow_period, DEFAULT_REFLOW_PERIOD)
 
+/* Time (in ms) to spend constructing boxes before yielding to the frontend */
+NSOPTION_UINT(box_construct_budget, 4)
+
 /* use core selection menu */
 NSOPTION_BOOL(core_select_menu, false)
 
@@ -217,6 +220,13 @@ NSOPTION_UINT(curl_fetch_timeout, 30)
 /** Suppress debug output from cURL. */
 NSOPTION_BOOL(suppress_curl_debug, true)
 
+/** Use HTTP/2 where the server supports it, multiplexing fetches to
+ * the same host over a single connection. When enabled the
+ * max_fetchers_per_host limit applies to connections rather than
+ * simultaneous fetches.
+ */
+NSOPTION_BOOL(curl_http2, false)
+
 /** Whether to allow target="_blank" */
 NSOPTION_BOOL(target_blank, true)
 
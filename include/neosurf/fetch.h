@@ -27,6 +27,15 @@
 
 struct nsurl;
 
+/**
+ * File descriptor events a fetcher may wait for.
+ */
+enum fetch_fd_event {
+	FETCH_FD_READ = 1, /**< Data is available to read */
+	FETCH_FD_WRITE = 2, /**< Data may be written */
+	FETCH_FD_ERROR = 4 /**< An error or hangup occurred */
+};
+
 /**
  * function table for fetcher operations.
  */
@@ -99,6 +108,32 @@ struct gui_fetch_table {
 	 */
 	char *(*mimetype)(const char *ro_path);
 
+	/**
+	 * Watch a file descriptor on behalf of the fetchers.
+	 *
+	 * Called when a fetcher starts waiting on a file descriptor
+	 * or the events it is waiting for change. The frontend should
+	 * add the descriptor to its event loop and call
+	 * fetch_fd_ready() whenever any of the events occur until
+	 * unwatch_fd is called for it.
+	 *
+	 * If this and unwatch_fd are not provided the fetchers are
+	 * polled from the scheduler instead.
+	 *
+	 * \param fd The file descriptor to watch.
+	 * \param events Bitmask of ::fetch_fd_event to wait for.
+	 * \return NSERROR_OK on success else appropriate error code.
+	 */
+	nserror (*watch_fd)(int fd, unsigned int events);
+
+	/**
+	 * Stop watching a file descriptor on behalf of the fetchers.
+	 *
+	 * \param fd The file descriptor previously passed to watch_fd.
+	 * \return NSERROR_OK on success else appropriate error code.
+	 */
+	nserror (*unwatch_fd)(int fd);
+
 };
 
 #endif
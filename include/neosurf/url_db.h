@@ -44,6 +44,9 @@ struct url_data {
 /**
  * Import an URL database from file, replacing any existing database
  *
+ * Both the binary format written by urldb_save() and the text format
+ * of earlier versions are accepted.
+ *
  * \param filename Name of file containing data
  */
 nserror urldb_load(const char *filename);
@@ -52,6 +55,9 @@ nserror urldb_load(const char *filename);
 /**
  * Export the current database to file
  *
+ * The database is written in binary format to a temporary file which
+ * then replaces \a filename.
+ *
  * \param filename Name of file to export to
  */
 nserror urldb_save(const char *filename);
@@ -28,7 +28,14 @@
  * Active fetches are held in the circular linked list ::fetch_ring. There may
  * be at most nsoption max_fetchers_per_host active requests per Host: header.
  * There may be at most nsoption max_fetchers active requests overall. Inactive
- * fetches are stored in the ::queue_ring waiting for use.
+ * fetches are stored in a queue ring for their priority on the entry for
+ * their host in the ::fetch_hosts table, waiting for use.
+ *
+ * Hosts with queued fetches of a priority and a free slot are kept on
+ * the ::fetch_ready ring for that priority, so choosing the next fetch
+ * to dispatch never needs to skip over saturated hosts. Queued fetches
+ * are dispatched from a scheduled callback whenever a fetch is added
+ * or an active fetch completes.
  */
 
 #include <stdlib.h>
@@ -48,6 +55,7 @@
 #include <neosurf/utils/nsurl.h>
 #include "utils/ring.h"
 #include <neosurf/misc.h>
+#include <neosurf/fetch.h>
 #include <neosurf/desktop/gui_internal.h>
 
 #include <neosurf/content/fetch.h>
@@ -73,6 +81,9 @@
 /** The fdset timeout in ms */
 #define FDSET_TIMEOUT 1000
 
+/** The number of buckets in the per host table (must be a power of two) */
+#define FETCH_HOST_BUCKETS 64
+
 /**
  * Information about a fetcher for a given scheme.
  */
@@ -85,6 +96,39 @@ typedef struct scheme_fetcher_s {
 
 static scheme_fetcher fetchers[MAX_FETCHERS];
 
+/**
+ * A file descriptor watched on behalf of a fetcher.
+ */
+struct fetch_fd_watch {
+	fetcher_fd_callback cb; /**< Callback or NULL if not watched */
+	void *pw; /**< Callback context */
+};
+
+/**
+ * Per host fetch accounting.
+ *
+ * Entries are kept per fetcher as each fetcher may limit the fetches
+ * to a host differently.
+ */
+struct fetch_host {
+	lwc_string *host;	/**< Host name, interned, may be NULL */
+	int fetcherd;		/**< Fetcher descriptor of the fetches */
+	int active;		/**< Number of active fetches to the host */
+	int refcount;		/**< Number of fetches referring to entry */
+	struct fetch_host *next; /**< Next entry in hash bucket */
+
+	/** Rings of queued fetches to the host for each priority */
+	struct fetch *queue[FETCH_PRIORITY_COUNT];
+
+	/** Next host in the ::fetch_ready ring for each priority or
+	 * NULL when not ready at that priority
+	 */
+	struct fetch_host *ready_next[FETCH_PRIORITY_COUNT];
+
+	/** Previous host in the ::fetch_ready ring for each priority */
+	struct fetch_host *ready_prev[FETCH_PRIORITY_COUNT];
+};
+
 /** Information for a single fetch. */
 struct fetch {
 	fetch_callback callback;/**< Callback function. */
@@ -93,17 +137,42 @@ struct fetch {
 	bool verifiable;	/**< Transaction is verifiable */
 	void *p;		/**< Private data for callback. */
 	lwc_string *host;	/**< Host part of URL, interned */
+	struct fetch_host *host_entry; /**< Accounting entry for host */
 	long http_code;		/**< HTTP response code, or 0. */
 	int fetcherd;           /**< Fetcher descriptor for this fetch */
 	void *fetcher_handle;	/**< The handle for the fetcher. */
 	bool fetch_is_active;	/**< This fetch is active. */
+	fetch_priority priority; /**< Dispatch priority of this fetch */
 	fetch_msg_type last_msg;/**< The last message sent for this fetch */
-	struct fetch *r_prev;	/**< Previous active fetch in ::fetch_ring. */
-	struct fetch *r_next;	/**< Next active fetch in ::fetch_ring. */
+	struct fetch *r_prev;	/**< Previous fetch in active or queue ring. */
+	struct fetch *r_next;	/**< Next fetch in active or queue ring. */
 };
 
 static struct fetch *fetch_ring = NULL;	/**< Ring of active fetches. */
-static struct fetch *queue_ring = NULL;	/**< Ring of queued fetches */
+
+/** Rings of hosts with queued fetches and a free slot for each priority */
+static struct fetch_host *fetch_ready[FETCH_PRIORITY_COUNT];
+
+static int fetch_active_count = 0; /**< Number of fetches in ::fetch_ring */
+static int fetch_queued_count = 0; /**< Number of fetches in host queues */
+
+/** Number of active fetches whose fetcher must be polled */
+static int fetch_polled_count = 0;
+
+/** Flag for a fetcher refusing to start a fetch during the last dispatch */
+static bool fetch_dispatch_deferred = false;
+
+/** File descriptor watches indexed by file descriptor */
+static struct fetch_fd_watch *fetch_fd_watches = NULL;
+
+/** Number of entries in ::fetch_fd_watches */
+static int fetch_fd_watches_size = 0;
+
+/** Hash table of per host accounting entries */
+static struct fetch_host *fetch_hosts[FETCH_HOST_BUCKETS];
+
+/** Whether a dispatch of queued fetches has been scheduled */
+static bool fetch_dispatch_scheduled = false;
 
 /******************************************************************************
  * fetch internals							      *
@@ -123,6 +192,84 @@ static inline void fetch_unref_fetcher(int fetcherd)
 	}
 }
 
+/**
+ * Get the hash bucket for a host.
+ */
+static inline struct fetch_host **
+fetch_host_bucket(lwc_string *host, int fetcherd)
+{
+	uint32_t hash = fetcherd;
+
+	if (host != NULL) {
+		hash ^= lwc_string_hash_value(host);
+	}
+	return &fetch_hosts[hash & (FETCH_HOST_BUCKETS - 1)];
+}
+
+/**
+ * Obtain a reference to the accounting entry for a host.
+ *
+ * \param host The interned host name, may be NULL.
+ * \param fetcherd The fetcher descriptor of the fetch.
+ * \return The host entry or NULL on memory exhaustion.
+ */
+static struct fetch_host *fetch_host_ref(lwc_string *host, int fetcherd)
+{
+	struct fetch_host **bucket = fetch_host_bucket(host, fetcherd);
+	struct fetch_host *entry;
+
+	/* interned strings may be compared by pointer */
+	for (entry = *bucket; entry != NULL; entry = entry->next) {
+		if ((entry->host == host) && (entry->fetcherd == fetcherd)) {
+			entry->refcount++;
+			return entry;
+		}
+	}
+
+	entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+
+	if (host != NULL) {
+		entry->host = lwc_string_ref(host);
+	}
+	entry->fetcherd = fetcherd;
+	entry->refcount = 1;
+	entry->next = *bucket;
+	*bucket = entry;
+
+	return entry;
+}
+
+/**
+ * Release a reference to a host accounting entry.
+ */
+static void fetch_host_unref(struct fetch_host *entry)
+{
+	struct fetch_host **prevp;
+
+	entry->refcount--;
+	if (entry->refcount > 0) {
+		return;
+	}
+
+	/* no fetches remain so the host cannot be queued or ready */
+	assert(entry->active == 0);
+
+	for (prevp = fetch_host_bucket(entry->host, entry->fetcherd);
+	     *prevp != entry;
+	     prevp = &(*prevp)->next) {
+		assert(*prevp != NULL);
+	}
+	*prevp = entry->next;
+
+	if (entry->host != NULL) {
+		lwc_string_unref(entry->host);
+	}
+	free(entry);
+}
+
 /**
  * Find a suitable fetcher for a scheme.
  */
@@ -142,25 +289,130 @@ static int get_fetcher_for_scheme(lwc_string *scheme)
 	return -1;
 }
 
+/**
+ * Get the maximum number of active fetches to a host for a fetcher.
+ */
+static inline int fetch_max_per_host(int fetcherd, lwc_string *host)
+{
+	if (fetchers[fetcherd].ops.max_per_host != NULL) {
+		return fetchers[fetcherd].ops.max_per_host(
+					fetchers[fetcherd].scheme, host);
+	}
+	return nsoption_int(max_fetchers_per_host);
+}
+
+/**
+ * Add a host to the end of the ready ring for a priority.
+ */
+static void fetch_ready_insert(struct fetch_host *entry, int priority)
+{
+	struct fetch_host *head = fetch_ready[priority];
+	struct fetch_host *tail;
+
+	if (head == NULL) {
+		entry->ready_next[priority] = entry;
+		entry->ready_prev[priority] = entry;
+		fetch_ready[priority] = entry;
+		return;
+	}
+
+	tail = head->ready_prev[priority];
+	entry->ready_next[priority] = head;
+	entry->ready_prev[priority] = tail;
+	head->ready_prev[priority] = entry;
+	tail->ready_next[priority] = entry;
+}
+
+/**
+ * Remove a host from the ready ring for a priority.
+ */
+static void fetch_ready_remove(struct fetch_host *entry, int priority)
+{
+	struct fetch_host *next = entry->ready_next[priority];
+	struct fetch_host *prev = entry->ready_prev[priority];
+
+	if (next == entry) {
+		fetch_ready[priority] = NULL;
+	} else {
+		next->ready_prev[priority] = prev;
+		prev->ready_next[priority] = next;
+		if (fetch_ready[priority] == entry) {
+			fetch_ready[priority] = next;
+		}
+	}
+	entry->ready_next[priority] = NULL;
+	entry->ready_prev[priority] = NULL;
+}
+
+/**
+ * Move a host on or off the ready rings.
+ *
+ * Must be called whenever the active count or the queues of a host
+ * change. A host is ready at a priority when it has fetches of that
+ * priority queued and fewer active fetches than its limit. Hosts
+ * becoming ready join the end of the ring so free slots are shared
+ * between hosts in turn.
+ *
+ * \param entry The host entry which changed.
+ */
+static void fetch_host_update(struct fetch_host *entry)
+{
+	bool has_slot;
+	bool ready;
+	int priority;
+
+	has_slot = (entry->active <
+		    fetch_max_per_host(entry->fetcherd, entry->host));
+
+	for (priority = 0; priority < FETCH_PRIORITY_COUNT; priority++) {
+		ready = has_slot && (entry->queue[priority] != NULL);
+
+		if (ready && (entry->ready_next[priority] == NULL)) {
+			fetch_ready_insert(entry, priority);
+		} else if (!ready && (entry->ready_next[priority] != NULL)) {
+			fetch_ready_remove(entry, priority);
+		}
+	}
+}
+
 /**
  * Dispatch a single job
  */
 static bool fetch_dispatch_job(struct fetch *fetch)
 {
-	RING_REMOVE(queue_ring, fetch);
+	struct fetch_host *entry = fetch->host_entry;
+	bool started;
+
+	RING_REMOVE(entry->queue[fetch->priority], fetch);
 	NSLOG(fetch, DEBUG,
 	      "Attempting to start fetch %p, fetcher %p, url %s", fetch,
 	      fetch->fetcher_handle,
 	      nsurl_access(fetch->url));
 
-	if (!fetchers[fetch->fetcherd].ops.start(fetch->fetcher_handle)) {
-		RING_INSERT(queue_ring, fetch); /* Put it back on the end of the queue */
-		return false;
+	started = fetchers[fetch->fetcherd].ops.start(fetch->fetcher_handle);
+	if (!started) {
+		/* Put it back on the end of the queue */
+		RING_INSERT(entry->queue[fetch->priority], fetch);
+		fetch_dispatch_deferred = true;
 	} else {
 		RING_INSERT(fetch_ring, fetch);
 		fetch->fetch_is_active = true;
-		return true;
+		entry->active++;
+		fetch_queued_count--;
+		fetch_active_count++;
+		if (fetchers[fetch->fetcherd].ops.poll != NULL) {
+			fetch_polled_count++;
+		}
+		fetch_host_update(entry);
+	}
+
+	/* give the next ready host the following slot */
+	if (fetch_ready[fetch->priority] == entry) {
+		fetch_ready[fetch->priority] =
+			entry->ready_next[fetch->priority];
 	}
+
+	return started;
 }
 
 /**
@@ -169,58 +421,22 @@ static bool fetch_dispatch_job(struct fetch *fetch)
  *
  * We don't check the overall dispatch size here because we're not called unless
  * there is room in the fetch queue for us.
+ *
+ * The ready rings are considered in priority order so a fetch is only
+ * chosen from a lower priority when every host with a higher priority
+ * fetch queued has no free slots.
  */
 static bool fetch_choose_and_dispatch(void)
 {
-	bool same_host;
-	struct fetch *queueitem;
-	queueitem = queue_ring;
-	do {
-		/* We can dispatch the selected item if there is room in the
-		 * fetch ring
-		 */
-		int countbyhost;
-		RING_COUNTBYLWCHOST(struct fetch, fetch_ring, countbyhost,
-				    queueitem->host);
-		if (countbyhost < nsoption_int(max_fetchers_per_host)) {
-			/* We can dispatch this item in theory */
-			return fetch_dispatch_job(queueitem);
-		}
-		/* skip over other items with the same host */
-		same_host = true;
-		while (same_host == true && queueitem->r_next != queue_ring) {
-			if (lwc_string_isequal(queueitem->host,
-					       queueitem->r_next->host, &same_host) ==
-			    lwc_error_ok && same_host == true) {
-				queueitem = queueitem->r_next;
-			}
-		}
-		queueitem = queueitem->r_next;
-	} while (queueitem != queue_ring);
-	return false;
-}
-
-static void dump_rings(void)
-{
-	struct fetch *q;
-	struct fetch *f;
+	int priority;
 
-	q = queue_ring;
-	if (q) {
-		do {
-			NSLOG(fetch, DEBUG, "queue_ring: %s",
-			      nsurl_access(q->url));
-			q = q->r_next;
-		} while (q != queue_ring);
-	}
-	f = fetch_ring;
-	if (f) {
-		do {
-			NSLOG(fetch, DEBUG, "fetch_ring: %s",
-			      nsurl_access(f->url));
-			f = f->r_next;
-		} while (f != fetch_ring);
+	for (priority = 0; priority < FETCH_PRIORITY_COUNT; priority++) {
+		if (fetch_ready[priority] != NULL) {
+			return fetch_dispatch_job(
+				fetch_ready[priority]->queue[priority]);
+		}
 	}
+	return false;
 }
 
 /**
@@ -230,33 +446,26 @@ static void dump_rings(void)
  */
 static bool fetch_dispatch_jobs(void)
 {
-	int all_active;
-	int all_queued;
-
-	RING_GETSIZE(struct fetch, queue_ring, all_queued);
-	RING_GETSIZE(struct fetch, fetch_ring, all_active);
-
 	NSLOG(fetch, DEBUG,
-	      "queue_ring %i, fetch_ring %i",
-	      all_queued,
-	      all_active);
-	dump_rings();
+	      "queued %i, fetch_ring %i",
+	      fetch_queued_count,
+	      fetch_active_count);
+
+	fetch_dispatch_deferred = false;
 
-	while ((all_queued != 0) &&
-	       (all_active < nsoption_int(max_fetchers)) &&
+	while ((fetch_queued_count != 0) &&
+	       (fetch_active_count < nsoption_int(max_fetchers)) &&
 	       fetch_choose_and_dispatch()) {
-			all_queued--;
-			all_active++;
 			NSLOG(fetch, DEBUG,
 			      "%d queued, %d fetching",
-			      all_queued,
-			      all_active);
+			      fetch_queued_count,
+			      fetch_active_count);
 	}
 
-	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", all_active);
-	NSLOG(fetch, DEBUG, "Queue ring is now %d elements.", all_queued);
+	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", fetch_active_count);
+	NSLOG(fetch, DEBUG, "Queue ring is now %d elements.", fetch_queued_count);
 
-	return (all_active > 0);
+	return (fetch_active_count > 0);
 }
 
 static void fetcher_poll(void *unused)
@@ -266,14 +475,52 @@ static void fetcher_poll(void *unused)
 	if (fetch_dispatch_jobs()) {
 		NSLOG(fetch, DEBUG, "Polling fetchers");
 		for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
-			if (fetchers[fetcherd].refcount > 0) {
+			if ((fetchers[fetcherd].refcount > 0) &&
+			    (fetchers[fetcherd].ops.poll != NULL)) {
 				/* fetcher present */
 				fetchers[fetcherd].ops.poll(fetchers[fetcherd].scheme);
 			}
 		}
 
-		/* schedule active fetchers to run again in 10ms */
-		guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
+		/* schedule active fetchers to run again in 10ms, fetchers
+		 * driven by file descriptor watches need no polling
+		 * unless they refused to start a fetch.
+		 */
+		if ((fetch_polled_count > 0) || fetch_dispatch_deferred) {
+			guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
+		}
+	}
+}
+
+/**
+ * Scheduled callback to dispatch queued fetches.
+ *
+ * Newly dispatched fetches are polled straight away rather than
+ * waiting for the next poll interval.
+ */
+static void fetch_dispatch_callback(void *unused)
+{
+	fetch_dispatch_scheduled = false;
+
+	if (fetch_queued_count == 0) {
+		return;
+	}
+
+	fetcher_poll(NULL);
+}
+
+/**
+ * Request queued fetches be dispatched.
+ *
+ * The dispatch is deferred to a scheduled callback which coalesces
+ * requests made while adding many fetches or from within a fetcher
+ * callback where starting another fetch is not safe.
+ */
+static void fetch_schedule_dispatch(void)
+{
+	if (!fetch_dispatch_scheduled) {
+		fetch_dispatch_scheduled = true;
+		guit->misc->schedule(0, fetch_dispatch_callback, NULL);
 	}
 }
 
@@ -320,6 +567,12 @@ nserror fetcher_init(void)
 void fetcher_quit(void)
 {
 	int fetcherd; /* fetcher index */
+
+	if (fetch_dispatch_scheduled) {
+		guit->misc->schedule(-1, fetch_dispatch_callback, NULL);
+		fetch_dispatch_scheduled = false;
+	}
+
 	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
 		if (fetchers[fetcherd].refcount > 1) {
 			/* fetcher still has reference at quit. This
@@ -348,6 +601,9 @@ void fetcher_quit(void)
 			fetch_unref_fetcher(fetcherd);
 		}
 	}
+	free(fetch_fd_watches);
+	fetch_fd_watches = NULL;
+	fetch_fd_watches_size = 0;
 }
 
 /* exported interface documented in content/fetchers.h */
@@ -397,7 +653,8 @@ fetch_fdset(fd_set *read_fd_set,
 	NSLOG(fetch, DEBUG, "Polling fetchers");
 
 	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
-		if (fetchers[fetcherd].refcount > 0) {
+		if ((fetchers[fetcherd].refcount > 0) &&
+		    (fetchers[fetcherd].ops.poll != NULL)) {
 			/* fetcher present */
 			fetchers[fetcherd].ops.poll(fetchers[fetcherd].scheme);
 		}
@@ -420,7 +677,7 @@ fetch_fdset(fd_set *read_fd_set,
 		}
 	}
 
-	if (maxfd >= 0) {
+	if ((maxfd >= 0) && (fetch_polled_count > 0)) {
 		/* change the scheduled poll to happen is a 1000ms as
 		 * we assume fetching an fdset means the fetchers will
 		 * be run by the client waking up on data available on
@@ -442,6 +699,82 @@ fetch_fdset(fd_set *read_fd_set,
 	return NSERROR_OK;
 }
 
+/* exported interface documented in content/fetch.h */
+nserror fetch_fd_ready(int fd, unsigned int events)
+{
+	struct fetch_fd_watch *watch;
+
+	if ((fd < 0) ||
+	    (fd >= fetch_fd_watches_size) ||
+	    (fetch_fd_watches[fd].cb == NULL)) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	watch = &fetch_fd_watches[fd];
+	watch->cb(fd, events, watch->pw);
+
+	return NSERROR_OK;
+}
+
+/* exported interface documented in content/fetchers.h */
+bool fetcher_fd_watch_available(void)
+{
+	return (guit->fetch->watch_fd != NULL);
+}
+
+/* exported interface documented in content/fetchers.h */
+nserror
+fetcher_fd_watch(int fd, unsigned int events, fetcher_fd_callback cb, void *pw)
+{
+	struct fetch_fd_watch *watches;
+	int size;
+	nserror res;
+
+	if ((fd < 0) || (cb == NULL) || (guit->fetch->watch_fd == NULL)) {
+		return NSERROR_BAD_PARAMETER;
+	}
+
+	if (fd >= fetch_fd_watches_size) {
+		size = (fetch_fd_watches_size > 0) ? fetch_fd_watches_size : 64;
+		while (size <= fd) {
+			size *= 2;
+		}
+		watches = realloc(fetch_fd_watches, size * sizeof(*watches));
+		if (watches == NULL) {
+			return NSERROR_NOMEM;
+		}
+		memset(watches + fetch_fd_watches_size, 0,
+		       (size - fetch_fd_watches_size) * sizeof(*watches));
+		fetch_fd_watches = watches;
+		fetch_fd_watches_size = size;
+	}
+
+	res = guit->fetch->watch_fd(fd, events);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	fetch_fd_watches[fd].cb = cb;
+	fetch_fd_watches[fd].pw = pw;
+
+	return NSERROR_OK;
+}
+
+/* exported interface documented in content/fetchers.h */
+nserror fetcher_fd_unwatch(int fd)
+{
+	if ((fd < 0) ||
+	    (fd >= fetch_fd_watches_size) ||
+	    (fetch_fd_watches[fd].cb == NULL)) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	fetch_fd_watches[fd].cb = NULL;
+	fetch_fd_watches[fd].pw = NULL;
+
+	return guit->fetch->unwatch_fd(fd);
+}
+
 /* exported interface documented in content/fetch.h */
 nserror
 fetch_start(nsurl *url,
@@ -453,6 +786,7 @@ fetch_start(nsurl *url,
 	    const struct fetch_multipart_data *post_multipart,
 	    bool verifiable,
 	    bool downgrade_tls,
+	    fetch_priority priority,
 	    const char *headers[],
 	    struct fetch **fetch_out)
 {
@@ -482,9 +816,19 @@ fetch_start(nsurl *url,
 	fetch->callback = callback;
 	fetch->url = nsurl_ref(url);
 	fetch->verifiable = verifiable;
+	fetch->priority = priority;
 	fetch->p = p;
 	fetch->host = nsurl_get_component(url, NSURL_HOST);
 
+	fetch->host_entry = fetch_host_ref(fetch->host, fetch->fetcherd);
+	if (fetch->host_entry == NULL) {
+		if (fetch->host != NULL)
+			lwc_string_unref(fetch->host);
+		nsurl_unref(fetch->url);
+		free(fetch);
+		return NSERROR_NOMEM;
+	}
+
 	if (referer != NULL) {
 		fetch->referer = nsurl_ref(referer);
 	}
@@ -496,6 +840,8 @@ fetch_start(nsurl *url,
 						headers);
 	if (fetch->fetcher_handle == NULL) {
 
+		fetch_host_unref(fetch->host_entry);
+
 		if (fetch->host != NULL)
 			lwc_string_unref(fetch->host);
 
@@ -518,14 +864,12 @@ fetch_start(nsurl *url,
 	fetch_ref_fetcher(fetch->fetcherd);
 
 	/* Dump new fetch in the queue. */
-	RING_INSERT(queue_ring, fetch);
+	RING_INSERT(fetch->host_entry->queue[fetch->priority], fetch);
+	fetch_queued_count++;
+	fetch_host_update(fetch->host_entry);
 
 	/* Ask the queue to run. */
-	if (fetch_dispatch_jobs()) {
-		NSLOG(fetch, DEBUG, "scheduling poll");
-		/* schedule active fetchers to run again in 10ms */
-		guit->misc->schedule(10, fetcher_poll, NULL);
-	}
+	fetch_schedule_dispatch();
 
 	*fetch_out = fetch;
 	return NSERROR_OK;
@@ -568,6 +912,8 @@ void fetch_free(struct fetch *f)
 
 	fetch_unref_fetcher(f->fetcherd);
 
+	fetch_host_unref(f->host_entry);
+
 	nsurl_unref(f->url);
 	if (f->referer != NULL) {
 		nsurl_unref(f->referer);
@@ -764,9 +1110,6 @@ fetch_send_callback(const fetch_msg *msg, struct fetch *fetch)
 /* exported interface documented in content/fetch.h */
 void fetch_remove_from_queues(struct fetch *fetch)
 {
-	int all_active;
-	int all_queued;
-
 	NSLOG(fetch, DEBUG,
 	      "Fetch %p, fetcher %p can be freed",
 	      fetch,
@@ -775,16 +1118,26 @@ void fetch_remove_from_queues(struct fetch *fetch)
 	/* Go ahead and free the fetch properly now */
 	if (fetch->fetch_is_active) {
 		RING_REMOVE(fetch_ring, fetch);
+		fetch->fetch_is_active = false;
+		fetch->host_entry->active--;
+		fetch_active_count--;
+		if (fetchers[fetch->fetcherd].ops.poll != NULL) {
+			fetch_polled_count--;
+		}
+		fetch_host_update(fetch->host_entry);
+
+		/* a slot has become available for a queued fetch */
+		if (fetch_queued_count > 0) {
+			fetch_schedule_dispatch();
+		}
 	} else {
-		RING_REMOVE(queue_ring, fetch);
+		RING_REMOVE(fetch->host_entry->queue[fetch->priority], fetch);
+		fetch_queued_count--;
+		fetch_host_update(fetch->host_entry);
 	}
 
-
-	RING_GETSIZE(struct fetch, fetch_ring, all_active);
-	RING_GETSIZE(struct fetch, queue_ring, all_queued);
-
-	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", all_active);
-	NSLOG(fetch, DEBUG, "Queue ring is now %d elements.", all_queued);
+	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", fetch_active_count);
+	NSLOG(fetch, DEBUG, "Queue ring is now %d elements.", fetch_queued_count);
 }
 
 
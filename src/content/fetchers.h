@@ -39,6 +39,8 @@ struct fetch;
  *
  * Each fetcher is called once for initialisaion and finalisation.
  * The poll entry point will be called to allow all active fetches to progress.
+ * Fetchers which are driven entirely by file descriptor watches (see
+ * fetcher_fd_watch()) and scheduled callbacks may omit the poll entry.
  * The flow of a fetch operation is:
  *   URL is checked for aceptability.
  *   setup with all applicable data.
@@ -87,11 +89,15 @@ struct fetcher_operation_table {
 
 	/**
 	 * poll a fetcher to let it make progress.
+	 *
+	 * Optional if the fetcher makes progress without polling.
 	 */
 	void (*poll)(lwc_string *scheme);
 
 	/**
 	 * update an fdset with the FDs needed to poll cleanly
+	 *
+	 * Optional.
 	 */
 	int (*fdset)(lwc_string *scheme, fd_set *read_set, fd_set *write_set,
 		     fd_set *error_set);
@@ -100,9 +106,64 @@ struct fetcher_operation_table {
 	 * Finalise the fetcher.
 	 */
 	void (*finalise)(lwc_string *scheme);
+
+	/**
+	 * Maximum number of simultaneous fetches to a single host.
+	 *
+	 * Optional, if not provided the max_fetchers_per_host option
+	 * is used. Fetchers which multiplex several fetches over one
+	 * connection use this to count streams rather than connections.
+	 *
+	 * \param scheme The scheme being fetched.
+	 * \param host The interned host being fetched, may be NULL.
+	 * \return The maximum number of simultaneous fetches.
+	 */
+	int (*max_per_host)(lwc_string *scheme, lwc_string *host);
 };
 
 
+/**
+ * Callback for activity on a watched file descriptor.
+ *
+ * \param fd The file descriptor which is ready.
+ * \param events Bitmask of ::fetch_fd_event which occurred.
+ * \param pw The context passed to fetcher_fd_watch().
+ */
+typedef void (*fetcher_fd_callback)(int fd, unsigned int events, void *pw);
+
+
+/**
+ * Determine if the frontend can watch file descriptors for fetchers.
+ *
+ * \return true if fetcher_fd_watch() may be used else false.
+ */
+bool fetcher_fd_watch_available(void);
+
+
+/**
+ * Watch a file descriptor on behalf of a fetcher.
+ *
+ * Watching an already watched descriptor updates the events and
+ * callback.
+ *
+ * \param fd The file descriptor to watch.
+ * \param events Bitmask of ::fetch_fd_event to wait for.
+ * \param cb The callback to call when the descriptor is ready.
+ * \param pw The context to pass to the callback.
+ * \return NSERROR_OK or appropriate error code.
+ */
+nserror fetcher_fd_watch(int fd, unsigned int events, fetcher_fd_callback cb, void *pw);
+
+
+/**
+ * Stop watching a file descriptor on behalf of a fetcher.
+ *
+ * \param fd The file descriptor to stop watching.
+ * \return NSERROR_OK or appropriate error code.
+ */
+nserror fetcher_fd_unwatch(int fd);
+
+
 /**
  * Register a fetcher for a scheme
  *
@@ -93,6 +93,8 @@ bool fetch_about_imagecache_handler(struct fetch_about_context *ctx)
 				"(from %v images converted more than once)"
 				"</p>\n"
 		"<p>Bitmap of size %w had most (%x) conversions</p>\n"
+		"<p>Cleaner released %y bitmaps, reconverted by %z reads "
+				"(%pz%% of reads)</p>\n"
 		"<h2 class=\"ns-border\">Current contents</h2>\n");
 	if (slen >= (int) (sizeof(buffer))) {
 		goto fetch_about_imagecache_handler_aborted; /* overflow */
@@ -188,6 +188,52 @@ static hashmap_parameters_t curl_fetch_ssl_hashmap_parameters = {
 
 static hashmap_t *curl_fetch_ssl_hashmap = NULL;
 
+static void *
+curl_h2_host_key_clone(void *key)
+{
+	return lwc_string_ref((lwc_string *)key);
+}
+
+static void
+curl_h2_host_key_destroy(void *key)
+{
+	lwc_string_unref((lwc_string *)key);
+}
+
+static uint32_t
+curl_h2_host_key_hash(void *key)
+{
+	return lwc_string_hash_value((lwc_string *)key);
+}
+
+static bool
+curl_h2_host_key_eq(void *key1, void *key2)
+{
+	/* host names are interned so may be compared by pointer */
+	return key1 == key2;
+}
+
+static void *
+curl_h2_host_value_alloc(void *key)
+{
+	return malloc(sizeof(long));
+}
+
+static hashmap_parameters_t curl_h2_host_hashmap_parameters = {
+	.key_clone = curl_h2_host_key_clone,
+	.key_destroy = curl_h2_host_key_destroy,
+	.key_eq = curl_h2_host_key_eq,
+	.key_hash = curl_h2_host_key_hash,
+	.value_alloc = curl_h2_host_value_alloc,
+	.value_destroy = free,
+};
+
+/**
+ * Hosts whose last completed transfer was multiplexed, the value is
+ * the negotiated HTTP version.
+ */
+static hashmap_t *curl_h2_hosts = NULL;
+
 /** SSL certificate info */
 struct cert_info {
 	X509 *cert;		/**< Pointer to certificate */
@@ -234,6 +280,12 @@ CURLM *fetch_curl_multi;
 /** Curl handle with default options set; not used for transfers. */
 static CURL *fetch_blank_curl;
 
+/** Share handle for the DNS and TLS session caches of all transfers. */
+static CURLSH *fetch_curl_share;
+
+/** Flag for fetches being multiplexed over HTTP/2 connections */
+static bool curl_multiplexing = false;
+
 /** Ring of cached handles */
 static struct cache_handle *curl_handle_ring = 0;
 
@@ -252,6 +304,11 @@ static char fetch_proxy_userpwd[100];
 /** Interlock to prevent initiation during callbacks */
 static bool inside_curl = false;
 
+/** Flag for progress being driven by socket activity instead of polling */
+static bool curl_socket_driven = false;
+
+static void fetch_curl_timeout(void *p);
+
 
 /**
  * Initialise a cURL fetcher.
@@ -277,6 +334,18 @@ static void fetch_curl_finalise(lwc_string *scheme)
 	curl_fetchers_registered--;
 	NSLOG(neosurf, INFO, "Finalise cURL fetcher %s",
 	      lwc_string_data(scheme));
+
+	/* Free anything remaining in the cached curl handle ring, before
+	 * the share the handles use is cleaned up
+	 */
+	while (curl_handle_ring != NULL) {
+		h = curl_handle_ring;
+		RING_REMOVE(curl_handle_ring, h);
+		lwc_string_unref(h->host);
+		curl_easy_cleanup(h->handle);
+		free(h);
+	}
+
 	if (curl_fetchers_registered == 0) {
 		CURLMcode codem;
 		/* All the fetchers have been finalised. */
@@ -285,25 +354,30 @@ static void fetch_curl_finalise(lwc_string *scheme)
 
 		curl_easy_cleanup(fetch_blank_curl);
 
+		if (curl_socket_driven) {
+			guit->misc->schedule(-1, fetch_curl_timeout, NULL);
+		}
+
 		codem = curl_multi_cleanup(fetch_curl_multi);
 		if (codem != CURLM_OK)
 			NSLOG(neosurf, INFO,
 			      "curl_multi_cleanup failed: ignoring");
 
+		if (fetch_curl_share != NULL) {
+			curl_share_cleanup(fetch_curl_share);
+			fetch_curl_share = NULL;
+		}
+
 		curl_global_cleanup();
 
 		NSLOG(neosurf, DEBUG, "Cleaning up SSL cert chain hashmap");
 		hashmap_destroy(curl_fetch_ssl_hashmap);
 		curl_fetch_ssl_hashmap = NULL;
-	}
 
-	/* Free anything remaining in the cached curl handle ring */
-	while (curl_handle_ring != NULL) {
-		h = curl_handle_ring;
-		RING_REMOVE(curl_handle_ring, h);
-		lwc_string_unref(h->host);
-		curl_easy_cleanup(h->handle);
-		free(h);
+		if (curl_h2_hosts != NULL) {
+			hashmap_destroy(curl_h2_hosts);
+			curl_h2_hosts = NULL;
+		}
 	}
 }
 
@@ -320,6 +394,74 @@ static bool fetch_curl_can_fetch(const nsurl *url)
 }
 
 
+/**
+ * Maximum number of simultaneous fetches to a single host.
+ *
+ * Fetches to a host known to have negotiated HTTP/2 become streams
+ * on the connections the multi handle limits and are only limited
+ * by the overall fetch limit. Every other fetch needs a connection of
+ * its own; more than the per host limit would only wait in the queue
+ * of the multi handle, holding fetch slots other hosts could use.
+ *
+ * \param scheme The scheme being fetched.
+ * \param host The host being fetched.
+ * \return The maximum number of simultaneous fetches.
+ */
+static int fetch_curl_max_per_host(lwc_string *scheme, lwc_string *host)
+{
+	bool match;
+
+	/* HTTP/2 is only negotiated over TLS */
+	if ((curl_h2_hosts != NULL) &&
+	    (host != NULL) &&
+	    (lwc_string_caseless_isequal(scheme,
+					 corestring_lwc_https,
+					 &match) == lwc_error_ok) &&
+	    match &&
+	    (hashmap_lookup(curl_h2_hosts, host) != NULL)) {
+		return nsoption_int(max_fetchers);
+	}
+	return nsoption_int(max_fetchers_per_host);
+}
+
+
+/**
+ * Record whether a completed transfer to a host was multiplexed.
+ *
+ * \param f The fetch whose transfer completed.
+ * \param curl_handle The easy handle of the transfer.
+ */
+static void
+fetch_curl_record_http_version(struct curl_fetch_info *f, CURL *curl_handle)
+{
+#if LIBCURL_VERSION_NUM >= 0x073200
+	long version;
+	long *entry;
+
+	if ((curl_h2_hosts == NULL) || (f->host == NULL)) {
+		return;
+	}
+
+	if ((curl_easy_getinfo(curl_handle,
+			       CURLINFO_HTTP_VERSION,
+			       &version) != CURLE_OK) ||
+	    (version == 0)) {
+		/* no response so nothing was negotiated */
+		return;
+	}
+
+	if (version >= CURL_HTTP_VERSION_2_0) {
+		entry = hashmap_insert(curl_h2_hosts, f->host);
+		if (entry != NULL) {
+			*entry = version;
+		}
+	} else {
+		hashmap_remove(curl_h2_hosts, f->host);
+	}
+#endif
+}
+
+
 /**
  * Convert a list of struct ::fetch_multipart_data to a list of
  * struct curl_httppost for libcurl.
@@ -1196,6 +1338,8 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
 	abort_fetch = f->abort;
 	NSLOG(neosurf, INFO, "done %s", nsurl_access(f->url));
 
+	fetch_curl_record_http_version(f, curl_handle);
+
 	if ((abort_fetch == false) &&
 	    (result == CURLE_OK ||
 	     ((result == CURLE_WRITE_ERROR) && (f->stopped == false)))) {
@@ -1282,16 +1426,39 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
 }
 
 
+/**
+ * Process the messages cURL has queued for completed fetches.
+ */
+static void fetch_curl_process_messages(void)
+{
+	int queue;
+	CURLMsg *curl_msg;
+
+	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	while (curl_msg) {
+		switch (curl_msg->msg) {
+			case CURLMSG_DONE:
+				fetch_curl_done(curl_msg->easy_handle,
+						curl_msg->data.result);
+				break;
+			default:
+				break;
+		}
+		curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	}
+}
+
+
 /**
  * Do some work on current fetches.
  *
- * Must be called regularly to make progress on fetches.
+ * Must be called regularly to make progress on fetches unless they
+ * are driven by socket activity.
  */
 static void fetch_curl_poll(lwc_string *scheme_ignored)
 {
-	int running, queue;
+	int running;
 	CURLMcode codem;
-	CURLMsg *curl_msg;
 
 	if (nsoption_bool(suppress_curl_debug) == false) {
 		fd_set read_fd_set, write_fd_set, exc_fd_set;
@@ -1344,23 +1511,128 @@ static void fetch_curl_poll(lwc_string *scheme_ignored)
 		}
 	} while (codem == CURLM_CALL_MULTI_PERFORM);
 
-	/* process curl results */
-	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
-	while (curl_msg) {
-		switch (curl_msg->msg) {
-			case CURLMSG_DONE:
-				fetch_curl_done(curl_msg->easy_handle,
-						curl_msg->data.result);
-				break;
-			default:
-				break;
-		}
-		curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	fetch_curl_process_messages();
+	inside_curl = false;
+}
+
+
+/**
+ * Let cURL act on a socket or timeout.
+ *
+ * \param s The socket which is ready or CURL_SOCKET_TIMEOUT.
+ * \param ev_bitmask Bitmask of CURL_CSELECT_* events on the socket.
+ */
+static void fetch_curl_socket_action(curl_socket_t s, int ev_bitmask)
+{
+	int running;
+	CURLMcode codem;
+
+	inside_curl = true;
+	codem = curl_multi_socket_action(fetch_curl_multi, s,
+					 ev_bitmask, &running);
+	if (codem != CURLM_OK) {
+		NSLOG(neosurf, WARNING,
+		      "curl_multi_socket_action: %i %s",
+		      codem, curl_multi_strerror(codem));
 	}
+
+	fetch_curl_process_messages();
 	inside_curl = false;
 }
 
 
+/**
+ * Scheduled callback for a cURL timeout expiring.
+ */
+static void fetch_curl_timeout(void *p)
+{
+	fetch_curl_socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+
+/**
+ * Callback for activity on a socket watched on behalf of cURL.
+ */
+static void fetch_curl_fd_ready(int fd, unsigned int events, void *pw)
+{
+	int ev_bitmask = 0;
+
+	if ((events & FETCH_FD_READ) != 0) {
+		ev_bitmask |= CURL_CSELECT_IN;
+	}
+	if ((events & FETCH_FD_WRITE) != 0) {
+		ev_bitmask |= CURL_CSELECT_OUT;
+	}
+	if ((events & FETCH_FD_ERROR) != 0) {
+		ev_bitmask |= CURL_CSELECT_ERR;
+	}
+
+	fetch_curl_socket_action(fd, ev_bitmask);
+}
+
+
+/**
+ * cURL callback to update the events wanted on a socket.
+ *
+ * \return 0 on success or -1 if the socket could not be watched.
+ */
+static int
+fetch_curl_socket_cb(CURL *easy,
+		     curl_socket_t s,
+		     int what,
+		     void *userp,
+		     void *socketp)
+{
+	unsigned int events;
+
+	switch (what) {
+	case CURL_POLL_IN:
+		events = FETCH_FD_READ;
+		break;
+
+	case CURL_POLL_OUT:
+		events = FETCH_FD_WRITE;
+		break;
+
+	case CURL_POLL_INOUT:
+		events = FETCH_FD_READ | FETCH_FD_WRITE;
+		break;
+
+	case CURL_POLL_REMOVE:
+		fetcher_fd_unwatch(s);
+		return 0;
+
+	default:
+		return 0;
+	}
+
+	if (fetcher_fd_watch(s, events, fetch_curl_fd_ready, NULL) != NSERROR_OK) {
+		NSLOG(neosurf, WARNING, "Unable to watch cURL socket %d", s);
+		return -1;
+	}
+
+	return 0;
+}
+
+
+/**
+ * cURL callback to update the timeout for socket driven operation.
+ *
+ * The timeout is only scheduled here, cURL must not be called back
+ * from within this callback.
+ */
+static int fetch_curl_timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+	if (timeout_ms < 0) {
+		guit->misc->schedule(-1, fetch_curl_timeout, NULL);
+	} else {
+		guit->misc->schedule(timeout_ms, fetch_curl_timeout, NULL);
+	}
+
+	return 0;
+}
+
+
 /**
  * Callback function for fetch progress.
  */
@@ -1594,7 +1866,7 @@ nserror fetch_curl_register(void)
 	curl_version_info_data *data;
 	int i;
 	lwc_string *scheme;
-	const struct fetcher_operation_table fetcher_ops = {
+	struct fetcher_operation_table fetcher_ops = {
 		.initialise = fetch_curl_initialise,
 		.acceptable = fetch_curl_can_fetch,
 		.setup = fetch_curl_setup,
@@ -1603,7 +1875,8 @@ nserror fetch_curl_register(void)
 		.free = fetch_curl_free,
 		.poll = fetch_curl_poll,
 		.fdset = fetch_curl_fdset,
-		.finalise = fetch_curl_finalise
+		.finalise = fetch_curl_finalise,
+		.max_per_host = fetch_curl_max_per_host
 	};
 
 	CURLsslset setres;
@@ -1623,12 +1896,36 @@ nserror fetch_curl_register(void)
 		return NSERROR_INIT_FAILED;
 	}
 
+	data = curl_version_info(CURLVERSION_NOW);
+
+	if (nsoption_bool(curl_http2)) {
+		if ((data->features & CURL_VERSION_HTTP2) != 0) {
+			curl_multiplexing = true;
+		} else {
+			NSLOG(neosurf, INFO, "cURL built without HTTP/2 support");
+		}
+	}
+
 	fetch_curl_multi = curl_multi_init();
 	if (!fetch_curl_multi) {
 		NSLOG(neosurf, INFO, "curl_multi_init failed.");
 		return NSERROR_INIT_FAILED;
 	}
 
+	/* Share the DNS and TLS session caches between all transfers
+	 * so cached handles do not have to resolve and negotiate
+	 * again. Connections are already pooled by the multi handle.
+	 */
+	fetch_curl_share = curl_share_init();
+	if (fetch_curl_share != NULL) {
+		curl_share_setopt(fetch_curl_share,
+				  CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS);
+		curl_share_setopt(fetch_curl_share,
+				  CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION);
+	} else {
+		NSLOG(neosurf, INFO, "curl_share_init failed.");
+	}
+
 	{
 		CURLMcode mcode;
 		int maxconnects = nsoption_int(max_fetchers) +
@@ -1645,6 +1942,20 @@ nserror fetch_curl_register(void)
 		SETOPT(CURLMOPT_MAXCONNECTS, maxconnects);
 		SETOPT(CURLMOPT_MAX_TOTAL_CONNECTIONS, maxconnects);
 		SETOPT(CURLMOPT_MAX_HOST_CONNECTIONS, nsoption_int(max_fetchers_per_host));
+		if (curl_multiplexing) {
+			SETOPT(CURLMOPT_PIPELINING, CURLPIPE_MULTIPLEX);
+		}
+
+		/* When the frontend can watch sockets let cURL tell
+		 * us which to wait on instead of polling every fetch.
+		 */
+		if (fetcher_fd_watch_available()) {
+			SETOPT(CURLMOPT_SOCKETFUNCTION, fetch_curl_socket_cb);
+			SETOPT(CURLMOPT_TIMERFUNCTION, fetch_curl_timer_cb);
+			curl_socket_driven = true;
+			fetcher_ops.poll = NULL;
+			fetcher_ops.fdset = NULL;
+		}
 	}
 
 	/* Create a curl easy handle with the options that are common to all
@@ -1672,8 +1983,20 @@ nserror fetch_curl_register(void)
 		SETOPT(CURLOPT_VERBOSE, 1);
 	}
 
-	/* Currently we explode if curl uses HTTP2, so force 1.1. */
-	SETOPT(CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+	if (curl_multiplexing) {
+		/* Negotiate HTTP/2 over TLS and wait for an existing
+		 * connection to the host rather than opening another
+		 * so transfers are multiplexed.
+		 */
+		SETOPT(CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_2TLS);
+		SETOPT(CURLOPT_PIPEWAIT, 1L);
+	} else {
+		SETOPT(CURLOPT_HTTP_VERSION, CURL_HTTP_VERSION_1_1);
+	}
+
+	if (fetch_curl_share != NULL) {
+		SETOPT(CURLOPT_SHARE, fetch_curl_share);
+	}
 
 	SETOPT(CURLOPT_WRITEFUNCTION, fetch_curl_data);
 	SETOPT(CURLOPT_HEADERFUNCTION, fetch_curl_header);
@@ -1711,9 +2034,10 @@ nserror fetch_curl_register(void)
 	NSLOG(neosurf, INFO, "cURL %slinked against openssl",
 	      curl_with_openssl ? "" : "not ");
 
-	/* cURL initialised okay, register the fetchers */
+	NSLOG(neosurf, INFO, "cURL %s HTTP/2 multiplexing",
+	      curl_multiplexing ? "using" : "not using");
 
-	data = curl_version_info(CURLVERSION_NOW);
+	/* cURL initialised okay, register the fetchers */
 
 	curl_fetch_ssl_hashmap = hashmap_create(&curl_fetch_ssl_hashmap_parameters);
 	if (curl_fetch_ssl_hashmap == NULL) {
@@ -1721,6 +2045,15 @@ nserror fetch_curl_register(void)
 		return NSERROR_NOMEM;
 	}
 
+	if (curl_multiplexing) {
+		/* without the map every host keeps the per host limit */
+		curl_h2_hosts = hashmap_create(&curl_h2_host_hashmap_parameters);
+		if (curl_h2_hosts == NULL) {
+			NSLOG(neosurf, WARNING,
+			      "Unable to track HTTP/2 hosts, not lifting per host limit");
+		}
+	}
+
 	for (i = 0; data->protocols[i]; i++) {
 		if (strcmp(data->protocols[i], "http") == 0) {
 			scheme = lwc_string_ref(corestring_lwc_http);
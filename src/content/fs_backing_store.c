@@ -25,8 +25,6 @@
  * \todo Consider improving eviction sorting to include objects size
  *         and remaining lifetime and other cost metrics.
  *
- * \todo Implement mmap retrieval where supported.
- *
  * \todo Implement static retrieval for metadata objects as their heap
  *         lifetime is typically very short, though this may be obsoleted
  *         by a small object storage strategy.
@@ -43,6 +41,14 @@
 #include <stdlib.h>
 #include <nsutils/unistd.h>
 
+#include <neosurf/utils/config.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef WITH_THREADS
+#include <pthread.h>
+#endif
+
 #include "neosurf/inttypes.h"
 #include <neosurf/utils/filepath.h>
 #include <neosurf/utils/file.h>
@@ -56,7 +62,7 @@
 #include <neosurf/content/backing_store.h>
 
 /** Backing store file format version */
-#define CONTROL_VERSION 202
+#define CONTROL_VERSION 203
 
 /**
  * Number of milliseconds after a update before control data
@@ -67,6 +73,27 @@
 /** Filename of serialised entries */
 #define ENTRIES_FNAME "entries"
 
+/** Filename of entries journal */
+#define JOURNAL_FNAME "journal"
+
+/** Magic number identifying a serialised entries index */
+#define INDEX_MAGIC 0x4e534958
+
+/**
+ * Number of journal records after which the entries index is
+ * rewritten instead of being appended to the journal.
+ */
+#define JOURNAL_COMPACT_MIN 4096
+
+/** Maximum number of entries considered for eviction in one slice */
+#define EVICT_SLICE_COUNT 64
+
+/**
+ * Number of milliseconds between eviction slices once the store is
+ * back within its limit.
+ */
+#define EVICT_SLICE_TIME 10
+
 /** Filename of block file index */
 #define BLOCKS_FNAME "blocks"
 
@@ -85,6 +112,18 @@
 /** log2 size of metadata blocks (8k) */
 #define BLOCK_META_SIZE 13
 
+/**
+ * Minimum size of an element stored in its own file for it to be
+ * memory mapped on retrieval instead of read onto the heap.
+ */
+#define MMAP_MIN_SIZE (64 * 1024)
+
+/**
+ * Number of milliseconds between checks for completed asynchronous
+ * writes while any are outstanding.
+ */
+#define WRITER_REAP_TIME 50
+
 /** length in bytes of a block files use map */
 #define BLOCK_USE_MAP_SIZE (1 << (BLOCK_ENTRY_COUNT - 3))
 
@@ -175,12 +214,62 @@ struct store_entry_element {
 struct store_entry {
 	nsurl *url; /**< The URL for this entry */
 	int64_t last_used; /**< UNIX time the entry was last used */
+	uint32_t heap_idx; /**< eviction heap position plus one, 0 if absent */
 	uint16_t use_count; /**< number of times this entry has been accessed */
 	uint8_t flags; /**< entry flags */
 	/** Entry element (data or meta) specific information */
 	struct store_entry_element elem[ENTRY_ELEM_COUNT];
 };
 
+/**
+ * Serialised entry index header.
+ *
+ * The entries file is this header followed by ::count records sorted
+ * by URL hash and then a heap of the URL strings the records refer to.
+ */
+struct store_index_header {
+	uint32_t magic; /**< INDEX_MAGIC */
+	uint32_t count; /**< number of records */
+	uint32_t heap_size; /**< size of the URL string heap */
+	uint32_t reserved; /**< keeps records 64bit aligned */
+};
+
+/**
+ * Serialised entry index record.
+ *
+ * @note Order is important to avoid excessive structure packing overhead.
+ */
+struct store_index_record {
+	entry_ident_t hash; /**< nsurl_hash() of the entry URL */
+	uint32_t url_offset; /**< offset of URL in the string heap */
+	uint32_t url_len; /**< length of URL */
+	uint16_t use_count; /**< number of times this entry has been accessed */
+	uint8_t flags; /**< entry flags */
+	uint8_t reserved; /**< padding */
+	int64_t last_used; /**< UNIX time the entry was last used */
+	uint32_t size[ENTRY_ELEM_COUNT]; /**< element sizes */
+	block_index_t block[ENTRY_ELEM_COUNT]; /**< element small blocks */
+};
+
+/**
+ * Operations recorded in the entries journal.
+ */
+enum store_journal_op {
+	JOURNAL_OP_SET = 1, /**< entry added or updated */
+	JOURNAL_OP_REMOVE = 2, /**< entry removed */
+};
+
+/**
+ * Entries journal record.
+ *
+ * Followed by the URL of the entry, record.url_offset is unused.
+ */
+struct store_journal_record {
+	uint32_t op; /**< ::store_journal_op */
+	uint32_t reserved; /**< keeps record 64bit aligned */
+	struct store_index_record record; /**< the entry */
+};
+
 /**
  * Small block file.
  */
@@ -199,6 +288,41 @@ static const unsigned int log2_block_size[ENTRY_ELEM_COUNT] = {
 	BLOCK_META_SIZE  /**< Metadata block size */
 };
 
+#ifdef WITH_THREADS
+/**
+ * An element write performed by the writer thread.
+ *
+ * Everything the write needs is resolved on the main thread when the
+ * job is queued so the writer thread only performs the I/O. The
+ * element data is kept alive by a reference held until the job is
+ * reaped.
+ */
+struct store_write_job {
+	struct store_write_job *next; /**< next job in queue */
+	struct store_entry *bse; /**< entry being written */
+	int elem_idx; /**< element index within the entry */
+	int fd; /**< block file descriptor or -1 for an individual file */
+	off_t offset; /**< offset of the block within the block file */
+	char *fname; /**< filename of an individual file */
+	ssize_t written; /**< number of bytes written */
+	int err; /**< errno of a failed write */
+};
+
+/**
+ * Writer thread state.
+ */
+struct store_writer {
+	pthread_t thread; /**< the writer thread */
+	pthread_mutex_t lock; /**< lock protecting the queues and quit */
+	pthread_cond_t cond; /**< signalled when jobs are queued or on quit */
+	struct store_write_job *pending; /**< jobs waiting to be written */
+	struct store_write_job **pending_tail; /**< end of pending queue */
+	struct store_write_job *complete; /**< written jobs awaiting reaping */
+	bool quit; /**< the thread should exit once pending is empty */
+	unsigned int outstanding; /**< jobs queued and not yet reaped */
+};
+#endif
+
 /**
  * Parameters controlling the backing store.
  */
@@ -218,6 +342,36 @@ struct store_state {
 	 */
 	bool entries_dirty;
 
+	/** serialised entry index, entries are only created from it
+	 * when they are first looked up.
+	 */
+	uint8_t *index;
+	size_t index_size; /**< size of index data */
+	bool index_mapped; /**< index data is mmaped not on heap */
+	const struct store_index_record *index_records; /**< index records */
+	uint32_t index_count; /**< number of records in index */
+	const char *index_heap; /**< index URL string heap */
+	/** bitmap of index records which have been made entries or removed */
+	uint8_t *index_used;
+
+	/** journal records not yet written */
+	uint8_t *journal;
+	size_t journal_len; /**< length of pending journal data */
+	size_t journal_alloc; /**< allocated size of journal */
+	size_t journal_count; /**< records in the journal file */
+
+	/** entries min-heap ordered by eviction priority */
+	struct store_entry **evict_heap;
+	uint32_t evict_count; /**< number of entries in eviction heap */
+	uint32_t evict_alloc; /**< allocated size of eviction heap */
+
+	/** unused index records min-heap ordered by eviction priority */
+	uint32_t *index_evict;
+	uint32_t index_evict_count; /**< number of records in heap */
+
+	bool evicting; /**< eviction slices are scheduled */
+	uint64_t evict_target; /**< allocation eviction slices reduce to */
+
 	/** small block indexes */
 	struct block_file blocks[ENTRY_ELEM_COUNT][BLOCK_FILE_COUNT];
 
@@ -231,6 +385,10 @@ struct store_state {
 	 */
 	bool blocks_opened;
 
+#ifdef WITH_THREADS
+	/** asynchronous writer or NULL if writes are synchronous */
+	struct store_writer *writer;
+#endif
 
 	/* stats */
 	uint64_t total_alloc; /**< total size of all allocated storage. */
@@ -249,6 +407,8 @@ struct store_state {
  */
 struct store_state *storestate;
 
+static void control_maintenance(void *s);
+
 /* Entries hashmap parameters
  *
  * Our hashmap has nsurl keys and store_entry values
@@ -288,6 +448,455 @@ static hashmap_parameters_t entries_hashmap_parameters = {
 	.value_destroy = entries_hashmap_value_destroy,
 };
 
+/**
+ * Check if an index record has been made an entry or removed.
+ */
+static inline bool index_record_used(struct store_state *state, uint32_t idx)
+{
+	return (state->index_used[idx >> 3] & (1U << (idx & 7))) != 0;
+}
+
+/**
+ * Mark an index record as having been made an entry or removed.
+ */
+static inline void index_record_use(struct store_state *state, uint32_t idx)
+{
+	state->index_used[idx >> 3] |= (1U << (idx & 7));
+}
+
+/**
+ * Check if one entry should be evicted before another.
+ *
+ * The entry with the fewest uses is evicted first and entries with
+ * the same number of uses are evicted oldest first.
+ */
+static inline bool
+evict_before(uint16_t a_use_count, int64_t a_last_used,
+	     uint16_t b_use_count, int64_t b_last_used)
+{
+	if (a_use_count != b_use_count) {
+		return a_use_count < b_use_count;
+	}
+	return a_last_used < b_last_used;
+}
+
+/**
+ * Check if an entry has element data allocated.
+ *
+ * Such entries cannot be removed until the allocation is released.
+ */
+static inline bool entry_has_allocation(const struct store_entry *bse)
+{
+	return ((bse->elem[ENTRY_ELEM_DATA].flags &
+		 (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) ||
+		((bse->elem[ENTRY_ELEM_META].flags &
+		  (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0);
+}
+
+static inline bool
+evict_heap_before(const struct store_entry *a, const struct store_entry *b)
+{
+	return evict_before(a->use_count, a->last_used,
+			    b->use_count, b->last_used);
+}
+
+static inline void
+evict_heap_set(struct store_state *state, uint32_t pos, struct store_entry *ent)
+{
+	state->evict_heap[pos] = ent;
+	ent->heap_idx = pos + 1;
+}
+
+static void evict_heap_sift_up(struct store_state *state, uint32_t pos)
+{
+	struct store_entry *ent = state->evict_heap[pos];
+	uint32_t parent;
+
+	while (pos > 0) {
+		parent = (pos - 1) / 2;
+		if (!evict_heap_before(ent, state->evict_heap[parent])) {
+			break;
+		}
+		evict_heap_set(state, pos, state->evict_heap[parent]);
+		pos = parent;
+	}
+	evict_heap_set(state, pos, ent);
+}
+
+static void evict_heap_sift_down(struct store_state *state, uint32_t pos)
+{
+	struct store_entry *ent = state->evict_heap[pos];
+	uint32_t child;
+
+	for (;;) {
+		child = (pos * 2) + 1;
+		if (child >= state->evict_count) {
+			break;
+		}
+		if (((child + 1) < state->evict_count) &&
+		    evict_heap_before(state->evict_heap[child + 1],
+				      state->evict_heap[child])) {
+			child++;
+		}
+		if (!evict_heap_before(state->evict_heap[child], ent)) {
+			break;
+		}
+		evict_heap_set(state, pos, state->evict_heap[child]);
+		pos = child;
+	}
+	evict_heap_set(state, pos, ent);
+}
+
+/**
+ * Add an entry to the eviction heap or reposition it after its usage
+ * has changed.
+ *
+ * @param state The store state to use.
+ * @param ent The entry to update.
+ * @return NSERROR_OK on success or NSERROR_NOMEM if the heap could
+ *         not be grown.
+ */
+static nserror evict_heap_update(struct store_state *state, struct store_entry *ent)
+{
+	struct store_entry **heap;
+	uint32_t alloc;
+	uint32_t pos;
+
+	if (ent->heap_idx != 0) {
+		pos = ent->heap_idx - 1;
+		evict_heap_sift_up(state, pos);
+		if (ent->heap_idx == (pos + 1)) {
+			evict_heap_sift_down(state, pos);
+		}
+		return NSERROR_OK;
+	}
+
+	if (state->evict_count == state->evict_alloc) {
+		alloc = (state->evict_alloc == 0) ? 256 : state->evict_alloc * 2;
+		heap = realloc(state->evict_heap, sizeof(*heap) * alloc);
+		if (heap == NULL) {
+			return NSERROR_NOMEM;
+		}
+		state->evict_heap = heap;
+		state->evict_alloc = alloc;
+	}
+
+	pos = state->evict_count++;
+	state->evict_heap[pos] = ent;
+	evict_heap_sift_up(state, pos);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Remove an entry from the eviction heap if it is present.
+ */
+static void evict_heap_remove(struct store_state *state, struct store_entry *ent)
+{
+	struct store_entry *last;
+	uint32_t pos;
+
+	if (ent->heap_idx == 0) {
+		return;
+	}
+	pos = ent->heap_idx - 1;
+	ent->heap_idx = 0;
+
+	last = state->evict_heap[--state->evict_count];
+	if (last == ent) {
+		return;
+	}
+	evict_heap_set(state, pos, last);
+	evict_heap_sift_up(state, pos);
+	if (last->heap_idx == (pos + 1)) {
+		evict_heap_sift_down(state, pos);
+	}
+}
+
+static inline bool
+index_evict_before(struct store_state *state, uint32_t a, uint32_t b)
+{
+	const struct store_index_record *ra = &state->index_records[a];
+	const struct store_index_record *rb = &state->index_records[b];
+
+	return evict_before(ra->use_count, ra->last_used,
+			    rb->use_count, rb->last_used);
+}
+
+static void index_evict_sift_down(struct store_state *state, uint32_t pos)
+{
+	uint32_t *heap = state->index_evict;
+	uint32_t idx = heap[pos];
+	uint32_t child;
+
+	for (;;) {
+		child = (pos * 2) + 1;
+		if (child >= state->index_evict_count) {
+			break;
+		}
+		if (((child + 1) < state->index_evict_count) &&
+		    index_evict_before(state, heap[child + 1], heap[child])) {
+			child++;
+		}
+		if (!index_evict_before(state, heap[child], idx)) {
+			break;
+		}
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = idx;
+}
+
+/**
+ * Build the eviction heap of the loaded index records.
+ *
+ * Records are only ever removed from this heap, those which become
+ * entries or are removed are discarded when they reach the top.
+ *
+ * @param state The store state to use.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror index_evict_build(struct store_state *state)
+{
+	uint32_t idx;
+
+	if (state->index_count == 0) {
+		return NSERROR_OK;
+	}
+
+	state->index_evict = malloc(sizeof(uint32_t) * state->index_count);
+	if (state->index_evict == NULL) {
+		return NSERROR_NOMEM;
+	}
+	for (idx = 0; idx < state->index_count; idx++) {
+		state->index_evict[idx] = idx;
+	}
+	state->index_evict_count = state->index_count;
+
+	for (idx = state->index_count / 2; idx > 0; idx--) {
+		index_evict_sift_down(state, idx - 1);
+	}
+
+	return NSERROR_OK;
+}
+
+/**
+ * Get the unused index record which should be evicted first.
+ *
+ * @param state The store state to use.
+ * @return The record index or -1 if there are no unused records.
+ */
+static int64_t index_evict_peek(struct store_state *state)
+{
+	while (state->index_evict_count > 0) {
+		if (!index_record_used(state, state->index_evict[0])) {
+			return state->index_evict[0];
+		}
+		state->index_evict[0] =
+			state->index_evict[--state->index_evict_count];
+		index_evict_sift_down(state, 0);
+	}
+	return -1;
+}
+
+/**
+ * Find the unused index record for a URL.
+ *
+ * The records are sorted by hash so are binary searched and only
+ * records with a matching hash have their URL compared.
+ *
+ * @param state The store state to use.
+ * @param url The URL to find.
+ * @return The record index or -1 if there is no record for the URL.
+ */
+static int64_t index_find(struct store_state *state, nsurl *url)
+{
+	entry_ident_t hash = nsurl_hash(url);
+	const char *str = nsurl_access(url);
+	size_t len = nsurl_length(url);
+	const struct store_index_record *rec;
+	uint32_t lo = 0;
+	uint32_t hi = state->index_count;
+	uint32_t mid;
+
+	while (lo < hi) {
+		mid = lo + ((hi - lo) / 2);
+		if (state->index_records[mid].hash < hash) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	for (; lo < state->index_count; lo++) {
+		rec = &state->index_records[lo];
+		if (rec->hash != hash) {
+			break;
+		}
+		if ((rec->url_len == len) &&
+		    (index_record_used(state, lo) == false) &&
+		    (memcmp(state->index_heap + rec->url_offset, str, len) == 0)) {
+			return lo;
+		}
+	}
+
+	return -1;
+}
+
+/**
+ * Set up an entry from a serialised record.
+ */
+static void
+entry_from_record(struct store_entry *ent, const struct store_index_record *rec)
+{
+	int elem_idx;
+
+	ent->last_used = rec->last_used;
+	ent->use_count = rec->use_count;
+	ent->flags = rec->flags;
+	for (elem_idx = 0; elem_idx < ENTRY_ELEM_COUNT; elem_idx++) {
+		ent->elem[elem_idx].data = NULL;
+		ent->elem[elem_idx].size = rec->size[elem_idx];
+		ent->elem[elem_idx].block = rec->block[elem_idx];
+		ent->elem[elem_idx].ref = 0;
+		ent->elem[elem_idx].flags = ENTRY_ELEM_FLAG_NONE;
+	}
+}
+
+/**
+ * Serialise an entry into a record.
+ */
+static void
+record_from_entry(struct store_index_record *rec, const struct store_entry *ent)
+{
+	int elem_idx;
+
+	memset(rec, 0, sizeof(*rec));
+	rec->hash = nsurl_hash(ent->url);
+	rec->url_len = nsurl_length(ent->url);
+	rec->last_used = ent->last_used;
+	rec->use_count = ent->use_count;
+	rec->flags = ent->flags;
+	for (elem_idx = 0; elem_idx < ENTRY_ELEM_COUNT; elem_idx++) {
+		rec->size[elem_idx] = ent->elem[elem_idx].size;
+		rec->block[elem_idx] = ent->elem[elem_idx].block;
+	}
+}
+
+/**
+ * Make an entry from the index record for a URL.
+ *
+ * @param state The store state to use.
+ * @param url The URL of the entry.
+ * @return The new entry or NULL if there is no record for the URL.
+ */
+static struct store_entry *index_lookup(struct store_state *state, nsurl *url)
+{
+	struct store_entry *ent;
+	int64_t idx;
+
+	idx = index_find(state, url);
+	if (idx < 0) {
+		return NULL;
+	}
+
+	ent = hashmap_insert(state->entries, url);
+	if (ent == NULL) {
+		return NULL;
+	}
+	entry_from_record(ent, &state->index_records[idx]);
+	index_record_use(state, idx);
+
+	/* an entry missing from the heap is only exempt from eviction */
+	evict_heap_update(state, ent);
+
+	return ent;
+}
+
+/**
+ * Find the entry for a URL.
+ *
+ * @param state The store state to use.
+ * @param url The URL of the entry.
+ * @return The entry or NULL if the store has no entry for the URL.
+ */
+static struct store_entry *
+store_entry_lookup(struct store_state *state, nsurl *url)
+{
+	struct store_entry *ent;
+
+	ent = hashmap_lookup(state->entries, url);
+	if ((ent == NULL) && (state->index_count > 0)) {
+		ent = index_lookup(state, url);
+	}
+	return ent;
+}
+
+/**
+ * Record a change to a serialised record in the pending journal.
+ *
+ * @param state The store state to use.
+ * @param op The change being made.
+ * @param rec The record being changed.
+ * @param url The URL of the record, rec->url_len bytes long.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror
+journal_append_record(struct store_state *state,
+		      enum store_journal_op op,
+		      const struct store_index_record *rec,
+		      const char *url)
+{
+	struct store_journal_record jrec;
+	size_t len;
+	uint8_t *journal;
+
+	memset(&jrec, 0, sizeof(jrec));
+	jrec.op = op;
+	jrec.record = *rec;
+	jrec.record.url_offset = 0;
+
+	len = sizeof(jrec) + jrec.record.url_len;
+	if ((state->journal_len + len) > state->journal_alloc) {
+		size_t alloc = (state->journal_alloc + len) * 2;
+		journal = realloc(state->journal, alloc);
+		if (journal == NULL) {
+			return NSERROR_NOMEM;
+		}
+		state->journal = journal;
+		state->journal_alloc = alloc;
+	}
+
+	memcpy(state->journal + state->journal_len, &jrec, sizeof(jrec));
+	memcpy(state->journal + state->journal_len + sizeof(jrec),
+	       url,
+	       jrec.record.url_len);
+	state->journal_len += len;
+	state->journal_count++;
+
+	return NSERROR_OK;
+}
+
+/**
+ * Record a change to an entry in the pending journal.
+ *
+ * @param state The store state to use.
+ * @param op The change being made.
+ * @param ent The entry being changed.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror
+journal_append(struct store_state *state,
+	       enum store_journal_op op,
+	       const struct store_entry *ent)
+{
+	struct store_index_record rec;
+
+	record_from_entry(&rec, ent);
+
+	return journal_append_record(state, op, &rec, nsurl_access(ent->url));
+}
+
 /**
  * Generate a filename for an object.
  *
@@ -418,25 +1027,29 @@ store_fname(struct store_state *state,
  * invalidate an element of an entry
  *
  * @param state The store state to use.
- * @param bse The entry to invalidate.
+ * @param ident The identifier of the entry to invalidate.
  * @param elem_idx The element index to invalidate.
+ * @param block The small block of the element or 0 if it is in a file.
+ * @param size The size of the element.
  * @return NSERROR_OK on success or error code on failure.
  */
 static nserror
 invalidate_element(struct store_state *state,
-		   struct store_entry *bse,
-		   int elem_idx)
+		   entry_ident_t ident,
+		   int elem_idx,
+		   block_index_t block,
+		   uint32_t size)
 {
-	if (bse->elem[elem_idx].block != 0) {
+	if (block != 0) {
 		block_index_t bf;
 		block_index_t bi;
 
 		/* block file block resides in */
-		bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
+		bf = (block >> BLOCK_ENTRY_COUNT) &
 			((1 << BLOCK_FILE_COUNT) - 1);
 
 		/* block index in file */
-		bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1);
+		bi = block & ((1U << BLOCK_ENTRY_COUNT) -1);
 
 		/* clear bit in use map */
 		state->blocks[elem_idx][bf].use_map[bi >> 3] &= ~(1U << (bi & 7));
@@ -444,7 +1057,7 @@ invalidate_element(struct store_state *state,
 		char *fname;
 
 		/* unlink the file from disc */
-		fname = store_fname(state, nsurl_hash(bse->url), elem_idx);
+		fname = store_fname(state, ident, elem_idx);
 		if (fname == NULL) {
 			return NSERROR_NOMEM;
 		}
@@ -452,229 +1065,623 @@ invalidate_element(struct store_state *state,
 		free(fname);
 	}
 
-	state->total_alloc -= bse->elem[elem_idx].size;
+	state->total_alloc -= size;
+
+	return NSERROR_OK;
+}
+
+/**
+ * Remove the entry and files associated with an identifier.
+ *
+ * @param state The store state to use.
+ * @param bse The entry to invalidate.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror
+invalidate_entry(struct store_state *state, struct store_entry *bse)
+{
+	nserror ret;
+
+	/* mark entry as invalid */
+	bse->flags |= ENTRY_FLAGS_INVALID;
+
+	/* check if the entry has storage already allocated */
+	if (entry_has_allocation(bse)) {
+		/*
+		 * This entry cannot be immediately removed as it has
+		 * associated allocation so wait for allocation release.
+		 */
+		NSLOG(neosurf, DEBUG,
+		      "invalidating entry with referenced allocation");
+		return NSERROR_OK;
+	}
+
+	NSLOG(neosurf, VERBOSE, "Removing entry for %s", nsurl_access(bse->url));
+
+	ret = invalidate_element(state,
+				 nsurl_hash(bse->url),
+				 ENTRY_ELEM_META,
+				 bse->elem[ENTRY_ELEM_META].block,
+				 bse->elem[ENTRY_ELEM_META].size);
+	if (ret != NSERROR_OK) {
+		NSLOG(neosurf, ERROR, "Error invalidating metadata element");
+	}
+
+	ret = invalidate_element(state,
+				 nsurl_hash(bse->url),
+				 ENTRY_ELEM_DATA,
+				 bse->elem[ENTRY_ELEM_DATA].block,
+				 bse->elem[ENTRY_ELEM_DATA].size);
+	if (ret != NSERROR_OK) {
+		NSLOG(neosurf, ERROR, "Error invalidating data element");
+	}
+
+	journal_append(state, JOURNAL_OP_REMOVE, bse);
+	state->entries_dirty = true;
+	guit->misc->schedule(CONTROL_MAINT_TIME, control_maintenance, state);
+
+	/* As our final act we remove bse from the cache */
+	evict_heap_remove(state, bse);
+	hashmap_remove(state->entries, bse->url);
+	/* From now, bse is invalid memory */
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Remove an unused index record and its stored elements.
+ *
+ * The record is removed using its identifier so no entry needs to be
+ * created for it.
+ *
+ * @param state The store state to use.
+ * @param idx The index record to remove.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror invalidate_record(struct store_state *state, uint32_t idx)
+{
+	const struct store_index_record *rec = &state->index_records[idx];
+	nserror ret;
+
+	index_record_use(state, idx);
+
+	ret = invalidate_element(state, rec->hash, ENTRY_ELEM_META,
+				 rec->block[ENTRY_ELEM_META],
+				 rec->size[ENTRY_ELEM_META]);
+	if (ret != NSERROR_OK) {
+		NSLOG(neosurf, ERROR, "Error invalidating metadata element");
+	}
+
+	ret = invalidate_element(state, rec->hash, ENTRY_ELEM_DATA,
+				 rec->block[ENTRY_ELEM_DATA],
+				 rec->size[ENTRY_ELEM_DATA]);
+	if (ret != NSERROR_OK) {
+		NSLOG(neosurf, ERROR, "Error invalidating data element");
+	}
+
+	journal_append_record(state, JOURNAL_OP_REMOVE, rec,
+			      state->index_heap + rec->url_offset);
+	state->entries_dirty = true;
+	guit->misc->schedule(CONTROL_MAINT_TIME, control_maintenance, state);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Evict a slice of entries from the backing store.
+ *
+ * Entries and unused index records are evicted from the top of their
+ * eviction heaps until the total allocation is no more than the
+ * target. Entries with outstanding allocation cannot be freed so are
+ * passed over and returned to the heap afterwards.
+ *
+ * @param state The store state to use.
+ * @param target The allocation to reduce the store to.
+ * @return The number of entries evicted.
+ */
+static size_t store_evict_slice(struct store_state *state, uint64_t target)
+{
+	struct store_entry *skipped[EVICT_SLICE_COUNT];
+	const struct store_index_record *rec;
+	struct store_entry *bse;
+	unsigned int skip_count = 0;
+	unsigned int step;
+	size_t evicted = 0;
+	int64_t idx;
+
+	for (step = 0;
+	     (step < EVICT_SLICE_COUNT) && (state->total_alloc > target);
+	     step++) {
+		idx = index_evict_peek(state);
+		bse = (state->evict_count > 0) ? state->evict_heap[0] : NULL;
+
+		if (idx >= 0) {
+			rec = &state->index_records[idx];
+			if ((bse == NULL) ||
+			    evict_before(rec->use_count, rec->last_used,
+					 bse->use_count, bse->last_used)) {
+				if (invalidate_record(state, idx) != NSERROR_OK) {
+					break;
+				}
+				evicted++;
+				continue;
+			}
+		}
+
+		if (bse == NULL) {
+			/* nothing left to evict */
+			break;
+		}
+
+		evict_heap_remove(state, bse);
+		if (entry_has_allocation(bse)) {
+			skipped[skip_count++] = bse;
+			continue;
+		}
+
+		if (invalidate_entry(state, bse) != NSERROR_OK) {
+			break;
+		}
+		evicted++;
+	}
+
+	while (skip_count > 0) {
+		evict_heap_update(state, skipped[--skip_count]);
+	}
+
+	return evicted;
+}
+
+/**
+ * Scheduled callback to continue eviction.
+ *
+ * @param s The store state.
+ */
+static void store_evict_cb(void *s)
+{
+	struct store_state *state = s;
+
+	if ((store_evict_slice(state, state->evict_target) > 0) &&
+	    (state->total_alloc > state->evict_target)) {
+		guit->misc->schedule(EVICT_SLICE_TIME, store_evict_cb, state);
+		return;
+	}
+
+	state->evicting = false;
+
+	NSLOG(neosurf, INFO,
+	      "Eviction complete, %"PRIu64" remaining in %"PRIsizet" entries",
+	      state->total_alloc,
+	      hashmap_count(state->entries) + state->index_evict_count);
+}
+
+/**
+ * Evict entries from backing store as per configuration.
+ *
+ * Entries are evicted to ensure the cache remains within the
+ * configured limits on size and number of entries.
+ *
+ * Entries are kept in a heap ordered by use count and then by age as
+ * they are used, so the oldest object with least number of uses is
+ * always available to evict first. Enough entries are evicted
+ * immediately to bring the cache back within its limit and the
+ * remainder of the hysteresis is evicted in scheduled slices.
+ *
+ * @param state The store state to use.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror store_evict(struct store_state *state)
+{
+	/* check if the cache has exceeded configured limit */
+	if (state->total_alloc < state->limit) {
+		/* cache within limits */
+		return NSERROR_OK;
+	}
+
+	if (state->evicting == false) {
+		state->evicting = true;
+		if (state->limit > state->hysteresis) {
+			state->evict_target = state->limit - state->hysteresis;
+		} else {
+			state->evict_target = 0;
+		}
+
+		NSLOG(neosurf, INFO,
+		      "Evicting entries to reduce %"PRIu64" to %"PRIu64,
+		      state->total_alloc,
+		      state->evict_target);
+	}
+
+	/* get back within the limit before anything more is stored */
+	while (state->total_alloc >= state->limit) {
+		if ((state->limit == 0) ||
+		    (store_evict_slice(state, state->limit - 1) == 0)) {
+			break;
+		}
+	}
+
+	guit->misc->schedule(EVICT_SLICE_TIME, store_evict_cb, state);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Release the serialised entry index.
+ *
+ * @param state The backing store state.
+ */
+static void index_unload(struct store_state *state)
+{
+	if (state->index != NULL) {
+#ifdef HAVE_MMAP
+		if (state->index_mapped) {
+			munmap(state->index, state->index_size);
+		} else {
+			free(state->index);
+		}
+#else
+		free(state->index);
+#endif
+	}
+	free(state->index_used);
+	free(state->index_evict);
+
+	state->index = NULL;
+	state->index_size = 0;
+	state->index_mapped = false;
+	state->index_records = NULL;
+	state->index_count = 0;
+	state->index_heap = NULL;
+	state->index_used = NULL;
+	state->index_evict = NULL;
+	state->index_evict_count = 0;
+}
+
+/**
+ * Load the serialised entry index.
+ *
+ * The index is mapped where possible so only the pages of records
+ * which are looked up are read. The total size of the stored
+ * elements is accounted from the records.
+ *
+ * @param state The backing store state to load the index into.
+ * @return NSERROR_OK on success or error code on faliure.
+ */
+static nserror index_load(struct store_state *state)
+{
+	const struct store_index_header *header;
+	const struct store_index_record *rec;
+	char *fname = NULL;
+	struct stat sb;
+	size_t records_size;
+	uint32_t idx;
+	nserror ret;
+	int fd;
+
+	ret = neosurf_mkpath(&fname, NULL, 2, state->path, ENTRIES_FNAME);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
+
+	fd = open(fname, O_RDONLY);
+	free(fname);
+	if (fd == -1) {
+		/* no index is an empty index */
+		return NSERROR_OK;
+	}
+
+	if ((fstat(fd, &sb) != 0) ||
+	    ((size_t)sb.st_size < sizeof(struct store_index_header))) {
+		close(fd);
+		return NSERROR_INIT_FAILED;
+	}
+	state->index_size = sb.st_size;
+
+#ifdef HAVE_MMAP
+	state->index = mmap(NULL, state->index_size,
+			    PROT_READ, MAP_PRIVATE, fd, 0);
+	if (state->index == MAP_FAILED) {
+		state->index = NULL;
+	} else {
+		state->index_mapped = true;
+	}
+#endif
+	if (state->index == NULL) {
+		state->index = malloc(state->index_size);
+		if (state->index == NULL) {
+			close(fd);
+			return NSERROR_NOMEM;
+		}
+		if (nsu_pread(fd, state->index, state->index_size, 0) !=
+		    (ssize_t)state->index_size) {
+			close(fd);
+			index_unload(state);
+			return NSERROR_INIT_FAILED;
+		}
+	}
+	close(fd);
+
+	header = (const struct store_index_header *)state->index;
+	records_size = (size_t)header->count * sizeof(struct store_index_record);
+	if ((header->magic != INDEX_MAGIC) ||
+	    ((sizeof(*header) + records_size + header->heap_size) !=
+	     state->index_size)) {
+		index_unload(state);
+		return NSERROR_INIT_FAILED;
+	}
+
+	state->index_records = (const struct store_index_record *)
+		(state->index + sizeof(*header));
+	state->index_count = header->count;
+	state->index_heap = (const char *)state->index +
+		sizeof(*header) + records_size;
+
+	state->index_used = calloc((state->index_count + 8) / 8, 1);
+	if (state->index_used == NULL) {
+		index_unload(state);
+		return NSERROR_NOMEM;
+	}
+
+	for (idx = 0; idx < state->index_count; idx++) {
+		rec = &state->index_records[idx];
+		if (((uint64_t)rec->url_offset + rec->url_len) > header->heap_size) {
+			index_unload(state);
+			return NSERROR_INIT_FAILED;
+		}
+		/* Note the size allocation */
+		state->total_alloc += rec->size[ENTRY_ELEM_DATA];
+		state->total_alloc += rec->size[ENTRY_ELEM_META];
+	}
+
+	ret = index_evict_build(state);
+	if (ret != NSERROR_OK) {
+		index_unload(state);
+		return ret;
+	}
+
+	return NSERROR_OK;
+}
+
+/**
+ * Apply a journal record.
+ *
+ * @param state The backing store state.
+ * @param jrec The journal record.
+ * @param str The URL of the record.
+ * @return NSERROR_OK on success or error code on faliure.
+ */
+static nserror
+journal_apply(struct store_state *state,
+	      const struct store_journal_record *jrec,
+	      const char *str)
+{
+	const struct store_index_record *rec;
+	struct store_entry *ent;
+	nsurl *url;
+	int64_t idx;
+	nserror ret;
+
+	ret = nsurl_create(str, &url);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
+
+	/* the change supersedes any index record */
+	idx = index_find(state, url);
+	if (idx >= 0) {
+		rec = &state->index_records[idx];
+		state->total_alloc -= rec->size[ENTRY_ELEM_DATA];
+		state->total_alloc -= rec->size[ENTRY_ELEM_META];
+		index_record_use(state, idx);
+	}
+
+	ent = hashmap_lookup(state->entries, url);
+	if (ent != NULL) {
+		state->total_alloc -= ent->elem[ENTRY_ELEM_DATA].size;
+		state->total_alloc -= ent->elem[ENTRY_ELEM_META].size;
+	}
+
+	if (jrec->op == JOURNAL_OP_SET) {
+		if (ent == NULL) {
+			ent = hashmap_insert(state->entries, url);
+		}
+		if (ent == NULL) {
+			nsurl_unref(url);
+			return NSERROR_NOMEM;
+		}
+		entry_from_record(ent, &jrec->record);
+		state->total_alloc += ent->elem[ENTRY_ELEM_DATA].size;
+		state->total_alloc += ent->elem[ENTRY_ELEM_META].size;
+		evict_heap_update(state, ent);
+	} else if (ent != NULL) {
+		evict_heap_remove(state, ent);
+		hashmap_remove(state->entries, url);
+	}
+
+	nsurl_unref(url);
 
 	return NSERROR_OK;
 }
 
 /**
- * Remove the entry and files associated with an identifier.
+ * Replay the entries journal.
  *
- * @param state The store state to use.
- * @param bse The entry to invalidate.
- * @return NSERROR_OK on success or error code on failure.
+ * A truncated final record from an interrupted write is ignored.
+ *
+ * @param state The backing store state to apply the journal to.
+ * @return NSERROR_OK on success or error code on faliure.
  */
-static nserror
-invalidate_entry(struct store_state *state, struct store_entry *bse)
+static nserror journal_replay(struct store_state *state)
 {
+	struct store_journal_record jrec;
+	char *fname = NULL;
+	uint8_t *journal;
+	char *str;
+	struct stat sb;
+	size_t offset = 0;
 	nserror ret;
+	int fd;
 
-	/* mark entry as invalid */
-	bse->flags |= ENTRY_FLAGS_INVALID;
+	ret = neosurf_mkpath(&fname, NULL, 2, state->path, JOURNAL_FNAME);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
 
-	/* check if the entry has storage already allocated */
-	if (((bse->elem[ENTRY_ELEM_DATA].flags &
-	     (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) ||
-	    ((bse->elem[ENTRY_ELEM_META].flags &
-	      (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0)) {
-		/*
-		 * This entry cannot be immediately removed as it has
-		 * associated allocation so wait for allocation release.
-		 */
-		NSLOG(neosurf, DEBUG,
-		      "invalidating entry with referenced allocation");
+	fd = open(fname, O_RDONLY);
+	free(fname);
+	if (fd == -1) {
 		return NSERROR_OK;
 	}
 
-	NSLOG(neosurf, VERBOSE, "Removing entry for %s", nsurl_access(bse->url));
+	if ((fstat(fd, &sb) != 0) || (sb.st_size == 0)) {
+		close(fd);
+		return NSERROR_OK;
+	}
 
-	ret = invalidate_element(state, bse, ENTRY_ELEM_META);
-	if (ret != NSERROR_OK) {
-		NSLOG(neosurf, ERROR, "Error invalidating metadata element");
+	journal = malloc(sb.st_size);
+	if (journal == NULL) {
+		close(fd);
+		return NSERROR_NOMEM;
 	}
+	if (nsu_pread(fd, journal, sb.st_size, 0) != sb.st_size) {
+		free(journal);
+		close(fd);
+		return NSERROR_INIT_FAILED;
+	}
+	close(fd);
 
-	ret = invalidate_element(state, bse, ENTRY_ELEM_DATA);
-	if (ret != NSERROR_OK) {
-		NSLOG(neosurf, ERROR, "Error invalidating data element");
+	while ((offset + sizeof(jrec)) <= (size_t)sb.st_size) {
+		memcpy(&jrec, journal + offset, sizeof(jrec));
+		offset += sizeof(jrec);
+		if ((offset + jrec.record.url_len) > (size_t)sb.st_size) {
+			break;
+		}
+
+		str = strndup((char *)journal + offset, jrec.record.url_len);
+		if (str == NULL) {
+			free(journal);
+			return NSERROR_NOMEM;
+		}
+		offset += jrec.record.url_len;
+
+		ret = journal_apply(state, &jrec, str);
+		free(str);
+		if (ret != NSERROR_OK) {
+			free(journal);
+			return ret;
+		}
+		state->journal_count++;
 	}
 
-	/* As our final act we remove bse from the cache */
-	hashmap_remove(state->entries, bse->url);
-	/* From now, bse is invalid memory */
+	free(journal);
+
+	NSLOG(neosurf, INFO, "Replayed %"PRIsizet" journal records",
+	      state->journal_count);
 
 	return NSERROR_OK;
 }
 
-
 /**
- * Quick sort comparison.
+ * Read description entries into memory.
+ *
+ * @param state The backing store state to put the loaded entries in.
+ * @return NSERROR_OK on success or error code on faliure.
  */
-static int compar(const void *va, const void *vb)
+static nserror
+read_entries(struct store_state *state)
 {
-	const struct store_entry *a = *(const struct store_entry **)va;
-	const struct store_entry *b = *(const struct store_entry **)vb;
+	nserror ret;
 
-	/* consider the allocation flags - if an entry has an
-	 * allocation it is considered more valuable as it cannot be
-	 * freed.
-	 */
-	if ((a->elem[ENTRY_ELEM_DATA].flags == ENTRY_ELEM_FLAG_NONE) &&
-	    (b->elem[ENTRY_ELEM_DATA].flags != ENTRY_ELEM_FLAG_NONE)) {
-		return -1;
-	} else if ((a->elem[ENTRY_ELEM_DATA].flags != ENTRY_ELEM_FLAG_NONE) &&
-		   (b->elem[ENTRY_ELEM_DATA].flags == ENTRY_ELEM_FLAG_NONE)) {
-		return 1;
+	state->entries = hashmap_create(&entries_hashmap_parameters);
+	if (state->entries == NULL) {
+		return NSERROR_NOMEM;
 	}
 
-	if ((a->elem[ENTRY_ELEM_META].flags == ENTRY_ELEM_FLAG_NONE) &&
-	    (b->elem[ENTRY_ELEM_META].flags != ENTRY_ELEM_FLAG_NONE)) {
-		return -1;
-	} else if ((a->elem[ENTRY_ELEM_META].flags != ENTRY_ELEM_FLAG_NONE) &&
-		   (b->elem[ENTRY_ELEM_META].flags == ENTRY_ELEM_FLAG_NONE)) {
-		return 1;
+	ret = index_load(state);
+	if (ret != NSERROR_OK) {
+		return ret;
 	}
 
-	if (a->use_count < b->use_count) {
-		return -1;
-	} else if (a->use_count > b->use_count) {
-		return 1;
+	ret = journal_replay(state);
+	if (ret != NSERROR_OK) {
+		return ret;
 	}
-	/* use count is the same - now consider last use time */
 
-	if (a->last_used < b->last_used) {
-		return -1;
-	} else if (a->last_used > b->last_used) {
-		return 1;
-	}
+	NSLOG(neosurf, INFO, "Read %"PRIu32" entries from cache",
+	      state->index_count);
 
-	/* they are the same */
-	return 0;
+	return NSERROR_OK;
 }
 
-typedef struct {
-	struct store_entry **elist;
-	size_t ent_count;
-} eviction_state_t;
-
 /**
- * Iterator for gathering entries to compute eviction order
+ * Callback marking the index record of an existing entry as used.
  */
-static bool
-entry_eviction_iterator_cb(void *key, void *value, void *ctx)
+static bool index_use_entry_iterator(void *key, void *value, void *ctx)
 {
-	eviction_state_t *estate = ctx;
 	struct store_entry *ent = value;
-	estate->elist[estate->ent_count++] = ent;
+	struct store_state *state = ctx;
+	int64_t idx;
+
+	idx = index_find(state, ent->url);
+	if (idx >= 0) {
+		index_record_use(state, idx);
+	}
 	return false;
 }
 
 /**
- * Evict entries from backing store as per configuration.
- *
- * Entries are evicted to ensure the cache remains within the
- * configured limits on size and number of entries.
+ * Replace the loaded index with the one most recently written.
  *
- * The approach is to check if the cache limits have been exceeded and
- * if so build and sort list of entries to evict. The list is sorted
- * by use count and then by age, so oldest object with least number of uses
- * get evicted first.
- *
- * @param state The store state to use.
- * @return NSERROR_OK on success or error code on failure.
+ * @param state The backing store state.
+ * @return NSERROR_OK on success or error code on faliure.
  */
-static nserror store_evict(struct store_state *state)
+static nserror index_reload(struct store_state *state)
 {
-	size_t ent = 0;
-	size_t removed = 0; /* size of removed entries */
-	nserror ret = NSERROR_OK;
-	size_t old_count;
-	eviction_state_t estate;
-
-	/* check if the cache has exceeded configured limit */
-	if (state->total_alloc < state->limit) {
-		/* cache within limits */
-		return NSERROR_OK;
-	}
-
-	NSLOG(neosurf, INFO,
-	      "Evicting entries to reduce %"PRIu64" by %"PRIsizet,
-	      state->total_alloc,
-	      state->hysteresis);
-
-	/* allocate storage for the list */
-	old_count = hashmap_count(state->entries);
-	estate.ent_count = 0;
-	estate.elist = malloc(sizeof(struct state_entry*) * old_count);
-	if (estate.elist == NULL) {
-		return NSERROR_NOMEM;
-	}
-
-	if (hashmap_iterate(state->entries, entry_eviction_iterator_cb, &estate)) {
-		NSLOG(neosurf, WARNING, "Unexpected termination of eviction iterator");
-		free(estate.elist);
-		return NSERROR_UNKNOWN;
-	}
-
-	if (old_count != estate.ent_count) {
-		NSLOG(neosurf, WARNING, "Incorrect entry count after eviction iterator");
-		free(estate.elist);
-		return NSERROR_UNKNOWN;
-	}
-
-	qsort(estate.elist, estate.ent_count, sizeof(struct state_entry*), compar);
+	uint64_t total_alloc = state->total_alloc;
+	nserror ret;
 
-	/* evict entries in listed order */
-	removed = 0;
-	for (ent = 0; ent < estate.ent_count; ent++) {
-		struct store_entry *bse = estate.elist[ent];
+	index_unload(state);
 
-		removed += bse->elem[ENTRY_ELEM_DATA].size;
-		removed += bse->elem[ENTRY_ELEM_META].size;
+	ret = index_load(state);
 
-		ret = invalidate_entry(state, bse);
-		if (ret != NSERROR_OK) {
-			break;
-		}
+	/* every record was written from the current state */
+	state->total_alloc = total_alloc;
 
-		if (removed > state->hysteresis) {
-			break;
-		}
+	if (ret == NSERROR_OK) {
+		hashmap_iterate(state->entries, index_use_entry_iterator, state);
 	}
-
-	free(estate.elist);
-
-	NSLOG(neosurf, INFO,
-	      "removed %"PRIsizet" in %"PRIsizet" entries, %"PRIu64" remaining in %"PRIsizet" entries",
-	      removed, ent, state->total_alloc, old_count - ent);
-
 	return ret;
 }
 
+
 /**
- * Write a single store entry to disk
- *
- * To serialise a single store entry for now we write out a 32bit int
- * which is the length of the url, then that many bytes of the url.
- * Then we write out the full store entry struct as-is, which includes
- * a useless nsurl pointer.
+ * Record to be serialised into the entries index.
  */
-static nserror
-write_entry(struct store_entry *ent, int fd)
+struct index_write_record {
+	struct store_index_record record; /**< the record */
+	const char *url; /**< URL of the record */
+};
+
+/**
+ * Sort comparison of index write records by hash.
+ */
+static int index_write_record_compar(const void *va, const void *vb)
 {
-	uint32_t len = strlen(nsurl_access(ent->url));
-	if (write(fd, &len, sizeof(len)) != sizeof(len))
-		return NSERROR_SAVE_FAILED;
-	if (write(fd, nsurl_access(ent->url), len) != (ssize_t)len)
-		return NSERROR_SAVE_FAILED;
-	if (write(fd, ent, sizeof(*ent)) != sizeof(*ent))
-		return NSERROR_SAVE_FAILED;
+	const struct index_write_record *a = va;
+	const struct index_write_record *b = vb;
 
-	return NSERROR_OK;
+	if (a->record.hash < b->record.hash) {
+		return -1;
+	} else if (a->record.hash > b->record.hash) {
+		return 1;
+	}
+	return 0;
 }
 
 typedef struct {
-	int fd;
-	size_t written;
+	struct index_write_record *records;
+	size_t count;
 } write_entry_iteration_state;
 
 /**
@@ -686,15 +1693,79 @@ write_entry_iterator(void *key, void *value, void *ctx)
 	/* We ignore the key */
 	struct store_entry *ent = value;
 	write_entry_iteration_state *state = ctx;
-	state->written++;
-	/* We stop early if we fail to write this entry */
-	return write_entry(ent, state->fd) != NSERROR_OK;
+	struct index_write_record *wrec = &state->records[state->count++];
+
+	record_from_entry(&wrec->record, ent);
+	wrec->url = nsurl_access(ent->url);
+
+	return false;
+}
+
+/**
+ * Write all of a buffer to a file descriptor.
+ */
+static bool write_all(int fd, const void *data, size_t len)
+{
+	ssize_t wr;
+
+	while (len > 0) {
+		wr = write(fd, data, len);
+		if (wr <= 0) {
+			return false;
+		}
+		data = (const uint8_t *)data + wr;
+		len -= wr;
+	}
+	return true;
+}
+
+/**
+ * Write pending journal records to file.
+ *
+ * @param state The backing store state to serialise.
+ * @return NSERROR_OK on success or error code on failure.
+ */
+static nserror write_journal(struct store_state *state)
+{
+	char *fname = NULL;
+	nserror ret;
+	int fd;
+
+	if (state->journal_len == 0) {
+		return NSERROR_OK;
+	}
+
+	ret = neosurf_mkpath(&fname, NULL, 2, state->path, JOURNAL_FNAME);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
+
+	fd = open(fname, O_WRONLY | O_CREAT | O_APPEND, S_IRUSR | S_IWUSR);
+	free(fname);
+	if (fd == -1) {
+		return NSERROR_SAVE_FAILED;
+	}
+
+	if (!write_all(fd, state->journal, state->journal_len)) {
+		close(fd);
+		return NSERROR_SAVE_FAILED;
+	}
+	close(fd);
+
+	NSLOG(neosurf, INFO, "Wrote %"PRIsizet" bytes of journal",
+	      state->journal_len);
+
+	state->journal_len = 0;
+
+	return NSERROR_OK;
 }
 
 /**
  * Write filesystem entries to file.
  *
- * Serialise entry index out to storage.
+ * Serialise the entry index out to storage as records sorted by URL
+ * hash followed by the URL strings. The journal is discarded once the
+ * index has been replaced.
  *
  * @param state The backing store state to serialise.
  * @return NSERROR_OK on success or error code on failure.
@@ -704,36 +1775,85 @@ static nserror write_entries(struct store_state *state)
 	char *tname = NULL; /* temporary file name for atomic replace */
 	char *fname = NULL; /* target filename */
 	write_entry_iteration_state weistate;
+	struct store_index_header header;
+	const struct store_index_record *rec;
+	size_t max_count;
+	size_t idx;
+	uint32_t heap_size = 0;
+	bool ok;
+	int fd;
 	nserror ret;
 
-	memset(&weistate, 0, sizeof(weistate));
-
 	if (state->entries_dirty == false) {
 		/* entries have not been updated since last write */
 		return NSERROR_OK;
 	}
 
+	/* gather records from entries and the unused index records */
+	max_count = hashmap_count(state->entries) + state->index_count;
+	weistate.count = 0;
+	weistate.records = malloc(sizeof(*weistate.records) * (max_count + 1));
+	if (weistate.records == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	hashmap_iterate(state->entries, write_entry_iterator, &weistate);
+
+	for (idx = 0; idx < state->index_count; idx++) {
+		if (!index_record_used(state, idx)) {
+			rec = &state->index_records[idx];
+			weistate.records[weistate.count].record = *rec;
+			weistate.records[weistate.count].url =
+				state->index_heap + rec->url_offset;
+			weistate.count++;
+		}
+	}
+
+	qsort(weistate.records, weistate.count,
+	      sizeof(*weistate.records), index_write_record_compar);
+
+	for (idx = 0; idx < weistate.count; idx++) {
+		weistate.records[idx].record.url_offset = heap_size;
+		heap_size += weistate.records[idx].record.url_len;
+	}
+
 	ret = neosurf_mkpath(&tname, NULL, 2, state->path, "t"ENTRIES_FNAME);
 	if (ret != NSERROR_OK) {
+		free(weistate.records);
 		return ret;
 	}
 
-	weistate.fd = open(tname, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-	if (weistate.fd == -1) {
+	fd = open(tname, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+	if (fd == -1) {
+		free(weistate.records);
 		free(tname);
 		return NSERROR_SAVE_FAILED;
 	}
 
-	if (hashmap_iterate(state->entries, write_entry_iterator, &weistate)) {
-		/* The iteration ended early, so we failed */
-		close(weistate.fd);
+	memset(&header, 0, sizeof(header));
+	header.magic = INDEX_MAGIC;
+	header.count = weistate.count;
+	header.heap_size = heap_size;
+
+	ok = write_all(fd, &header, sizeof(header));
+	for (idx = 0; ok && (idx < weistate.count); idx++) {
+		ok = write_all(fd, &weistate.records[idx].record,
+			       sizeof(struct store_index_record));
+	}
+	for (idx = 0; ok && (idx < weistate.count); idx++) {
+		ok = write_all(fd, weistate.records[idx].url,
+			       weistate.records[idx].record.url_len);
+	}
+
+	close(fd);
+	free(weistate.records);
+
+	if (!ok) {
 		unlink(tname);
 		free(tname);
 		return NSERROR_SAVE_FAILED;
 	}
 
-	close(weistate.fd);
-
 	ret = neosurf_mkpath(&fname, NULL, 2, state->path, ENTRIES_FNAME);
 	if (ret != NSERROR_OK) {
 		unlink(tname);
@@ -749,8 +1869,20 @@ static nserror write_entries(struct store_state *state)
 		free(fname);
 		return NSERROR_SAVE_FAILED;
 	}
+	free(tname);
+	free(fname);
+
+	/* the index now holds everything the journal recorded */
+	ret = neosurf_mkpath(&fname, NULL, 2, state->path, JOURNAL_FNAME);
+	if (ret == NSERROR_OK) {
+		unlink(fname);
+		free(fname);
+	}
+	state->journal_len = 0;
+	state->journal_count = 0;
+	state->entries_dirty = false;
 
-	NSLOG(neosurf, INFO, "Wrote out %"PRIsizet" entries", weistate.written);
+	NSLOG(neosurf, INFO, "Wrote out %"PRIsizet" entries", weistate.count);
 
 	return NSERROR_OK;
 }
@@ -892,7 +2024,15 @@ static void control_maintenance(void *s)
 {
 	struct store_state *state = s;
 
-	write_entries(state);
+	/* append changes to the journal until it is large enough
+	 * relative to the index to be worth rewriting the index.
+	 */
+	if ((state->journal_count < JOURNAL_COMPACT_MIN) ||
+	    (state->journal_count < (state->index_count / 2))) {
+		write_journal(state);
+	} else if (write_entries(state) == NSERROR_OK) {
+		index_reload(state);
+	}
 	write_blocks(state);
 	set_block_extents(state);
 }
@@ -916,7 +2056,7 @@ get_store_entry(struct store_state *state, nsurl *url, struct store_entry **bse)
 {
 	struct store_entry *ent;
 
-	ent = hashmap_lookup(state->entries, url);
+	ent = store_entry_lookup(state, url);
 
 	if (ent == NULL) {
 		return NSERROR_NOT_FOUND;
@@ -926,6 +2066,7 @@ get_store_entry(struct store_state *state, nsurl *url, struct store_entry **bse)
 
 	ent->last_used = time(NULL);
 	ent->use_count++;
+	evict_heap_update(state, ent);
 
 	state->entries_dirty = true;
 
@@ -1001,7 +2142,7 @@ set_store_entry(struct store_state *state,
 		return ret;
 	}
 
-	se = hashmap_lookup(state->entries, url);
+	se = store_entry_lookup(state, url);
 	if (se == NULL) {
 		se = hashmap_insert(state->entries, url);
 	}
@@ -1025,6 +2166,7 @@ set_store_entry(struct store_state *state,
 	/* set the common entry data */
 	se->use_count = 1;
 	se->last_used = time(NULL);
+	evict_heap_update(state, se);
 
 	/* store the data in the element */
 	elem->flags |= ENTRY_ELEM_FLAG_HEAP;
@@ -1111,109 +2253,26 @@ unlink_entries(struct store_state *state)
 {
 	char *fname = NULL;
 	nserror ret;
-
-	ret = neosurf_mkpath(&fname, NULL, 2, state->path, ENTRIES_FNAME);
-	if (ret != NSERROR_OK) {
-		return ret;
-	}
-
-	unlink(fname);
-
-	free(fname);
-	return NSERROR_OK;
-}
-
-/**
- * Read description entries into memory.
- *
- * @param state The backing store state to put the loaded entries in.
- * @return NSERROR_OK on success or error code on faliure.
- */
-static nserror
-read_entries(struct store_state *state)
-{
-	char *fname = NULL;
-	char *url;
-	nsurl *nsurl;
-	nserror ret;
-	size_t read_entries = 0;
-	struct store_entry *ent;
-	int fd;
-
-	ret = neosurf_mkpath(&fname, NULL, 2, state->path, ENTRIES_FNAME);
-	if (ret != NSERROR_OK) {
-		return ret;
-	}
-
-	state->entries = hashmap_create(&entries_hashmap_parameters);
-	if (state->entries == NULL) {
-		free(fname);
-		return NSERROR_NOMEM;
-	}
-
-	fd = open(fname, O_RDWR);
-	if (fd != -1) {
-		uint32_t urllen;
-		while (read(fd, &urllen, sizeof(urllen)) == sizeof(urllen)) {
-			url = calloc(1, urllen+1);
-			if (url == NULL) {
-				close(fd);
-				free(fname);
-				return NSERROR_NOMEM;
-			}
-			if (read(fd, url, urllen) != (ssize_t)urllen) {
-				free(url);
-				close(fd);
-				free(fname);
-				return NSERROR_INIT_FAILED;
-			}
-			ret = nsurl_create(url, &nsurl);
-			if (ret != NSERROR_OK) {
-				free(url);
-				close(fd);
-				free(fname);
-				return ret;
-			}
-			free(url);
-			/* We have to be careful here about nsurl refs */
-			ent = hashmap_insert(state->entries, nsurl);
-			if (ent == NULL) {
-				nsurl_unref(nsurl);
-				close(fd);
-				free(fname);
-				return NSERROR_NOMEM;
-			}
-			/* At this point, ent actually owns a ref of nsurl */
-			if (read(fd, ent, sizeof(*ent)) != sizeof(*ent)) {
-				/* The read failed, so reset the ptr */
-				ent->url = nsurl; /* It already had a ref */
-				nsurl_unref(nsurl);
-				close(fd);
-				free(fname);
-				return NSERROR_INIT_FAILED;
-			}
-			ent->url = nsurl; /* It already owns a ref */
-			nsurl_unref(nsurl);
-			NSLOG(neosurf, DEBUG, "Successfully read entry for %s", nsurl_access(ent->url));
-			read_entries++;
-			/* Note the size allocation */
-			state->total_alloc += ent->elem[ENTRY_ELEM_DATA].size;
-			state->total_alloc += ent->elem[ENTRY_ELEM_META].size;
-			/* And ensure we don't pretend to have this in memory yet */
-			ent->elem[ENTRY_ELEM_DATA].flags &= ~(ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP);
-			ent->elem[ENTRY_ELEM_META].flags &= ~(ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP);
-
-		}
-		close(fd);
+
+	ret = neosurf_mkpath(&fname, NULL, 2, state->path, ENTRIES_FNAME);
+	if (ret != NSERROR_OK) {
+		return ret;
 	}
 
-	NSLOG(neosurf, INFO, "Read %"PRIsizet" entries from cache", read_entries);
+	unlink(fname);
+	free(fname);
+
+	ret = neosurf_mkpath(&fname, NULL, 2, state->path, JOURNAL_FNAME);
+	if (ret != NSERROR_OK) {
+		return ret;
+	}
 
+	unlink(fname);
 	free(fname);
+
 	return NSERROR_OK;
 }
 
-
 /**
  * Read block file usage bitmaps.
  *
@@ -1418,6 +2477,335 @@ control_error: /* problem with the control file */
 
 /* Functions exported in the backing store table */
 
+/**
+ * Open the small block file an element of an entry resides in.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry the element belongs to.
+ * \param elem_idx The element index within the entry.
+ * \param offset_out Updated with the offset of the block in the file.
+ * \return The block file descriptor or -1 on error.
+ */
+static int store_block_open(struct store_state *state,
+			    struct store_entry *bse,
+			    int elem_idx,
+			    off_t *offset_out)
+{
+	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
+		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
+	block_index_t bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1); /* block index in file */
+
+	/* ensure the block file fd is good */
+	if (state->blocks[elem_idx][bf].fd == -1) {
+		state->blocks[elem_idx][bf].fd = store_open(state, bf,
+				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
+		if (state->blocks[elem_idx][bf].fd == -1) {
+			NSLOG(neosurf, ERROR, "Open failed errno %d", errno);
+			return -1;
+		}
+
+		/* flag that a block file has been opened */
+		state->blocks_opened = true;
+	}
+
+	*offset_out = (unsigned int)bi << log2_block_size[elem_idx];
+
+	return state->blocks[elem_idx][bf].fd;
+}
+
+/**
+ * release any allocation for an entry
+ */
+static nserror entry_release_alloc(struct store_entry_element *elem)
+{
+	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			NSLOG(neosurf, DEEPDEBUG, "freeing %p", elem->data);
+			free(elem->data);
+			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
+		}
+	}
+#ifdef HAVE_MMAP
+	if ((elem->flags & ENTRY_ELEM_FLAG_MMAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			NSLOG(neosurf, DEEPDEBUG, "unmapping %p", elem->data);
+			munmap(elem->data, elem->size);
+			elem->flags &= ~ENTRY_ELEM_FLAG_MMAP;
+		}
+	}
+#endif
+	return NSERROR_OK;
+}
+
+
+#ifdef WITH_THREADS
+/**
+ * Perform the I/O for a queued element write.
+ *
+ * Called on the writer thread.
+ *
+ * \param job The write to perform.
+ */
+static void store_writer_write(struct store_write_job *job)
+{
+	struct store_entry_element *elem = &job->bse->elem[job->elem_idx];
+	int fd;
+
+	if (job->fd != -1) {
+		job->written = nsu_pwrite(job->fd,
+					  elem->data,
+					  elem->size,
+					  job->offset);
+		job->err = errno;
+		return;
+	}
+
+	fd = open(job->fname, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+	if (fd < 0) {
+		job->written = -1;
+		job->err = errno;
+		return;
+	}
+
+	job->written = write(fd, elem->data, elem->size);
+	job->err = errno; /* close can change errno */
+
+	close(fd);
+}
+
+/**
+ * Writer thread main loop.
+ *
+ * Writes pending jobs in order and moves them to the complete list
+ * until asked to quit and no jobs remain.
+ */
+static void *store_writer_main(void *p)
+{
+	struct store_writer *writer = p;
+	struct store_write_job *job;
+
+	pthread_mutex_lock(&writer->lock);
+	for (;;) {
+		while ((writer->pending == NULL) && (writer->quit == false)) {
+			pthread_cond_wait(&writer->cond, &writer->lock);
+		}
+		job = writer->pending;
+		if (job == NULL) {
+			break;
+		}
+		writer->pending = job->next;
+		if (writer->pending == NULL) {
+			writer->pending_tail = &writer->pending;
+		}
+		pthread_mutex_unlock(&writer->lock);
+
+		store_writer_write(job);
+
+		pthread_mutex_lock(&writer->lock);
+		job->next = writer->complete;
+		writer->complete = job;
+	}
+	pthread_mutex_unlock(&writer->lock);
+
+	return NULL;
+}
+
+/**
+ * Process completed writes.
+ *
+ * Drops the reference each write held on its element data. An entry
+ * whose write failed is invalidated so it is not served from disc, and
+ * one whose write succeeded is journaled.
+ *
+ * \param s The store state.
+ */
+static void store_writer_reap(void *s)
+{
+	struct store_state *state = s;
+	struct store_writer *writer = state->writer;
+	struct store_write_job *job;
+	struct store_entry_element *elem;
+	bool journaled = false;
+
+	pthread_mutex_lock(&writer->lock);
+	job = writer->complete;
+	writer->complete = NULL;
+	pthread_mutex_unlock(&writer->lock);
+
+	while (job != NULL) {
+		struct store_write_job *next = job->next;
+		struct store_entry *bse = job->bse;
+
+		elem = &bse->elem[job->elem_idx];
+		if (job->written != (ssize_t)elem->size) {
+			NSLOG(neosurf, ERROR,
+			      "Write failed %"PRIssizet" of %d bytes from %p errno %d",
+			      job->written, elem->size, elem->data, job->err);
+			bse->flags |= ENTRY_FLAGS_INVALID;
+		} else {
+			NSLOG(neosurf, VERBOSE, "Wrote %"PRIssizet" bytes from %p",
+			      job->written, elem->data);
+			/* only journal the entry once its data is on disc */
+			journal_append(state, JOURNAL_OP_SET, bse);
+			journaled = true;
+		}
+
+		entry_release_alloc(elem);
+		if ((bse->flags & ENTRY_FLAGS_INVALID) != 0) {
+			invalidate_entry(state, bse);
+		}
+
+		writer->outstanding--;
+		free(job->fname);
+		free(job);
+		job = next;
+	}
+
+	if (journaled) {
+		/* ensure the journal is written out */
+		state->entries_dirty = true;
+		guit->misc->schedule(CONTROL_MAINT_TIME,
+				     control_maintenance, state);
+	}
+
+	if (writer->outstanding > 0) {
+		guit->misc->schedule(WRITER_REAP_TIME, store_writer_reap, state);
+	}
+}
+
+/**
+ * Queue an element of an entry to be written by the writer thread.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to store
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_writer_queue(struct store_state *state,
+				  struct store_entry *bse,
+				  int elem_idx)
+{
+	struct store_writer *writer = state->writer;
+	struct store_write_job *job;
+	nserror ret;
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		return NSERROR_NOMEM;
+	}
+	job->bse = bse;
+	job->elem_idx = elem_idx;
+
+	if (bse->elem[elem_idx].block != 0) {
+		job->fd = store_block_open(state, bse, elem_idx, &job->offset);
+		if (job->fd == -1) {
+			free(job);
+			return NSERROR_SAVE_FAILED;
+		}
+	} else {
+		job->fd = -1;
+		job->fname = store_fname(state, nsurl_hash(bse->url), elem_idx);
+		if (job->fname == NULL) {
+			free(job);
+			return NSERROR_NOMEM;
+		}
+		ret = neosurf_mkdir_all(job->fname);
+		if (ret != NSERROR_OK) {
+			NSLOG(neosurf, WARNING,
+			      "file path \"%s\" could not be created",
+			      job->fname);
+			free(job->fname);
+			free(job);
+			return NSERROR_SAVE_FAILED;
+		}
+	}
+
+	/* the data must remain until the write is reaped */
+	bse->elem[elem_idx].ref++;
+
+	pthread_mutex_lock(&writer->lock);
+	*writer->pending_tail = job;
+	writer->pending_tail = &job->next;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+
+	if (writer->outstanding++ == 0) {
+		guit->misc->schedule(WRITER_REAP_TIME, store_writer_reap, state);
+	}
+
+	return NSERROR_OK;
+}
+
+/**
+ * Start the writer thread.
+ *
+ * \param state The backing store state to write for.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_writer_start(struct store_state *state)
+{
+	struct store_writer *writer;
+
+	writer = calloc(1, sizeof(*writer));
+	if (writer == NULL) {
+		return NSERROR_NOMEM;
+	}
+	writer->pending_tail = &writer->pending;
+
+	if (pthread_mutex_init(&writer->lock, NULL) != 0) {
+		free(writer);
+		return NSERROR_INIT_FAILED;
+	}
+	if (pthread_cond_init(&writer->cond, NULL) != 0) {
+		pthread_mutex_destroy(&writer->lock);
+		free(writer);
+		return NSERROR_INIT_FAILED;
+	}
+	if (pthread_create(&writer->thread, NULL,
+			   store_writer_main, writer) != 0) {
+		pthread_cond_destroy(&writer->cond);
+		pthread_mutex_destroy(&writer->lock);
+		free(writer);
+		return NSERROR_INIT_FAILED;
+	}
+
+	state->writer = writer;
+
+	return NSERROR_OK;
+}
+
+/**
+ * Stop the writer thread once all queued writes are complete.
+ *
+ * \param state The backing store state the writer belongs to.
+ */
+static void store_writer_stop(struct store_state *state)
+{
+	struct store_writer *writer = state->writer;
+
+	if (writer == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&writer->lock);
+	writer->quit = true;
+	pthread_cond_signal(&writer->cond);
+	pthread_mutex_unlock(&writer->lock);
+
+	pthread_join(writer->thread, NULL);
+
+	guit->misc->schedule(-1, store_writer_reap, state);
+	store_writer_reap(state);
+
+	pthread_cond_destroy(&writer->cond);
+	pthread_mutex_destroy(&writer->lock);
+	free(writer);
+	state->writer = NULL;
+}
+#endif
+
 /**
  * Initialise the backing store.
  *
@@ -1506,6 +2894,13 @@ initialise(const struct llcache_store_parameters *parameters)
 		return ret;
 	}
 
+#ifdef WITH_THREADS
+	if (store_writer_start(newstate) != NSERROR_OK) {
+		NSLOG(neosurf, WARNING,
+		      "Unable to start writer thread, writing synchronously");
+	}
+#endif
+
 	storestate = newstate;
 
 	NSLOG(neosurf, INFO, "FS backing store init successful");
@@ -1537,7 +2932,11 @@ finalise(void)
 	unsigned int op_count;
 
 	if (storestate != NULL) {
+#ifdef WITH_THREADS
+		store_writer_stop(storestate);
+#endif
 		guit->misc->schedule(-1, control_maintenance, storestate);
+		guit->misc->schedule(-1, store_evict_cb, storestate);
 		write_entries(storestate);
 		write_blocks(storestate);
 
@@ -1566,6 +2965,9 @@ finalise(void)
 			      0);
 		}
 
+		index_unload(storestate);
+		free(storestate->journal);
+		free(storestate->evict_heap);
 		hashmap_destroy(storestate->entries);
 		free(storestate->path);
 		free(storestate);
@@ -1587,28 +2989,16 @@ static nserror store_write_block(struct store_state *state,
 			 struct store_entry *bse,
 			 int elem_idx)
 {
-	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
-		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
-	block_index_t bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1); /* block index in file */
 	ssize_t wr;
 	off_t offst;
+	int fd;
 
-	/* ensure the block file fd is good */
-	if (state->blocks[elem_idx][bf].fd == -1) {
-		state->blocks[elem_idx][bf].fd = store_open(state, bf,
-				elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
-		if (state->blocks[elem_idx][bf].fd == -1) {
-			NSLOG(neosurf, ERROR, "Open failed errno %d", errno);
-			return NSERROR_SAVE_FAILED;
-		}
-
-		/* flag that a block file has been opened */
-		state->blocks_opened = true;
+	fd = store_block_open(state, bse, elem_idx, &offst);
+	if (fd == -1) {
+		return NSERROR_SAVE_FAILED;
 	}
 
-	offst = (unsigned int)bi << log2_block_size[elem_idx];
-
-	wr = nsu_pwrite(state->blocks[elem_idx][bf].fd,
+	wr = nsu_pwrite(fd,
 			bse->elem[elem_idx].data,
 			bse->elem[elem_idx].size,
 			offst);
@@ -1717,6 +3107,13 @@ store(nsurl *url,
 		return ret;
 	}
 
+#ifdef WITH_THREADS
+	if (storestate->writer != NULL) {
+		/* write out on the writer thread */
+		return store_writer_queue(storestate, bse, elem_idx);
+	}
+#endif
+
 	if (bse->elem[elem_idx].block != 0) {
 		/* small block storage */
 		ret = store_write_block(storestate, bse, elem_idx);
@@ -1725,25 +3122,12 @@ store(nsurl *url,
 		ret = store_write_file(storestate, bse, elem_idx);
 	}
 
-	return ret;
-}
-
-/**
- * release any allocation for an entry
- */
-static nserror entry_release_alloc(struct store_entry_element *elem)
-{
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
-		elem->ref--;
-		if (elem->ref == 0) {
-			NSLOG(neosurf, DEEPDEBUG, "freeing %p", elem->data);
-			free(elem->data);
-			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
-		}
+	if (ret == NSERROR_OK) {
+		journal_append(storestate, JOURNAL_OP_SET, bse);
 	}
-	return NSERROR_OK;
-}
 
+	return ret;
+}
 
 /**
  * Read an element of an entry from a small block file in the backing storage.
@@ -1850,6 +3234,59 @@ static nserror store_read_file(struct store_state *state,
 	return ret;
 }
 
+#ifdef HAVE_MMAP
+/**
+ * Map an element of an entry from an individual file in the backing storage.
+ *
+ * Files shorter than the element, for example after an interrupted
+ * write, are not mapped as reading past their end would fault; the
+ * caller reads them instead, which reports the error.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to map.
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_mmap_file(struct store_state *state,
+			 struct store_entry *bse,
+			 int elem_idx)
+{
+	int fd;
+	void *data;
+	struct stat sb;
+
+	fd = store_open(state, nsurl_hash(bse->url), elem_idx, O_RDONLY);
+	if (fd < 0) {
+		NSLOG(neosurf, ERROR, "Open failed %d errno %d", fd, errno);
+		return NSERROR_NOT_FOUND;
+	}
+
+	if (fstat(fd, &sb) != 0 ||
+	    sb.st_size < (off_t)bse->elem[elem_idx].size) {
+		NSLOG(neosurf, INFO, "File too short to map");
+		close(fd);
+		return NSERROR_NOT_FOUND;
+	}
+
+	data = mmap(NULL, bse->elem[elem_idx].size,
+		    PROT_READ, MAP_PRIVATE, fd, 0);
+
+	close(fd);
+
+	if (data == MAP_FAILED) {
+		NSLOG(neosurf, INFO, "mmap failed errno %d", errno);
+		return NSERROR_NOMEM;
+	}
+
+	bse->elem[elem_idx].data = data;
+
+	NSLOG(neosurf, DEEPDEBUG, "Mapped %"PRIu32" bytes at %p",
+	      bse->elem[elem_idx].size, data);
+
+	return NSERROR_OK;
+}
+#endif
+
 /**
  * Retrieve an object from the backing store.
  *
@@ -1896,7 +3333,7 @@ fetch(nsurl *url,
 	elem = &bse->elem[elem_idx];
 
 	/* if an allocation already exists return it */
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+	if ((elem->flags & (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) {
 		/* use the existing allocation and bump the ref count. */
 		elem->ref++;
 
@@ -1904,6 +3341,14 @@ fetch(nsurl *url,
 		      "Using existing entry (%p) allocation %p refs:%d", bse,
 		      elem->data, elem->ref);
 
+#ifdef HAVE_MMAP
+	} else if ((elem->block == 0) &&
+		   (elem->size >= MMAP_MIN_SIZE) &&
+		   (store_mmap_file(storestate, bse, elem_idx) == NSERROR_OK)) {
+		/* large element served directly from the page cache */
+		elem->flags |= ENTRY_ELEM_FLAG_MMAP;
+		elem->ref = 1;
+#endif
 	} else {
 		/* allocate from the heap */
 		elem->data = malloc(elem->size);
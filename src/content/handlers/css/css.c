@@ -589,7 +589,8 @@ css_error nscss_handle_import(void *pw, css_stylesheet *parent,
 		ctx = NULL;
 	} else {
 		nerror = hlcache_handle_retrieve(ns_url,
-				0, ns_ref, NULL, nscss_import, ctx,
+				LLCACHE_RETRIEVE_PRIORITY_HIGH,
+				ns_ref, NULL, nscss_import, ctx,
 				&child, accept,
 				&c->imports[c->import_count].c);
 		if (nerror != NSERROR_OK) {
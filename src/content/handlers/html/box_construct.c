@@ -27,6 +27,7 @@
 
 #include <string.h>
 #include <dom/dom.h>
+#include <nsutils/time.h>
 
 #include <neosurf/utils/errors.h>
 #include <neosurf/utils/nsoption.h>
@@ -1222,15 +1223,39 @@ static bool box_construct_text(struct box_construct_ctx *ctx)
 
 
 /**
- * Convert an ELEMENT node to a box tree fragment,
- * then schedule conversion of the next ELEMENT node
+ * Number of elements converted between checks of the time budget
+ */
+#define BOX_CONSTRUCT_CHECK_INTERVAL 8
+
+
+/**
+ * Determine if box construction may continue without yielding
+ *
+ * \param start Monotonic time in ms the current slice started
+ * \return true if some of the box_construct_budget option remains
+ */
+static bool box_construct_budget_remains(uint64_t start)
+{
+	uint64_t now;
+
+	nsu_getmonotonic_ms(&now);
+
+	return (now - start) < nsoption_uint(box_construct_budget);
+}
+
+
+/**
+ * Convert ELEMENT nodes to box tree fragments until the time budget
+ * runs out, then schedule conversion of the next ELEMENT node
  */
 static void convert_xml_to_box(struct box_construct_ctx *ctx)
 {
 	dom_node *next;
 	bool convert_children;
 	uint32_t num_processed = 0;
-	const uint32_t max_processed_before_yield = 10;
+	uint64_t start;
+
+	nsu_getmonotonic_ms(&start);
 
 	do {
 		convert_children = true;
@@ -1301,7 +1326,8 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 			free(ctx);
 			return;
 		}
-	} while (++num_processed < max_processed_before_yield);
+	} while (((++num_processed % BOX_CONSTRUCT_CHECK_INTERVAL) != 0) ||
+		 box_construct_budget_remains(start));
 
 	/* More work to do: schedule a continuation */
 	guit->misc->schedule(0, (void *)convert_xml_to_box, ctx);
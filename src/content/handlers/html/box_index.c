@@ -0,0 +1,273 @@
+/*
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Spatial index over the children of laid out boxes implementation.
+ *
+ * Each indexed list of children is held in document order along with
+ * the running maximum of the children's bottom edges and the minimum,
+ * from the end, of their top edges. Both are monotonic so the children
+ * which may overlap a vertical range form a span found by two binary
+ * searches. Children are normally stacked down the page, in which case
+ * the span holds just the overlapping children, but any order gives a
+ * correct, if wider, span. Painting order is unaffected as the span is
+ * walked in document order.
+ */
+
+#include <stdbool.h>
+#include <limits.h>
+
+#include <neosurf/utils/errors.h>
+#include "utils/talloc.h"
+#include <neosurf/types.h>
+#include <neosurf/css.h>
+
+#include <neosurf/content/handlers/html/box.h>
+#include "content/handlers/html/box_index.h"
+
+/** Smallest number of children worth indexing */
+#define BOX_INDEX_MIN_CHILDREN 32
+
+/**
+ * Indexed child.
+ */
+struct box_index_entry {
+	struct box *box; /**< the child */
+	int y0_min; /**< smallest top edge of this and later children */
+	int y1_max; /**< largest bottom edge of this and earlier children */
+};
+
+/**
+ * Index over one list of children.
+ */
+struct box_index_list {
+	unsigned int count; /**< number of entries, zero if not indexed */
+	unsigned int alloc; /**< number of entries allocated */
+	struct box_index_entry *entry; /**< entries in document order */
+};
+
+/**
+ * Spatial index of a box's children.
+ */
+struct box_index {
+	struct box_index_list children; /**< in flow children */
+	struct box_index_list floats; /**< float children */
+};
+
+
+/**
+ * Get the vertical extent of a child within its parent.
+ *
+ * The extent covers the area the child and its descendants may draw
+ * in or be hit in.
+ *
+ * \param child  box to get extent of
+ * \param y0     updated to top edge, relative to the parent's children
+ * \param y1     updated to bottom edge, exclusive
+ */
+static void box_index_extent(const struct box *child, int *y0, int *y1)
+{
+	css_computed_clip_rect css_rect;
+
+	if (child->style != NULL &&
+	    css_computed_position(child->style) == CSS_POSITION_ABSOLUTE &&
+	    css_computed_clip(child->style, &css_rect) == CSS_CLIP_RECT) {
+		/* a clip rect may reach beyond the child's boxes */
+		*y0 = INT_MIN;
+		*y1 = INT_MAX;
+		return;
+	}
+
+	*y0 = child->y + child->descendant_y0;
+	*y1 = child->y + child->descendant_y1;
+}
+
+
+/**
+ * Fill an index list from a list of children.
+ *
+ * \param index   index the list belongs to, for allocation
+ * \param list    list to fill
+ * \param first   first child in list
+ * \param floats  the children are linked by next_float, not next
+ * \return NSERROR_OK on success or NSERROR_NOMEM on memory exhaustion
+ */
+static nserror
+box_index_fill(struct box_index *index,
+		struct box_index_list *list,
+		struct box *first,
+		bool floats)
+{
+	struct box_index_entry *entry;
+	struct box *child;
+	unsigned int count = 0;
+	unsigned int i;
+	int y0, y1;
+	int y_max = INT_MIN;
+	int y_min = INT_MAX;
+
+	for (child = first; child != NULL;
+			child = floats ? child->next_float : child->next) {
+		if (!floats && (child->type == BOX_FLOAT_LEFT ||
+				child->type == BOX_FLOAT_RIGHT))
+			continue;
+		count++;
+	}
+
+	list->count = 0;
+	if (count < BOX_INDEX_MIN_CHILDREN)
+		return NSERROR_OK;
+
+	if (count > list->alloc) {
+		entry = talloc_realloc(index, list->entry,
+				struct box_index_entry, count);
+		if (entry == NULL)
+			return NSERROR_NOMEM;
+		list->entry = entry;
+		list->alloc = count;
+	}
+	entry = list->entry;
+
+	i = 0;
+	for (child = first; child != NULL;
+			child = floats ? child->next_float : child->next) {
+		if (!floats && (child->type == BOX_FLOAT_LEFT ||
+				child->type == BOX_FLOAT_RIGHT))
+			continue;
+
+		box_index_extent(child, &y0, &y1);
+		if (y_max < y1)
+			y_max = y1;
+
+		entry[i].box = child;
+		entry[i].y0_min = y0;
+		entry[i].y1_max = y_max;
+		i++;
+	}
+
+	for (i = count; i > 0; i--) {
+		if (y_min > entry[i - 1].y0_min)
+			y_min = entry[i - 1].y0_min;
+		entry[i - 1].y0_min = y_min;
+	}
+
+	list->count = count;
+
+	return NSERROR_OK;
+}
+
+
+/* exported function documented in html/box_index.h */
+nserror box_index_build(struct box *box)
+{
+	struct box *child;
+	nserror res = NSERROR_OK;
+	nserror err;
+
+	if ((box->flags & REPLACE_DIM) == 0 &&
+	    box->type != BOX_INLINE && box->type != BOX_TEXT) {
+		if (box->index == NULL) {
+			box->index = talloc_zero(box, struct box_index);
+		}
+
+		if (box->index != NULL) {
+			err = box_index_fill(box->index,
+					&box->index->children,
+					box->children, false);
+			if (err != NSERROR_OK)
+				res = err;
+
+			err = box_index_fill(box->index,
+					&box->index->floats,
+					box->float_children, true);
+			if (err != NSERROR_OK)
+				res = err;
+
+			if (box->index->children.count == 0 &&
+			    box->index->floats.count == 0) {
+				/* nothing worth indexing */
+				talloc_free(box->index);
+				box->index = NULL;
+			}
+		} else {
+			res = NSERROR_NOMEM;
+		}
+	} else if (box->index != NULL) {
+		talloc_free(box->index);
+		box->index = NULL;
+	}
+
+	/* carry on after failure so no index is left stale; boxes
+	 * without an index simply have all their children considered
+	 */
+	for (child = box->children; child != NULL; child = child->next) {
+		err = box_index_build(child);
+		if (err != NSERROR_OK)
+			res = err;
+	}
+
+	return res;
+}
+
+
+/* exported function documented in html/box_index.h */
+bool box_index_find(const struct box *box, bool floats, int y0, int y1,
+		struct box **first, struct box **end)
+{
+	const struct box_index_list *list;
+	unsigned int lo, hi, mid;
+	unsigned int start;
+
+	if (box->index == NULL)
+		return false;
+
+	list = floats ? &box->index->floats : &box->index->children;
+	if (list->count == 0)
+		return false;
+
+	/* first entry which, or an earlier one, reaches down to y0 */
+	lo = 0;
+	hi = list->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (list->entry[mid].y1_max < y0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	start = lo;
+
+	/* first entry which, and all later ones, start below y1 */
+	hi = list->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (list->entry[mid].y0_min <= y1)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	if (start == lo) {
+		*first = NULL;
+		*end = NULL;
+	} else {
+		*first = list->entry[start].box;
+		*end = (lo < list->count) ? list->entry[lo].box : NULL;
+	}
+
+	return true;
+}
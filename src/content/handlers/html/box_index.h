@@ -0,0 +1,68 @@
+/*
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Spatial index over the children of laid out boxes interface.
+ *
+ * Boxes with many children get an index over their children's
+ * vertical extents so redraw and hit testing can go straight to the
+ * children overlapping the area of interest instead of testing every
+ * child in turn.
+ */
+
+#ifndef NETSURF_HTML_BOX_INDEX_H
+#define NETSURF_HTML_BOX_INDEX_H
+
+struct box;
+
+/**
+ * Build the spatial indexes of a laid out box tree.
+ *
+ * Must be called after the descendant bounding boxes of the tree are
+ * calculated. Indexes from a previous layout are reused or released.
+ *
+ * On memory exhaustion the boxes which could not be indexed are left
+ * without an index, which is still correct, merely slower.
+ *
+ * \param box  root of the box tree
+ * \return NSERROR_OK on success or NSERROR_NOMEM on memory exhaustion
+ */
+nserror box_index_build(struct box *box);
+
+
+/**
+ * Find the children of a box which may overlap a vertical range.
+ *
+ * The children are returned as a span of the box's children, or
+ * float children, list in document order. Children outside the span
+ * do not overlap the range; those inside it may or may not.
+ *
+ * \param box     box whose children to search
+ * \param floats  search the float children rather than the children
+ * \param y0      top of range, relative to the box's children
+ * \param y1      bottom of range, inclusive
+ * \param first   updated to the first child in the span, or NULL if empty
+ * \param end     updated to the child after the span, or NULL for the
+ *                end of the list
+ * \return true if the span is set, false if the box is not indexed and
+ *         every child must be considered
+ */
+bool box_index_find(const struct box *box, bool floats, int y0, int y1,
+		struct box **first, struct box **end);
+
+
+#endif
@@ -37,6 +37,7 @@
 #include <neosurf/content/handlers/html/private.h>
 #include <neosurf/content/handlers/html/box.h>
 #include <neosurf/content/handlers/html/box_inspect.h>
+#include "content/handlers/html/box_index.h"
 
 /**
  * Direction to move in a box-tree walk
@@ -267,19 +268,78 @@ box_move_xy(struct box *b, enum box_walk_dir dir, int *x, int *y)
 }
 
 
+/**
+ * Move from box to the first of its children which may contain a point
+ *
+ * \param b       box to move from
+ * \param floats  move to the float children rather than the children
+ * \param x       box's global x-coord, updated to position of child
+ * \param y       box's global y-coord, updated to position of child
+ * \param py      global y-coord of point
+ *
+ * Children before the span the box's index gives for the point are
+ * passed over. If no box can be found, NULL is returned.
+ */
+static inline struct box *
+box_move_xy_first(struct box *b, bool floats, int *x, int *y, int py)
+{
+	struct box *first;
+	struct box *end;
+
+	if (!box_index_find(b, floats, py - *y, py - *y, &first, &end)) {
+		return box_move_xy(b, floats ? BOX_WALK_FLOAT_CHILDREN :
+				BOX_WALK_CHILDREN, x, y);
+	}
+
+	if (first != NULL) {
+		*x += first->x;
+		*y += first->y;
+	}
+
+	return first;
+}
+
+
+/**
+ * Test whether a sibling is past those which may contain a point
+ *
+ * \param container  box whose children, or float children, are walked
+ * \param floats     walking the float children rather than the children
+ * \param n          sibling walked to
+ * \param y          global y-coord of the container's children
+ * \param py         global y-coord of point
+ * \return true if neither n nor any later sibling can contain the point
+ */
+static inline bool
+box_past_xy(const struct box *container, bool floats,
+		const struct box *n, int y, int py)
+{
+	struct box *first;
+	struct box *end;
+
+	if (container == NULL ||
+	    !box_index_find(container, floats, py - y, py - y, &first, &end))
+		return false;
+
+	return end != NULL && n == end;
+}
+
+
 /**
  * Itterator for walking to next box in interaction order
  *
  * \param b	box to find next box from
  * \param x	box's global x-coord, updated to position of next box
  * \param y	box's global y-coord, updated to position of next box
+ * \param py	global y-coord of the point of interest
  * \param skip_children	whether to skip box's children
  *
  * This walks to a boxes float children before its children.  When walking
- * children, floating boxes are skipped.
+ * children, floating boxes are skipped. Children which the spatial index
+ * shows cannot contain the point of interest are skipped too.
  */
 static inline struct box *
-box_next_xy(struct box *b, int *x, int *y, bool skip_children)
+box_next_xy(struct box *b, int *x, int *y, int py, bool skip_children)
 {
 	struct box *n;
 	int tx, ty;
@@ -292,7 +352,7 @@ box_next_xy(struct box *b, int *x, int *y, bool skip_children)
 	}
 
 	tx = *x; ty = *y;
-	n = box_move_xy(b, BOX_WALK_FLOAT_CHILDREN, &tx, &ty);
+	n = box_move_xy_first(b, true, &tx, &ty, py);
 	if (n) {
 		/* Next node is float child */
 		*x = tx;
@@ -302,7 +362,7 @@ box_next_xy(struct box *b, int *x, int *y, bool skip_children)
  done_float_children:
 
 	tx = *x; ty = *y;
-	n = box_move_xy(b, BOX_WALK_CHILDREN, &tx, &ty);
+	n = box_move_xy_first(b, false, &tx, &ty, py);
 	if (n) {
 		/* Next node is child */
 		*x = tx;
@@ -313,6 +373,10 @@ box_next_xy(struct box *b, int *x, int *y, bool skip_children)
  skip_children:
 	tx = *x; ty = *y;
 	n = box_move_xy(b, BOX_WALK_NEXT_FLOAT_SIBLING, &tx, &ty);
+	if (n && box_past_xy(b->float_container, true, n, *y - b->y, py)) {
+		/* Later float siblings can't contain the point */
+		n = NULL;
+	}
 	if (n) {
 		/* Go to next float sibling */
 		*x = tx;
@@ -345,6 +409,10 @@ box_next_xy(struct box *b, int *x, int *y, bool skip_children)
 
 		tx = *x; ty = *y;
 		n = box_move_xy(b, BOX_WALK_NEXT_SIBLING, &tx, &ty);
+		if (n && box_past_xy(b->parent, false, n, *y - b->y, py)) {
+			/* Later siblings can't contain the point */
+			n = NULL;
+		}
 		if (n) {
 			/* Go to non-float (ancestor) sibling */
 			*x = tx;
@@ -590,7 +658,7 @@ box_at_point(const css_unit_ctx *unit_len_ctx,
 	assert(box);
 
 	skip_children = false;
-	while ((box = box_next_xy(box, box_x, box_y, skip_children))) {
+	while ((box = box_next_xy(box, box_x, box_y, y, skip_children))) {
 		if (box_contains_point(unit_len_ctx, box, x - *box_x, y - *box_y,
 				       &physically)) {
 			*box_x -= scrollbar_get_offset(box->scroll_x);
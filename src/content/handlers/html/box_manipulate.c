@@ -109,7 +109,7 @@ box_create(css_select_results *styles,
 	talloc_set_destructor(box, box_talloc_destructor);
 
 	box->type = BOX_INLINE;
-	box->flags = 0;
+	box->flags = NEED_LAYOUT;
 	box->flags = style_owned ? (box->flags | STYLE_OWNED) : box->flags;
 	box->styles = styles;
 	box->style = style;
@@ -142,6 +142,7 @@ box_create(css_select_results *styles,
 	box->float_children = NULL;
 	box->float_container = NULL;
 	box->next_float = NULL;
+	box->index = NULL;
 	box->cached_place_below_level = 0;
 	box->list_value = 1;
 	box->list_marker = NULL;
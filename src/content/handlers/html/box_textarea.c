@@ -36,6 +36,7 @@
 #include <neosurf/content/handlers/html/box.h>
 #include <neosurf/content/handlers/html/box_inspect.h>
 #include "content/handlers/html/box_textarea.h"
+#include "content/handlers/html/display_list.h"
 #include "content/handlers/html/font.h"
 #include <neosurf/content/handlers/html/form_internal.h>
 
@@ -187,6 +188,7 @@ static void box_textarea_callback(void *data, struct textarea_msg *msg)
 	{
 		/* Request redraw of the required textarea rectangle */
 		int x, y;
+		struct rect area;
 
 		if (html->reflowing == true) {
 			/* Can't redraw during layout, and it will
@@ -196,6 +198,12 @@ static void box_textarea_callback(void *data, struct textarea_msg *msg)
 
 		box_coords(box, &x, &y);
 
+		area.x0 = x + msg->data.redraw.x0;
+		area.y0 = y + msg->data.redraw.y0;
+		area.x1 = x + msg->data.redraw.x1;
+		area.y1 = y + msg->data.redraw.y1;
+		html_display_list_invalidate(html, &area);
+
 		content__request_redraw((struct content *)html,
 				x + msg->data.redraw.x0,
 				y + msg->data.redraw.y0,
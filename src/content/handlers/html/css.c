@@ -180,7 +180,7 @@ html_stylesheet_from_domnode(html_content *c,
 		return error;
 	}
 
-	error = hlcache_handle_retrieve(url, 0,
+	error = hlcache_handle_retrieve(url, LLCACHE_RETRIEVE_PRIORITY_HIGH,
 			content_get_url(&c->base), NULL,
 			html_convert_css_callback, c, &child, CONTENT_CSS,
 			sheet);
@@ -465,7 +465,8 @@ bool html_css_process_link(html_content *htmlc, dom_node *node)
 	child.charset = htmlc->encoding;
 	child.quirks = htmlc->base.quirks;
 
-	ns_error = hlcache_handle_retrieve(joined, 0,
+	ns_error = hlcache_handle_retrieve(joined,
+			LLCACHE_RETRIEVE_PRIORITY_HIGH,
 			content_get_url(&htmlc->base),
 			NULL, html_convert_css_callback,
 			htmlc, &child, CONTENT_CSS,
@@ -0,0 +1,1223 @@
+/*
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Retained display list for HTML redraw implementation.
+ *
+ * The document is split into bands, or tiles, spanning its whole
+ * width. A tile is recorded by redrawing it through a plotter table
+ * which appends each plot operation, in document coordinates, to the
+ * tile's array of operations. Variable length operands such as text
+ * and polygon points are copied to a data block owned by the tile.
+ *
+ * Replaying a tile translates the operations to the target position.
+ * Operations following a recorded clip which does not meet the redraw
+ * clip are passed over without reaching the plotters.
+ *
+ * A bounded number of tiles are retained; the least recently used
+ * tile is recycled when another is needed. A tile which can't be
+ * recorded, such as one holding an operation a recording can't
+ * represent, is drawn directly until it is invalidated.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dom/dom.h>
+
+#include <neosurf/utils/errors.h>
+#include <neosurf/utils/log.h>
+#include <neosurf/types.h>
+#include <neosurf/plotters.h>
+#include <neosurf/content.h>
+#include <neosurf/desktop/print.h>
+
+#include <neosurf/content/handlers/html/box.h>
+#include <neosurf/content/handlers/html/private.h>
+#include "content/handlers/html/display_list.h"
+
+/** Height of a display list tile */
+#define HTML_DISPLAY_LIST_TILE_HEIGHT 512
+
+/** Number of tiles retained */
+#define HTML_DISPLAY_LIST_TILES 32
+
+/** Initial number of operations allocated for a tile */
+#define HTML_DISPLAY_LIST_OPS 256
+
+/** Number of polygon points translated without allocation */
+#define HTML_DISPLAY_LIST_POINTS 16
+
+/**
+ * Display list operation type.
+ */
+enum html_display_list_op_type {
+	HTML_DISPLAY_LIST_CLIP,
+	HTML_DISPLAY_LIST_ARC,
+	HTML_DISPLAY_LIST_DISC,
+	HTML_DISPLAY_LIST_LINE,
+	HTML_DISPLAY_LIST_RECTANGLE,
+	HTML_DISPLAY_LIST_POLYGON,
+	HTML_DISPLAY_LIST_PATH,
+	HTML_DISPLAY_LIST_TEXT,
+	HTML_DISPLAY_LIST_GROUP_START,
+	HTML_DISPLAY_LIST_GROUP_END,
+	HTML_DISPLAY_LIST_CONTENT, /**< content redraw made on replay */
+	HTML_DISPLAY_LIST_BOX, /**< replaced box redraw made on replay */
+};
+
+/**
+ * Recorded plot operation.
+ *
+ * Offsets are into the data block of the tile holding the operation.
+ */
+struct html_display_list_op {
+	enum html_display_list_op_type type;
+	union {
+		struct rect clip;
+		struct {
+			plot_style_t style;
+			int x, y, radius;
+			int angle1, angle2;
+		} arc; /**< arc and disc */
+		struct {
+			plot_style_t style;
+			struct rect rect;
+		} rect; /**< line and rectangle */
+		struct {
+			plot_style_t style;
+			size_t points;
+			unsigned int n;
+			float transform[6];
+		} path; /**< path and polygon, which has no transform */
+		struct {
+			plot_font_style_t fstyle;
+			int x, y;
+			size_t text;
+			size_t length;
+		} text;
+		struct {
+			size_t name;
+		} group;
+		struct {
+			struct hlcache_handle *h;
+			struct content_redraw_data data;
+			struct rect clip;
+		} content;
+		struct {
+			struct box *box;
+			dom_html_element_type tag_type;
+			int x, y, width, height;
+			struct rect clip;
+			colour background;
+		} box;
+	} u;
+};
+
+/**
+ * Display list tile state.
+ */
+enum html_display_list_tile_state {
+	HTML_DISPLAY_LIST_TILE_EMPTY, /**< not in use */
+	HTML_DISPLAY_LIST_TILE_RECORDING, /**< being recorded */
+	HTML_DISPLAY_LIST_TILE_RECORDED, /**< recorded and valid */
+	HTML_DISPLAY_LIST_TILE_DIRECT, /**< must be drawn directly */
+};
+
+/**
+ * Display list tile.
+ */
+struct html_display_list_tile {
+	enum html_display_list_tile_state state;
+	bool invalid; /**< invalidated while being recorded */
+	int band; /**< covers band * tile height to the next band */
+	unsigned int used; /**< stamp of the redraw which last used it */
+
+	unsigned int count; /**< number of operations */
+	unsigned int alloc; /**< number of operations allocated */
+	struct html_display_list_op *op; /**< operations */
+
+	size_t data_used; /**< bytes of data block used */
+	size_t data_alloc; /**< bytes of data block allocated */
+	char *data; /**< operand data block */
+};
+
+/**
+ * Display list of a HTML content.
+ *
+ * The recordings are only valid for the redraw parameters they were
+ * made with; a change discards all of them.
+ */
+struct html_display_list {
+	const struct box *layout; /**< box tree recorded */
+	bool interactive; /**< recorded for interactive redraw */
+	bool background_images; /**< recorded with background images */
+	bool groups; /**< recorded with group operations */
+	bool debug; /**< recorded with debug outlines */
+	colour background; /**< document background colour */
+
+	int x0; /**< left edge of tiles */
+	int x1; /**< right edge of tiles */
+
+	unsigned int stamp; /**< redraw counter */
+
+	struct html_display_list_tile tile[HTML_DISPLAY_LIST_TILES];
+};
+
+
+/**
+ * Add an operation to the tile being recorded.
+ *
+ * \param ctx   recording redraw context
+ * \param type  type of operation
+ * \return the operation or NULL on memory exhaustion
+ */
+static struct html_display_list_op *
+html_display_list_op(const struct redraw_context *ctx,
+		enum html_display_list_op_type type)
+{
+	struct html_display_list_tile *tile = ctx->priv;
+	struct html_display_list_op *op;
+
+	if (tile->count == tile->alloc) {
+		unsigned int alloc = tile->alloc ? tile->alloc * 2 :
+				HTML_DISPLAY_LIST_OPS;
+
+		op = realloc(tile->op, alloc * sizeof(*op));
+		if (op == NULL) {
+			return NULL;
+		}
+		tile->op = op;
+		tile->alloc = alloc;
+	}
+
+	op = &tile->op[tile->count++];
+	op->type = type;
+
+	return op;
+}
+
+
+/**
+ * Copy operand data to the data block of the tile being recorded.
+ *
+ * \param ctx     recording redraw context
+ * \param src     data to copy
+ * \param len     length of data
+ * \param offset  updated to offset of the copy in the data block
+ * \return NSERROR_OK on success or NSERROR_NOMEM on memory exhaustion
+ */
+static nserror
+html_display_list_data(const struct redraw_context *ctx,
+		const void *src, size_t len, size_t *offset)
+{
+	struct html_display_list_tile *tile = ctx->priv;
+	size_t start;
+
+	/* keep polygon and path points aligned */
+	start = (tile->data_used + 7) & ~(size_t)7;
+
+	if (start + len > tile->data_alloc) {
+		size_t alloc = tile->data_alloc ? tile->data_alloc : 4096;
+		char *data;
+
+		while (start + len > alloc) {
+			alloc *= 2;
+		}
+
+		data = realloc(tile->data, alloc);
+		if (data == NULL) {
+			return NSERROR_NOMEM;
+		}
+		tile->data = data;
+		tile->data_alloc = alloc;
+	}
+
+	if (len > 0) {
+		memcpy(tile->data + start, src, len);
+	}
+	tile->data_used = start + len;
+	*offset = start;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a clip operation.
+ *
+ * \param ctx   recording redraw context
+ * \param clip  clip rectangle
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_clip(const struct redraw_context *ctx,
+		const struct rect *clip)
+{
+	struct html_display_list_op *op;
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_CLIP);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.clip = *clip;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record an arc operation.
+ *
+ * \param ctx     recording redraw context
+ * \param pstyle  style of the arc
+ * \param x       x coordinate of the arc
+ * \param y       y coordinate of the arc
+ * \param radius  radius of the arc
+ * \param angle1  start angle of the arc
+ * \param angle2  finish angle of the arc
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_arc(const struct redraw_context *ctx,
+		const plot_style_t *pstyle,
+		int x, int y, int radius, int angle1, int angle2)
+{
+	struct html_display_list_op *op;
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_ARC);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.arc.style = *pstyle;
+	op->u.arc.x = x;
+	op->u.arc.y = y;
+	op->u.arc.radius = radius;
+	op->u.arc.angle1 = angle1;
+	op->u.arc.angle2 = angle2;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a disc operation.
+ *
+ * \param ctx     recording redraw context
+ * \param pstyle  style of the disc
+ * \param x       x coordinate of the centre
+ * \param y       y coordinate of the centre
+ * \param radius  radius of the disc
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_disc(const struct redraw_context *ctx,
+		const plot_style_t *pstyle,
+		int x, int y, int radius)
+{
+	struct html_display_list_op *op;
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_DISC);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.arc.style = *pstyle;
+	op->u.arc.x = x;
+	op->u.arc.y = y;
+	op->u.arc.radius = radius;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a line operation.
+ *
+ * \param ctx     recording redraw context
+ * \param pstyle  style of the line
+ * \param line    end points of the line
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_line(const struct redraw_context *ctx,
+		const plot_style_t *pstyle,
+		const struct rect *line)
+{
+	struct html_display_list_op *op;
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_LINE);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.rect.style = *pstyle;
+	op->u.rect.rect = *line;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a rectangle operation.
+ *
+ * \param ctx        recording redraw context
+ * \param pstyle     style of the rectangle
+ * \param rectangle  the rectangle
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_rectangle(const struct redraw_context *ctx,
+		const plot_style_t *pstyle,
+		const struct rect *rectangle)
+{
+	struct html_display_list_op *op;
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_RECTANGLE);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.rect.style = *pstyle;
+	op->u.rect.rect = *rectangle;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a polygon operation.
+ *
+ * \param ctx     recording redraw context
+ * \param pstyle  style of the polygon
+ * \param p       vertices of the polygon
+ * \param n       number of vertices
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_polygon(const struct redraw_context *ctx,
+		const plot_style_t *pstyle,
+		const int *p,
+		unsigned int n)
+{
+	struct html_display_list_op *op;
+	size_t points;
+	nserror res;
+
+	res = html_display_list_data(ctx, p, n * 2 * sizeof(int), &points);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_POLYGON);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.path.style = *pstyle;
+	op->u.path.points = points;
+	op->u.path.n = n;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a path operation.
+ *
+ * \param ctx        recording redraw context
+ * \param pstyle     style of the path
+ * \param p          elements of the path
+ * \param n          number of elements
+ * \param transform  transform to apply to the path
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_path(const struct redraw_context *ctx,
+		const plot_style_t *pstyle,
+		const float *p,
+		unsigned int n,
+		const float transform[6])
+{
+	struct html_display_list_op *op;
+	size_t points;
+	nserror res;
+
+	res = html_display_list_data(ctx, p, n * sizeof(float), &points);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_PATH);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.path.style = *pstyle;
+	op->u.path.points = points;
+	op->u.path.n = n;
+	memcpy(op->u.path.transform, transform, sizeof(op->u.path.transform));
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Refuse to record a bitmap operation.
+ *
+ * Bitmaps are only plotted directly for canvases, which are recorded
+ * as replaced boxes, and by contents, which are recorded as content
+ * redraws. A bitmap reaching the plotters would be held by the
+ * recording beyond the lifetime its owner guarantees, so the tile is
+ * drawn directly instead.
+ *
+ * \return NSERROR_NOT_IMPLEMENTED
+ */
+static nserror
+html_display_list_plot_bitmap(const struct redraw_context *ctx,
+		struct bitmap *bitmap,
+		int x, int y, int width, int height,
+		colour bg,
+		bitmap_flags_t flags)
+{
+	return NSERROR_NOT_IMPLEMENTED;
+}
+
+
+/**
+ * Record a text operation.
+ *
+ * \param ctx     recording redraw context
+ * \param fstyle  style of the text
+ * \param x       x coordinate of the text
+ * \param y       y coordinate of the text
+ * \param text    UTF-8 text to plot
+ * \param length  length of text, in bytes
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_text(const struct redraw_context *ctx,
+		const plot_font_style_t *fstyle,
+		int x, int y,
+		const char *text,
+		size_t length)
+{
+	struct html_display_list_op *op;
+	size_t offset;
+	nserror res;
+
+	res = html_display_list_data(ctx, text, length, &offset);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_TEXT);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.text.fstyle = *fstyle;
+	op->u.text.x = x;
+	op->u.text.y = y;
+	op->u.text.text = offset;
+	op->u.text.length = length;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record the start of a group.
+ *
+ * \param ctx   recording redraw context
+ * \param name  name of the group
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_group_start(const struct redraw_context *ctx,
+		const char *name)
+{
+	struct html_display_list_op *op;
+	size_t offset;
+	nserror res;
+
+	res = html_display_list_data(ctx, name, strlen(name) + 1, &offset);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_GROUP_START);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.group.name = offset;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record the end of a group.
+ *
+ * \param ctx  recording redraw context
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_plot_group_end(const struct redraw_context *ctx)
+{
+	if (html_display_list_op(ctx, HTML_DISPLAY_LIST_GROUP_END) == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	return NSERROR_OK;
+}
+
+
+/** Recording plotters, for targets without groups */
+static const struct plotter_table html_display_list_plotters = {
+	.clip = html_display_list_plot_clip,
+	.arc = html_display_list_plot_arc,
+	.disc = html_display_list_plot_disc,
+	.line = html_display_list_plot_line,
+	.rectangle = html_display_list_plot_rectangle,
+	.polygon = html_display_list_plot_polygon,
+	.path = html_display_list_plot_path,
+	.bitmap = html_display_list_plot_bitmap,
+	.text = html_display_list_plot_text,
+	.group_start = NULL,
+	.group_end = NULL,
+	.flush = NULL,
+	.option_knockout = false,
+};
+
+/** Recording plotters, for targets with groups */
+static const struct plotter_table html_display_list_group_plotters = {
+	.clip = html_display_list_plot_clip,
+	.arc = html_display_list_plot_arc,
+	.disc = html_display_list_plot_disc,
+	.line = html_display_list_plot_line,
+	.rectangle = html_display_list_plot_rectangle,
+	.polygon = html_display_list_plot_polygon,
+	.path = html_display_list_plot_path,
+	.bitmap = html_display_list_plot_bitmap,
+	.text = html_display_list_plot_text,
+	.group_start = html_display_list_plot_group_start,
+	.group_end = html_display_list_plot_group_end,
+	.flush = NULL,
+	.option_knockout = false,
+};
+
+
+/**
+ * Translate a rectangle and intersect it with a clip rectangle.
+ *
+ * \param r     rectangle to translate
+ * \param dx    horizontal translation
+ * \param dy    vertical translation
+ * \param clip  clip rectangle
+ * \param out   updated to the translated and clipped rectangle
+ * \return true if the result is not empty
+ */
+static inline bool
+html_display_list_clip_rect(const struct rect *r, int dx, int dy,
+		const struct rect *clip, struct rect *out)
+{
+	out->x0 = r->x0 + dx;
+	out->y0 = r->y0 + dy;
+	out->x1 = r->x1 + dx;
+	out->y1 = r->y1 + dy;
+
+	if (out->x0 < clip->x0) out->x0 = clip->x0;
+	if (out->y0 < clip->y0) out->y0 = clip->y0;
+	if (out->x1 > clip->x1) out->x1 = clip->x1;
+	if (out->y1 > clip->y1) out->y1 = clip->y1;
+
+	return (out->x0 < out->x1 && out->y0 < out->y1);
+}
+
+
+/**
+ * Plot a recorded polygon at an offset.
+ *
+ * \param op   polygon operation
+ * \param p    recorded vertices
+ * \param dx   horizontal translation
+ * \param dy   vertical translation
+ * \param ctx  current redraw context
+ * \return NSERROR_OK on success else error code
+ */
+static nserror
+html_display_list_replay_polygon(const struct html_display_list_op *op,
+		const int *p, int dx, int dy,
+		const struct redraw_context *ctx)
+{
+	int points[HTML_DISPLAY_LIST_POINTS * 2];
+	int *q = points;
+	unsigned int i;
+	nserror res;
+
+	if (op->u.path.n > HTML_DISPLAY_LIST_POINTS) {
+		q = malloc(op->u.path.n * 2 * sizeof(int));
+		if (q == NULL) {
+			return NSERROR_NOMEM;
+		}
+	}
+
+	for (i = 0; i != op->u.path.n; i++) {
+		q[i * 2] = p[i * 2] + dx;
+		q[i * 2 + 1] = p[i * 2 + 1] + dy;
+	}
+
+	res = ctx->plot->polygon(ctx, &op->u.path.style, q, op->u.path.n);
+
+	if (q != points) {
+		free(q);
+	}
+
+	return res;
+}
+
+
+/**
+ * Replay a recorded tile.
+ *
+ * \param tile  tile to replay
+ * \param dx    horizontal offset of the document in the target
+ * \param dy    vertical offset of the document in the target
+ * \param clip  clip rectangle, within the tile, in target coordinates
+ * \param ctx   current redraw context
+ * \return true if successful, false otherwise
+ */
+static bool
+html_display_list_replay(const struct html_display_list_tile *tile,
+		int dx, int dy,
+		const struct rect *clip,
+		const struct redraw_context *ctx)
+{
+	const struct html_display_list_op *op = tile->op;
+	const struct html_display_list_op *end = tile->op + tile->count;
+	struct rect current = *clip;
+	bool hidden = false;
+	nserror res = NSERROR_OK;
+	struct rect r;
+
+	for (; op != end && res == NSERROR_OK; op++) {
+		switch (op->type) {
+		case HTML_DISPLAY_LIST_CLIP:
+			hidden = !html_display_list_clip_rect(&op->u.clip,
+					dx, dy, clip, &current);
+			if (!hidden) {
+				res = ctx->plot->clip(ctx, &current);
+			}
+			continue;
+
+		case HTML_DISPLAY_LIST_GROUP_START:
+			if (ctx->plot->group_start != NULL) {
+				res = ctx->plot->group_start(ctx,
+						tile->data + op->u.group.name);
+			}
+			continue;
+
+		case HTML_DISPLAY_LIST_GROUP_END:
+			if (ctx->plot->group_end != NULL) {
+				res = ctx->plot->group_end(ctx);
+			}
+			continue;
+
+		case HTML_DISPLAY_LIST_CONTENT:
+			if (hidden || !html_display_list_clip_rect(
+					&op->u.content.clip, dx, dy, clip, &r))
+				continue;
+			{
+				struct content_redraw_data data;
+
+				data = op->u.content.data;
+				data.x += dx;
+				data.y += dy;
+				/* We just continue if redraw fails */
+				content_redraw(op->u.content.h, &data, &r, ctx);
+			}
+			/* restore the clip the recording continued with */
+			res = ctx->plot->clip(ctx, &current);
+			continue;
+
+		case HTML_DISPLAY_LIST_BOX:
+			if (hidden || !html_display_list_clip_rect(
+					&op->u.box.clip, dx, dy, clip, &r))
+				continue;
+			if (!html_redraw_replaced(op->u.box.box,
+					op->u.box.tag_type,
+					op->u.box.x + dx, op->u.box.y + dy,
+					op->u.box.width, op->u.box.height,
+					&r, 1.0, op->u.box.background, ctx)) {
+				return false;
+			}
+			res = ctx->plot->clip(ctx, &current);
+			continue;
+
+		default:
+			break;
+		}
+
+		if (hidden) {
+			/* nothing drawn until the next clip */
+			continue;
+		}
+
+		switch (op->type) {
+		case HTML_DISPLAY_LIST_ARC:
+			res = ctx->plot->arc(ctx, &op->u.arc.style,
+					op->u.arc.x + dx, op->u.arc.y + dy,
+					op->u.arc.radius,
+					op->u.arc.angle1, op->u.arc.angle2);
+			break;
+
+		case HTML_DISPLAY_LIST_DISC:
+			res = ctx->plot->disc(ctx, &op->u.arc.style,
+					op->u.arc.x + dx, op->u.arc.y + dy,
+					op->u.arc.radius);
+			break;
+
+		case HTML_DISPLAY_LIST_LINE:
+		case HTML_DISPLAY_LIST_RECTANGLE:
+			r.x0 = op->u.rect.rect.x0 + dx;
+			r.y0 = op->u.rect.rect.y0 + dy;
+			r.x1 = op->u.rect.rect.x1 + dx;
+			r.y1 = op->u.rect.rect.y1 + dy;
+			if (op->type == HTML_DISPLAY_LIST_LINE) {
+				res = ctx->plot->line(ctx,
+						&op->u.rect.style, &r);
+			} else {
+				res = ctx->plot->rectangle(ctx,
+						&op->u.rect.style, &r);
+			}
+			break;
+
+		case HTML_DISPLAY_LIST_POLYGON:
+			res = html_display_list_replay_polygon(op,
+					(const int *)(tile->data +
+						      op->u.path.points),
+					dx, dy, ctx);
+			break;
+
+		case HTML_DISPLAY_LIST_PATH:
+		{
+			float transform[6];
+
+			memcpy(transform, op->u.path.transform,
+					sizeof(transform));
+			transform[4] += dx;
+			transform[5] += dy;
+			res = ctx->plot->path(ctx, &op->u.path.style,
+					(const float *)(tile->data +
+							op->u.path.points),
+					op->u.path.n, transform);
+		}
+			break;
+
+		case HTML_DISPLAY_LIST_TEXT:
+			res = ctx->plot->text(ctx, &op->u.text.fstyle,
+					op->u.text.x + dx, op->u.text.y + dy,
+					tile->data + op->u.text.text,
+					op->u.text.length);
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	return (res == NSERROR_OK);
+}
+
+
+/**
+ * Discard a tile's recording, keeping its allocations for reuse.
+ *
+ * \param tile  tile to discard
+ */
+static inline void html_display_list_tile_reset(struct html_display_list_tile *tile)
+{
+	if (tile->state == HTML_DISPLAY_LIST_TILE_RECORDING) {
+		/* discarded once recording is complete */
+		tile->invalid = true;
+		return;
+	}
+
+	tile->state = HTML_DISPLAY_LIST_TILE_EMPTY;
+	tile->count = 0;
+	tile->data_used = 0;
+}
+
+
+/**
+ * Get the display list of a content for a redraw.
+ *
+ * The display list is created if needed and emptied if it was
+ * recorded for different redraw parameters.
+ *
+ * \param html        content to get display list of
+ * \param background  document background colour
+ * \param ctx         current redraw context
+ * \return the display list or NULL on memory exhaustion
+ */
+static struct html_display_list *
+html_display_list_get(struct html_content *html,
+		colour background,
+		const struct redraw_context *ctx)
+{
+	struct html_display_list *dl = html->display_list;
+	bool groups = (ctx->plot->group_start != NULL ||
+			ctx->plot->group_end != NULL);
+	unsigned int i;
+
+	if (dl == NULL) {
+		dl = calloc(1, sizeof(*dl));
+		if (dl == NULL) {
+			return NULL;
+		}
+		html->display_list = dl;
+	} else if (dl->layout == html->layout &&
+			dl->interactive == ctx->interactive &&
+			dl->background_images == ctx->background_images &&
+			dl->groups == groups &&
+			dl->debug == html_redraw_debug &&
+			dl->background == background) {
+		return dl;
+	}
+
+	for (i = 0; i != HTML_DISPLAY_LIST_TILES; i++) {
+		html_display_list_tile_reset(&dl->tile[i]);
+	}
+
+	dl->layout = html->layout;
+	dl->interactive = ctx->interactive;
+	dl->background_images = ctx->background_images;
+	dl->groups = groups;
+	dl->debug = html_redraw_debug;
+	dl->background = background;
+	dl->x0 = 0;
+	dl->x1 = 0;
+
+	return dl;
+}
+
+
+/**
+ * Get the tile covering a band, recording it if necessary.
+ *
+ * \param html        content being redrawn
+ * \param dl          content's display list
+ * \param band        band to get tile for
+ * \param background  document background colour
+ * \param ctx         current redraw context
+ * \return the tile, which may need drawing directly, or NULL if the
+ *         band could not be recorded
+ */
+static struct html_display_list_tile *
+html_display_list_tile(struct html_content *html,
+		struct html_display_list *dl,
+		int band,
+		colour background,
+		const struct redraw_context *ctx)
+{
+	struct html_display_list_tile *tile = NULL;
+	struct redraw_context rec_ctx;
+	struct rect area;
+	unsigned int i;
+	bool ok;
+
+	for (i = 0; i != HTML_DISPLAY_LIST_TILES; i++) {
+		struct html_display_list_tile *t = &dl->tile[i];
+
+		if (t->state != HTML_DISPLAY_LIST_TILE_EMPTY &&
+		    t->band == band) {
+			t->used = dl->stamp;
+			return t;
+		}
+
+		/* prefer an empty tile, else the least recently used */
+		if (tile == NULL ||
+		    (tile->state != HTML_DISPLAY_LIST_TILE_EMPTY &&
+		     (t->state == HTML_DISPLAY_LIST_TILE_EMPTY ||
+		      t->used < tile->used))) {
+			tile = t;
+		}
+	}
+
+	if (tile->used == dl->stamp &&
+	    tile->state != HTML_DISPLAY_LIST_TILE_EMPTY) {
+		/* every tile is in use by this redraw */
+		return NULL;
+	}
+
+	html_display_list_tile_reset(tile);
+	tile->state = HTML_DISPLAY_LIST_TILE_RECORDING;
+	tile->invalid = false;
+	tile->band = band;
+	tile->used = dl->stamp;
+
+	area.x0 = dl->x0;
+	area.y0 = band * HTML_DISPLAY_LIST_TILE_HEIGHT;
+	area.x1 = dl->x1;
+	area.y1 = area.y0 + HTML_DISPLAY_LIST_TILE_HEIGHT;
+
+	rec_ctx.interactive = ctx->interactive;
+	rec_ctx.background_images = ctx->background_images;
+	rec_ctx.plot = dl->groups ? &html_display_list_group_plotters :
+			&html_display_list_plotters;
+	rec_ctx.priv = tile;
+
+	ok = (rec_ctx.plot->clip(&rec_ctx, &area) == NSERROR_OK);
+	ok = ok && html_redraw_box(html, html->layout, 0, 0, &area, 1.0,
+			background, &rec_ctx);
+
+	if (tile->invalid) {
+		/* changed while recording; record again next time */
+		tile->state = HTML_DISPLAY_LIST_TILE_EMPTY;
+		html_display_list_tile_reset(tile);
+		return NULL;
+	}
+
+	if (!ok) {
+		NSLOG(neosurf, DEBUG, "drawing band %d of %p directly",
+				band, html);
+		tile->state = HTML_DISPLAY_LIST_TILE_DIRECT;
+		tile->count = 0;
+		tile->data_used = 0;
+		return tile;
+	}
+
+	tile->state = HTML_DISPLAY_LIST_TILE_RECORDED;
+
+	return tile;
+}
+
+
+/**
+ * Round down a division by the tile height.
+ *
+ * \param y  coordinate to divide
+ * \return the band containing y
+ */
+static inline int html_display_list_band(int y)
+{
+	if (y < 0) {
+		return -((-y + HTML_DISPLAY_LIST_TILE_HEIGHT - 1) /
+				HTML_DISPLAY_LIST_TILE_HEIGHT);
+	}
+	return y / HTML_DISPLAY_LIST_TILE_HEIGHT;
+}
+
+
+/* exported function documented in html/display_list.h */
+bool html_display_list_redraw(struct html_content *html,
+		const struct content_redraw_data *data,
+		const struct rect *clip,
+		colour background,
+		const struct redraw_context *ctx,
+		bool *result)
+{
+	struct html_display_list *dl;
+	struct html_display_list_tile *tile;
+	struct rect area;
+	struct rect r;
+	int band, band1;
+	int x0, x1;
+	bool ok;
+
+	/* scaled and printed redraws are not recorded */
+	if (data->scale != 1.0 || html_redraw_printing ||
+	    html->reflowing || html->layout == NULL) {
+		return false;
+	}
+
+	if (clip->x0 >= clip->x1 || clip->y0 >= clip->y1) {
+		return false;
+	}
+
+	dl = html_display_list_get(html, background, ctx);
+	if (dl == NULL) {
+		return false;
+	}
+
+	/* tiles span the document's width and any area beyond it that
+	 * has been drawn; reaching further starts a wider recording */
+	x0 = clip->x0 - data->x;
+	x1 = clip->x1 - data->x;
+	if (dl->x0 == dl->x1 || x0 < dl->x0 || x1 > dl->x1) {
+		unsigned int i;
+
+		if (x0 > html->layout->x + html->layout->descendant_x0)
+			x0 = html->layout->x + html->layout->descendant_x0;
+		if (x0 > 0)
+			x0 = 0;
+		if (x1 < html->base.width)
+			x1 = html->base.width;
+		if (dl->x0 != dl->x1) {
+			if (x0 > dl->x0)
+				x0 = dl->x0;
+			if (x1 < dl->x1)
+				x1 = dl->x1;
+		}
+
+		for (i = 0; i != HTML_DISPLAY_LIST_TILES; i++) {
+			html_display_list_tile_reset(&dl->tile[i]);
+		}
+		dl->x0 = x0;
+		dl->x1 = x1;
+	}
+
+	dl->stamp++;
+
+	band = html_display_list_band(clip->y0 - data->y);
+	band1 = html_display_list_band(clip->y1 - 1 - data->y);
+
+	for (; band <= band1; band++) {
+		area.x0 = dl->x0 + data->x;
+		area.y0 = band * HTML_DISPLAY_LIST_TILE_HEIGHT + data->y;
+		area.x1 = dl->x1 + data->x;
+		area.y1 = area.y0 + HTML_DISPLAY_LIST_TILE_HEIGHT;
+
+		if (!html_display_list_clip_rect(&area, 0, 0, clip, &r)) {
+			continue;
+		}
+
+		tile = html_display_list_tile(html, dl, band, background, ctx);
+
+		if (tile != NULL &&
+		    tile->state == HTML_DISPLAY_LIST_TILE_RECORDED) {
+			ok = html_display_list_replay(tile,
+					data->x, data->y, &r, ctx);
+		} else {
+			ok = (ctx->plot->clip(ctx, &r) == NSERROR_OK);
+			ok = ok && html_redraw_box(html, html->layout,
+					data->x, data->y, &r, 1.0,
+					background, ctx);
+		}
+
+		*result &= ok;
+	}
+
+	*result &= (ctx->plot->clip(ctx, clip) == NSERROR_OK);
+
+	return true;
+}
+
+
+/* exported function documented in html/display_list.h */
+bool html_display_list_recording(const struct redraw_context *ctx)
+{
+	return (ctx->plot == &html_display_list_plotters ||
+		ctx->plot == &html_display_list_group_plotters);
+}
+
+
+/* exported function documented in html/display_list.h */
+nserror html_display_list_add_content(const struct redraw_context *ctx,
+		struct hlcache_handle *h,
+		const struct content_redraw_data *data,
+		const struct rect *clip)
+{
+	struct html_display_list_op *op;
+
+	assert(html_display_list_recording(ctx));
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_CONTENT);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.content.h = h;
+	op->u.content.data = *data;
+	op->u.content.clip = *clip;
+
+	return NSERROR_OK;
+}
+
+
+/* exported function documented in html/display_list.h */
+nserror html_display_list_add_box(const struct redraw_context *ctx,
+		struct box *box,
+		dom_html_element_type tag_type,
+		int x, int y, int width, int height,
+		const struct rect *clip,
+		colour background)
+{
+	struct html_display_list_op *op;
+
+	assert(html_display_list_recording(ctx));
+
+	op = html_display_list_op(ctx, HTML_DISPLAY_LIST_BOX);
+	if (op == NULL) {
+		return NSERROR_NOMEM;
+	}
+	op->u.box.box = box;
+	op->u.box.tag_type = tag_type;
+	op->u.box.x = x;
+	op->u.box.y = y;
+	op->u.box.width = width;
+	op->u.box.height = height;
+	op->u.box.clip = *clip;
+	op->u.box.background = background;
+
+	return NSERROR_OK;
+}
+
+
+/* exported function documented in html/display_list.h */
+void html_display_list_invalidate(struct html_content *html,
+		const struct rect *area)
+{
+	struct html_display_list *dl = html->display_list;
+	unsigned int i;
+
+	if (dl == NULL) {
+		return;
+	}
+
+	for (i = 0; i != HTML_DISPLAY_LIST_TILES; i++) {
+		struct html_display_list_tile *tile = &dl->tile[i];
+		int y0 = tile->band * HTML_DISPLAY_LIST_TILE_HEIGHT;
+
+		if (tile->state == HTML_DISPLAY_LIST_TILE_EMPTY) {
+			continue;
+		}
+
+		/* whole bands go, so horizontal overflow of the area
+		 * is covered; allow a pixel for rounding vertically */
+		if (area == NULL ||
+		    (area->y0 - 1 < y0 + HTML_DISPLAY_LIST_TILE_HEIGHT &&
+		     y0 < area->y1 + 1)) {
+			html_display_list_tile_reset(tile);
+		}
+	}
+}
+
+
+/* exported function documented in html/display_list.h */
+void html_display_list_destroy(struct html_content *html)
+{
+	struct html_display_list *dl = html->display_list;
+	unsigned int i;
+
+	if (dl == NULL) {
+		return;
+	}
+
+	for (i = 0; i != HTML_DISPLAY_LIST_TILES; i++) {
+		free(dl->tile[i].op);
+		free(dl->tile[i].data);
+	}
+	free(dl);
+
+	html->display_list = NULL;
+}
@@ -0,0 +1,130 @@
+/*
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Retained display list for HTML redraw interface.
+ *
+ * The plot operations a laid out document produces are recorded, a
+ * horizontal band of the document at a time, the first time the band
+ * is drawn. Later redraws of the band replay the recorded operations
+ * instead of walking the box tree again. Objects, iframes and canvases
+ * are recorded as references and drawn live on each replay so their
+ * own updates need not discard the recording.
+ *
+ * Recordings are discarded when the document is reformatted and for
+ * any area the content asks to have redrawn.
+ */
+
+#ifndef NETSURF_HTML_DISPLAY_LIST_H
+#define NETSURF_HTML_DISPLAY_LIST_H
+
+struct box;
+struct rect;
+struct hlcache_handle;
+struct content_redraw_data;
+struct redraw_context;
+struct html_content;
+
+/**
+ * Redraw a HTML content from its display list.
+ *
+ * \param html        content to redraw
+ * \param data        redraw data for this content redraw
+ * \param clip        clip rectangle, in target coordinates
+ * \param background  colour the document background is cleared to
+ * \param ctx         current redraw context
+ * \param result      cleared if the redraw is done and fails
+ * \return true if the redraw was done, false if the content must be
+ *         drawn directly as the redraw can't use a display list
+ */
+bool html_display_list_redraw(struct html_content *html,
+		const struct content_redraw_data *data,
+		const struct rect *clip,
+		colour background,
+		const struct redraw_context *ctx,
+		bool *result);
+
+
+/**
+ * Test whether a redraw is being recorded into a display list.
+ *
+ * Content redraws, and boxes drawn by html_redraw_replaced(), must be
+ * added to the display list with html_display_list_add_content() and
+ * html_display_list_add_box() while recording, rather than drawn.
+ *
+ * \param ctx  current redraw context
+ * \return true if the redraw is being recorded
+ */
+bool html_display_list_recording(const struct redraw_context *ctx);
+
+
+/**
+ * Record a content redraw to be made on replay.
+ *
+ * \param ctx   current redraw context, which must be recording
+ * \param h     content to redraw
+ * \param data  redraw data for the content
+ * \param clip  clip rectangle
+ * \return NSERROR_OK on success or error code on failure
+ */
+nserror html_display_list_add_content(const struct redraw_context *ctx,
+		struct hlcache_handle *h,
+		const struct content_redraw_data *data,
+		const struct rect *clip);
+
+
+/**
+ * Record a replaced box redraw to be made on replay.
+ *
+ * \param ctx         current redraw context, which must be recording
+ * \param box         box to redraw with html_redraw_replaced()
+ * \param tag_type    element type of the box's node
+ * \param x           x coordinate of the box's content edge
+ * \param y           y coordinate of the box's content edge
+ * \param width       width of the box's content
+ * \param height      height of the box's content
+ * \param clip        clip rectangle
+ * \param background  current background colour
+ * \return NSERROR_OK on success or error code on failure
+ */
+nserror html_display_list_add_box(const struct redraw_context *ctx,
+		struct box *box,
+		dom_html_element_type tag_type,
+		int x, int y, int width, int height,
+		const struct rect *clip,
+		colour background);
+
+
+/**
+ * Discard the display list recordings covering an area.
+ *
+ * \param html  content whose display list to invalidate
+ * \param area  area to invalidate, in document coordinates, or NULL to
+ *              discard the whole display list
+ */
+void html_display_list_invalidate(struct html_content *html,
+		const struct rect *area);
+
+
+/**
+ * Destroy a HTML content's display list.
+ *
+ * \param html  content whose display list to destroy
+ */
+void html_display_list_destroy(struct html_content *html);
+
+#endif
@@ -20,14 +20,90 @@
  * \file
  *
  * HTML internal font handling implementation.
+ *
+ * Text measurements made during layout go through a cache in front of
+ * the frontend's layout table. Widths are remembered per font and
+ * string, and fonts whose printable ASCII glyphs are found to have
+ * fixed whole pixel advances have ASCII strings measured by summing
+ * advances, without asking the frontend at all.
  */
 
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <neosurf/utils/errors.h>
 #include <neosurf/utils/nsoption.h>
+#include <neosurf/utils/log.h>
 #include <neosurf/plot_style.h>
+#include <neosurf/layout.h>
+#include <neosurf/desktop/gui_internal.h>
 #include <neosurf/content/handlers/css/utils.h>
 
 #include "content/handlers/html/font.h"
 
+/** First character with an advance in the ASCII fast path */
+#define FONT_MEASURE_FIRST 0x20
+/** Number of characters with an advance in the ASCII fast path */
+#define FONT_MEASURE_COUNT (0x7f - FONT_MEASURE_FIRST)
+/** Number of fonts remembered before the cache is flushed */
+#define FONT_MEASURE_MAX_FONTS 64
+/** Number of hash chains for measured strings */
+#define FONT_MEASURE_CHAINS 4096
+/** Number of measured strings remembered before the cache is flushed */
+#define FONT_MEASURE_MAX_ENTRIES 32768
+/** Longest string whose width is remembered */
+#define FONT_MEASURE_MAX_LENGTH 256
+
+/**
+ * Whether a font's ASCII glyphs may be measured by summing advances.
+ */
+enum font_measure_advances {
+	FONT_ADVANCES_UNKNOWN, /**< not yet probed */
+	FONT_ADVANCES_FIXED, /**< strings are the sum of their advances */
+	FONT_ADVANCES_VARIABLE /**< kerning, ligatures or subpixel advances */
+};
+
+/**
+ * A font text has been measured in.
+ */
+struct font_measure_font {
+	plot_font_generic_family_t family; /**< generic family */
+	plot_style_fixed size; /**< size, in pt */
+	int weight; /**< weight */
+	plot_font_flags_t flags; /**< flags */
+	/** configured face for the generic family then the family names,
+	 * each nul terminated
+	 */
+	char *names;
+	size_t names_len; /**< length of names, including terminators */
+	enum font_measure_advances advances; /**< ASCII fast path state */
+	int advance[FONT_MEASURE_COUNT]; /**< ASCII glyph advances */
+};
+
+/**
+ * A measured string.
+ */
+struct font_measure_entry {
+	struct font_measure_entry *next; /**< next entry in hash chain */
+	const struct font_measure_font *font; /**< font measured in */
+	uint32_t hash; /**< hash of string */
+	size_t length; /**< length of string, in bytes */
+	int width; /**< width of string */
+	char string[]; /**< the string */
+};
+
+/** Fonts text has been measured in */
+static struct font_measure_font *font_measure_fonts[FONT_MEASURE_MAX_FONTS];
+/** Number of fonts in use */
+static unsigned int font_measure_font_count;
+/** Font of the previous measurement */
+static struct font_measure_font *font_measure_last;
+/** Hash chains of measured strings */
+static struct font_measure_entry *font_measure_chain[FONT_MEASURE_CHAINS];
+/** Number of measured strings */
+static unsigned int font_measure_entry_count;
+
 /**
  * Map a generic CSS font family to a generic plot font family
  *
@@ -163,3 +239,437 @@ void font_plot_style_from_css(
 	fstyle->foreground = nscss_color_to_ns(col);
 	fstyle->background = 0;
 }
+
+
+/**
+ * Discard all measured strings.
+ */
+static void font_measure_flush_entries(void)
+{
+	struct font_measure_entry *entry, *next;
+	unsigned int i;
+
+	for (i = 0; i != FONT_MEASURE_CHAINS; i++) {
+		for (entry = font_measure_chain[i]; entry; entry = next) {
+			next = entry->next;
+			free(entry);
+		}
+		font_measure_chain[i] = NULL;
+	}
+	font_measure_entry_count = 0;
+}
+
+
+/**
+ * Discard all fonts and measured strings.
+ */
+static void font_measure_flush(void)
+{
+	unsigned int i;
+
+	font_measure_flush_entries();
+
+	for (i = 0; i != font_measure_font_count; i++) {
+		free(font_measure_fonts[i]->names);
+		free(font_measure_fonts[i]);
+	}
+	font_measure_font_count = 0;
+	font_measure_last = NULL;
+}
+
+
+/**
+ * Get the face configured for a generic font family
+ *
+ * Frontends resolve generic families to these faces, so measurements
+ * made before one is changed are not valid afterwards.
+ *
+ * \param family  generic font family
+ * \return configured face name, or empty string if none
+ */
+static const char *font_measure_face(plot_font_generic_family_t family)
+{
+	const char *face;
+
+	switch (family) {
+	case PLOT_FONT_FAMILY_SERIF:
+		face = nsoption_charp(font_serif);
+		break;
+	case PLOT_FONT_FAMILY_MONOSPACE:
+		face = nsoption_charp(font_mono);
+		break;
+	case PLOT_FONT_FAMILY_CURSIVE:
+		face = nsoption_charp(font_cursive);
+		break;
+	case PLOT_FONT_FAMILY_FANTASY:
+		face = nsoption_charp(font_fantasy);
+		break;
+	case PLOT_FONT_FAMILY_SANS_SERIF:
+	default:
+		face = nsoption_charp(font_sans);
+		break;
+	}
+
+	return (face != NULL) ? face : "";
+}
+
+
+/**
+ * Compare a font with a plot font style
+ *
+ * \param font    font to compare
+ * \param fstyle  plot font style to compare
+ * \param face    face configured for the style's generic family
+ * \return true if text measures the same in both
+ */
+static bool
+font_measure_font_match(const struct font_measure_font *font,
+		const plot_font_style_t *fstyle,
+		const char *face)
+{
+	lwc_string * const *family;
+	const char *names;
+	const char *end;
+	size_t len;
+
+	if (font->family != fstyle->family ||
+			font->size != fstyle->size ||
+			font->weight != fstyle->weight ||
+			font->flags != fstyle->flags)
+		return false;
+
+	names = font->names;
+	end = names + font->names_len;
+
+	len = strlen(face) + 1;
+	if (len > (size_t)(end - names) || memcmp(names, face, len) != 0)
+		return false;
+	names += len;
+
+	if (fstyle->families != NULL) {
+		for (family = fstyle->families; *family != NULL; family++) {
+			len = lwc_string_length(*family);
+			if (len + 1 > (size_t)(end - names) ||
+					memcmp(names, lwc_string_data(*family),
+							len) != 0 ||
+					names[len] != '\0')
+				return false;
+			names += len + 1;
+		}
+	}
+
+	return names == end;
+}
+
+
+/**
+ * Find, or add, the font for a plot font style
+ *
+ * \param fstyle  plot font style
+ * \return font, or NULL on memory exhaustion
+ */
+static struct font_measure_font *
+font_measure_find_font(const plot_font_style_t *fstyle)
+{
+	struct font_measure_font *font;
+	lwc_string * const *family;
+	const char *face;
+	size_t len;
+	char *names;
+	unsigned int i;
+
+	face = font_measure_face(fstyle->family);
+
+	if (font_measure_last != NULL &&
+			font_measure_font_match(font_measure_last,
+					fstyle, face))
+		return font_measure_last;
+
+	for (i = 0; i != font_measure_font_count; i++) {
+		if (font_measure_font_match(font_measure_fonts[i],
+				fstyle, face)) {
+			font_measure_last = font_measure_fonts[i];
+			return font_measure_last;
+		}
+	}
+
+	if (font_measure_font_count == FONT_MEASURE_MAX_FONTS)
+		font_measure_flush();
+
+	len = strlen(face) + 1;
+	if (fstyle->families != NULL) {
+		for (family = fstyle->families; *family != NULL; family++)
+			len += lwc_string_length(*family) + 1;
+	}
+
+	font = malloc(sizeof *font);
+	names = malloc(len);
+	if (font == NULL || names == NULL) {
+		free(font);
+		free(names);
+		return NULL;
+	}
+
+	font->family = fstyle->family;
+	font->size = fstyle->size;
+	font->weight = fstyle->weight;
+	font->flags = fstyle->flags;
+	font->names = names;
+	font->names_len = len;
+	font->advances = FONT_ADVANCES_UNKNOWN;
+
+	len = strlen(face) + 1;
+	memcpy(names, face, len);
+	names += len;
+	if (fstyle->families != NULL) {
+		for (family = fstyle->families; *family != NULL; family++) {
+			len = lwc_string_length(*family);
+			memcpy(names, lwc_string_data(*family), len);
+			names[len] = '\0';
+			names += len + 1;
+		}
+	}
+
+	font_measure_fonts[font_measure_font_count++] = font;
+	font_measure_last = font;
+
+	return font;
+}
+
+
+/**
+ * Find whether a font's ASCII glyphs have fixed advances
+ *
+ * Each glyph is measured alone, then text with common kerning pairs
+ * and ligatures is checked to measure the sum of its advances. Fonts
+ * failing the check are always measured by the frontend.
+ *
+ * \param font    font to probe
+ * \param fstyle  plot font style of font
+ */
+static void
+font_measure_probe(struct font_measure_font *font,
+		const plot_font_style_t *fstyle)
+{
+	static const char probe[] = "AVAWAYTaTeToVaWaYaLTLVfifflffiff "
+			"r,y.P,F.\"A'A";
+	char all[FONT_MEASURE_COUNT];
+	int width, sum;
+	unsigned int i;
+
+	font->advances = FONT_ADVANCES_VARIABLE;
+
+	for (i = 0; i != FONT_MEASURE_COUNT; i++) {
+		all[i] = FONT_MEASURE_FIRST + i;
+		if (guit->layout->width(fstyle, all + i, 1,
+				&font->advance[i]) != NSERROR_OK)
+			return;
+	}
+
+	sum = 0;
+	for (i = 0; i != FONT_MEASURE_COUNT; i++)
+		sum += font->advance[i];
+	if (guit->layout->width(fstyle, all, FONT_MEASURE_COUNT,
+			&width) != NSERROR_OK || width != sum)
+		return;
+
+	sum = 0;
+	for (i = 0; i != sizeof probe - 1; i++)
+		sum += font->advance[probe[i] - FONT_MEASURE_FIRST];
+	if (guit->layout->width(fstyle, probe, sizeof probe - 1,
+			&width) != NSERROR_OK || width != sum)
+		return;
+
+	font->advances = FONT_ADVANCES_FIXED;
+}
+
+
+/**
+ * Measure a printable ASCII string from glyph advances
+ *
+ * \param font    font to measure in
+ * \param fstyle  plot font style of font
+ * \param string  string to measure
+ * \param length  length of string, in bytes
+ * \param width   updated to width of string
+ * \return true and width updated if the string was measured, or false
+ *         if it must be measured by the frontend
+ */
+static bool
+font_measure_ascii(struct font_measure_font *font,
+		const plot_font_style_t *fstyle,
+		const char *string,
+		size_t length,
+		int *width)
+{
+	unsigned char c;
+	size_t i;
+	int w = 0;
+
+	if (font->advances == FONT_ADVANCES_VARIABLE)
+		return false;
+
+	for (i = 0; i != length; i++) {
+		c = string[i];
+		if (c < FONT_MEASURE_FIRST ||
+				c >= FONT_MEASURE_FIRST + FONT_MEASURE_COUNT)
+			return false;
+	}
+
+	if (font->advances == FONT_ADVANCES_UNKNOWN) {
+		font_measure_probe(font, fstyle);
+		if (font->advances != FONT_ADVANCES_FIXED)
+			return false;
+	}
+
+	for (i = 0; i != length; i++)
+		w += font->advance[(unsigned char)string[i] -
+				FONT_MEASURE_FIRST];
+
+	*width = w;
+	return true;
+}
+
+
+/**
+ * Measure the width of a string, through the measurement cache.
+ *
+ * \param[in] fstyle plot style for this text
+ * \param[in] string UTF-8 string to measure
+ * \param[in] length length of string, in bytes
+ * \param[out] width updated to width of string[0..length)
+ * \return NSERROR_OK and width updated or appropriate error
+ *          code on faliure
+ */
+static nserror
+font_measure_width(const plot_font_style_t *fstyle,
+		const char *string,
+		size_t length,
+		int *width)
+{
+	struct font_measure_font *font;
+	struct font_measure_entry *entry;
+	uint32_t hash = 0x811c9dc5; /* FNV-1a */
+	unsigned int chain;
+	nserror res;
+	size_t i;
+
+	if (length == 0 || length > FONT_MEASURE_MAX_LENGTH)
+		return guit->layout->width(fstyle, string, length, width);
+
+	font = font_measure_find_font(fstyle);
+	if (font == NULL)
+		return guit->layout->width(fstyle, string, length, width);
+
+	if (font_measure_ascii(font, fstyle, string, length, width))
+		return NSERROR_OK;
+
+	for (i = 0; i != length; i++) {
+		hash ^= (unsigned char)string[i];
+		hash *= 0x01000193;
+	}
+	chain = hash % FONT_MEASURE_CHAINS;
+
+	for (entry = font_measure_chain[chain]; entry; entry = entry->next) {
+		if (entry->hash == hash &&
+				entry->font == font &&
+				entry->length == length &&
+				memcmp(entry->string, string, length) == 0) {
+			*width = entry->width;
+			return NSERROR_OK;
+		}
+	}
+
+	res = guit->layout->width(fstyle, string, length, width);
+	if (res != NSERROR_OK)
+		return res;
+
+	if (font_measure_entry_count == FONT_MEASURE_MAX_ENTRIES) {
+		/* keep the fonts, which may have been probed */
+		font_measure_flush_entries();
+	}
+
+	entry = malloc(sizeof *entry + length);
+	if (entry == NULL)
+		return NSERROR_OK;
+
+	entry->font = font;
+	entry->hash = hash;
+	entry->length = length;
+	entry->width = *width;
+	memcpy(entry->string, string, length);
+	entry->next = font_measure_chain[chain];
+	font_measure_chain[chain] = entry;
+	font_measure_entry_count++;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Find the position in a string where an x coordinate falls.
+ *
+ * The result depends on x, so it is not remembered.
+ *
+ * \param[in] fstyle style for this text
+ * \param[in] string UTF-8 string to measure
+ * \param[in] length length of string, in bytes
+ * \param[in] x coordinate to search for
+ * \param[out] char_offset updated to offset in string of actual_x, [0..length]
+ * \param[out] actual_x updated to x coordinate of character closest to x
+ * \return NSERROR_OK and char_offset and actual_x updated or appropriate
+ *          error code on faliure
+ */
+static nserror
+font_measure_position(const plot_font_style_t *fstyle,
+		const char *string,
+		size_t length,
+		int x,
+		size_t *char_offset,
+		int *actual_x)
+{
+	return guit->layout->position(fstyle, string, length, x,
+			char_offset, actual_x);
+}
+
+
+/**
+ * Find where to split a string to make it fit a width.
+ *
+ * Break opportunities are found by the frontend, so the split is not
+ * made from remembered widths.
+ *
+ * \param[in] fstyle       style for this text
+ * \param[in] string       UTF-8 string to measure
+ * \param[in] length       length of string, in bytes
+ * \param[in] x            width available
+ * \param[out] char_offset updated to offset in string of actual_x, [1..length]
+ * \param[out] actual_x updated to x coordinate of character closest to x
+ * \return NSERROR_OK or appropriate error code on faliure
+ */
+static nserror
+font_measure_split(const plot_font_style_t *fstyle,
+		const char *string,
+		size_t length,
+		int x,
+		size_t *char_offset,
+		int *actual_x)
+{
+	return guit->layout->split(fstyle, string, length, x,
+			char_offset, actual_x);
+}
+
+
+/* exported interface documented in html/font.h */
+const struct gui_layout_table html_font_layout_table = {
+	.width = font_measure_width,
+	.position = font_measure_position,
+	.split = font_measure_split,
+};
+
+
+/* exported function documented in html/font.h */
+void font_measure_fini(void)
+{
+	font_measure_flush();
+}
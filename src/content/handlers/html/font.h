@@ -28,6 +28,15 @@
 #define NETSURF_HTML_FONT_H
 
 struct plot_font_style;
+struct gui_layout_table;
+
+/**
+ * Text measurement functions for HTML layout.
+ *
+ * These measure text with the frontend's layout table, remembering
+ * string widths so repeated strings are measured only once.
+ */
+extern const struct gui_layout_table html_font_layout_table;
 
 /**
  * Populate a font style using data from a computed CSS style
@@ -40,4 +49,9 @@ void font_plot_style_from_css(const css_unit_ctx *unit_len_ctx,
 			      const css_computed_style *css,
 			      struct plot_font_style *fstyle);
 
+/**
+ * Discard remembered text measurements.
+ */
+void font_measure_fini(void);
+
 #endif
@@ -1314,6 +1314,7 @@ form__select_process_selection(html_content *html,
 			       int item)
 {
 	struct box *inline_box;
+	struct box *b;
 	struct form_option *o;
 	int count;
 	nserror ret = NSERROR_OK;
@@ -1383,6 +1384,10 @@ form__select_process_selection(html_content *html,
 	}
 	inline_box->width = control->box->width;
 
+	/* the changed text must be laid out again on the next reflow */
+	for (b = inline_box; b; b = b->parent)
+		b->flags |= NEED_LAYOUT;
+
 	html__redraw_a_box(html, control->box);
 
 	return ret;
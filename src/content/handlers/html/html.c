@@ -66,6 +66,8 @@
 #include <neosurf/content/handlers/html/interaction.h>
 #include <neosurf/content/handlers/html/box.h>
 #include "content/handlers/html/box_construct.h"
+#include "content/handlers/html/display_list.h"
+#include "content/handlers/html/font.h"
 #include <neosurf/content/handlers/html/box_inspect.h>
 #include <neosurf/content/handlers/html/form_internal.h>
 #include "content/handlers/html/imagemap.h"
@@ -457,9 +459,11 @@ html_create_html_data(html_content *c, const http_parameter *params)
 	c->aborted = false;
 	c->refresh = false;
 	c->reflowing = false;
+	c->layout_reuse = false;
 	c->title = NULL;
 	c->bctx = NULL;
 	c->layout = NULL;
+	c->display_list = NULL;
 	c->background_colour = NS_TRANSPARENT;
 	c->stylesheet_count = 0;
 	c->stylesheets = NULL;
@@ -474,7 +478,7 @@ html_create_html_data(html_content *c, const http_parameter *params)
 	c->frameset = NULL;
 	c->iframe = NULL;
 	c->page = NULL;
-	c->font_func = guit->layout;
+	c->font_func = &html_font_layout_table;
 	c->drag_type = HTML_DRAG_NONE;
 	c->drag_owner.no_owner = true;
 	c->selection_type = HTML_SELECTION_NONE;
@@ -1042,15 +1046,30 @@ static void html_reformat(struct content *c, int width, int height)
 	uint64_t ms_before;
 	uint64_t ms_after;
 	uint64_t ms_interval;
+	css_fixed viewport_width;
+	css_fixed viewport_height;
 
 	nsu_getmonotonic_ms(&ms_before);
 
 	htmlc->reflowing = true;
 
-	htmlc->unit_len_ctx.viewport_width = css_unit_device2css_px(
+	html_display_list_invalidate(htmlc, NULL);
+
+	viewport_width = css_unit_device2css_px(
 			INTTOFIX(width), htmlc->unit_len_ctx.device_dpi);
-	htmlc->unit_len_ctx.viewport_height = css_unit_device2css_px(
+	viewport_height = css_unit_device2css_px(
 			INTTOFIX(height), htmlc->unit_len_ctx.device_dpi);
+
+	/* lengths relative to the viewport resolve differently after it
+	 * changes size, so nothing from the previous layout can be kept
+	 */
+	htmlc->layout_reuse = htmlc->had_initial_layout &&
+			htmlc->unit_len_ctx.viewport_width == viewport_width &&
+			htmlc->unit_len_ctx.viewport_height == viewport_height &&
+			htmlc->unit_len_ctx.root_style == htmlc->layout->style;
+
+	htmlc->unit_len_ctx.viewport_width = viewport_width;
+	htmlc->unit_len_ctx.viewport_height = viewport_height;
 	htmlc->unit_len_ctx.root_style = htmlc->layout->style;
 
 	layout_document(htmlc, width, height);
@@ -1096,9 +1115,17 @@ static void html_reformat(struct content *c, int width, int height)
 void html_redraw_a_box(hlcache_handle *h, struct box *box)
 {
 	int x, y;
+	struct rect area;
 
 	box_coords(box, &x, &y);
 
+	area.x0 = x;
+	area.y0 = y;
+	area.x1 = x + box->padding[LEFT] + box->width + box->padding[RIGHT];
+	area.y1 = y + box->padding[TOP] + box->height + box->padding[BOTTOM];
+	html_display_list_invalidate(
+			(html_content *)hlcache_handle_get_content(h), &area);
+
 	content_request_redraw(h, x, y,
 			box->padding[LEFT] + box->width + box->padding[RIGHT],
 			box->padding[TOP] + box->height + box->padding[BOTTOM]);
@@ -1115,9 +1142,16 @@ void html_redraw_a_box(hlcache_handle *h, struct box *box)
 void html__redraw_a_box(struct html_content *html, struct box *box)
 {
 	int x, y;
+	struct rect area;
 
 	box_coords(box, &x, &y);
 
+	area.x0 = x;
+	area.y0 = y;
+	area.x1 = x + box->padding[LEFT] + box->width + box->padding[RIGHT];
+	area.y1 = y + box->padding[TOP] + box->height + box->padding[BOTTOM];
+	html_display_list_invalidate(html, &area);
+
 	content__request_redraw((struct content *)html, x, y,
 			box->padding[LEFT] + box->width + box->padding[RIGHT],
 			box->padding[TOP] + box->height + box->padding[BOTTOM]);
@@ -1172,6 +1206,8 @@ static void html_destroy_iframe(struct content_html_iframe *iframe)
 
 static void html_free_layout(html_content *htmlc)
 {
+	html_display_list_destroy(htmlc);
+
 	if (htmlc->bctx != NULL) {
 		/* freeing talloc context should let the entire box
 		 * set be destroyed
@@ -1349,6 +1385,9 @@ static nserror html_close(struct content *c)
 	/* clear the html content reference to the browser window */
 	htmlc->bw = NULL;
 
+	/* nothing is drawn until reopened */
+	html_display_list_destroy(htmlc);
+
 	/* remove all object references from the html content */
 	html_object_close_objects(htmlc);
 
@@ -2145,6 +2184,7 @@ static content_type html_content_type(void)
 static void html_fini(void)
 {
 	html_css_fini();
+	font_measure_fini();
 }
 
 /**
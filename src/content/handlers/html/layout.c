@@ -64,6 +64,7 @@
 #include <neosurf/content/handlers/html/private.h>
 #include <neosurf/content/handlers/html/box.h>
 #include <neosurf/content/handlers/html/box_inspect.h>
+#include "content/handlers/html/box_index.h"
 #include "content/handlers/html/font.h"
 #include <neosurf/content/handlers/html/form_internal.h>
 #include "content/handlers/html/layout.h"
@@ -3527,6 +3528,88 @@ static bool layout_inline_container(struct box *inline_container, int width,
 }
 
 
+/**
+ * Check a list of inline boxes can keep its previous layout.
+ *
+ * \param first  first box in list
+ * \return true if no box in the list, or its descendants, has changed
+ *         since it was laid out or is positioned outside the normal line
+ *         layout
+ */
+static bool layout_inline_children_clean(const struct box *first)
+{
+	const struct box *c;
+
+	for (c = first; c != NULL; c = c->next) {
+		if (c->flags & NEED_LAYOUT)
+			return false;
+
+		if (c->type == BOX_FLOAT_LEFT || c->type == BOX_FLOAT_RIGHT)
+			return false;
+
+		/* relative offsets are added again by every layout */
+		if (c->style != NULL && css_computed_position(c->style) !=
+				CSS_POSITION_STATIC)
+			return false;
+
+		/* embedded documents can change size by themselves */
+		if (c->object != NULL &&
+				content_get_type(c->object) == CONTENT_HTML)
+			return false;
+
+		if (c->children != NULL &&
+				!layout_inline_children_clean(c->children))
+			return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * Check whether an inline container can keep its previous layout.
+ *
+ * The lines of an inline container depend only on its contents and
+ * width unless floats intrude, so an unchanged container at the same
+ * width as before, with no floats in its block formatting context, has
+ * the same lines as last time.
+ *
+ * \param inline_container  inline container box
+ * \param cont              ancestor box which defines horizontal space
+ * \param content           content being laid out
+ * \return true if the previous layout is still valid
+ */
+static bool layout_inline_container_clean(
+		const struct box *inline_container,
+		const struct box *cont,
+		const html_content *content)
+{
+	return content->layout_reuse &&
+			!(inline_container->flags & NEED_LAYOUT) &&
+			inline_container->width ==
+					inline_container->parent->width &&
+			cont->float_children == NULL &&
+			layout_inline_children_clean(
+					inline_container->children);
+}
+
+
+/**
+ * Mark a box and its descendants as laid out.
+ *
+ * \param box  box to mark
+ */
+static void layout_mark_clean(struct box *box)
+{
+	struct box *c;
+
+	box->flags &= ~NEED_LAYOUT;
+
+	for (c = box->children; c != NULL; c = c->next)
+		layout_mark_clean(c);
+}
+
+
 /* Documented in layout_intertnal.h */
 bool layout_block_context(
 		struct box *block,
@@ -3825,10 +3908,24 @@ bool layout_block_context(
 				return false;
 
 		} else if (box->type == BOX_INLINE_CONTAINER) {
-			box->width = box->parent->width;
-			if (!layout_inline_container(box, box->width, block,
-					cx, cy, content))
-				return false;
+			if (layout_inline_container_clean(box, block,
+					content)) {
+				/* keep the lines from the previous layout */
+				NSLOG(layout, DEBUG, "reusing %p", box);
+			} else {
+				box->width = box->parent->width;
+				if (!layout_inline_container(box, box->width,
+						block, cx, cy, content))
+					return false;
+
+				/* lines laid out around floats can't be
+				 * kept, as the floats may move
+				 */
+				if (block->float_children == NULL)
+					layout_mark_clean(box);
+				else
+					box->flags |= NEED_LAYOUT;
+			}
 
 		} else if (box->type == BOX_TABLE) {
 			/* Move down to avoid floats if necessary. */
@@ -5466,5 +5563,10 @@ bool layout_document(html_content *content, int width, int height)
 
 	layout_calculate_descendant_bboxes(&content->unit_len_ctx, doc);
 
+	if (box_index_build(doc) != NSERROR_OK) {
+		NSLOG(layout, WARNING, "Unable to index all boxes of %s",
+				nsurl_access(content_get_url(&content->base)));
+	}
+
 	return ret;
 }
@@ -46,6 +46,7 @@
 #include <neosurf/content/handlers/html/box.h>
 #include <neosurf/content/handlers/html/box_inspect.h>
 #include "content/handlers/html/object.h"
+#include "content/handlers/html/display_list.h"
 
 /* break reference loop */
 static void html_object_refresh(void *p);
@@ -69,6 +70,28 @@ struct content_html_object *html_get_objects(hlcache_handle *h, unsigned int *n)
 	return c->object_list;
 }
 
+/**
+ * Determine the retrieval flags for an object fetch.
+ *
+ * Objects which can only be images, including all backgrounds, are
+ * not required to lay out the page so are fetched at low priority.
+ *
+ * \param object The object to be fetched
+ * \return The hlcache retrieval flags
+ */
+static uint32_t
+html_object_fetch_flags(const struct content_html_object *object)
+{
+	uint32_t flags = HLCACHE_RETRIEVE_SNIFF_TYPE;
+
+	if (object->background ||
+	    ((object->permitted_types & ~CONTENT_IMAGE) == 0)) {
+		flags |= LLCACHE_RETRIEVE_PRIORITY_LOW;
+	}
+
+	return flags;
+}
+
 /**
  * Handle object fetching or loading failure.
  *
@@ -102,6 +125,10 @@ html_object_done(struct box *box,
 
 	box->object = object;
 
+	/* the box and its ancestors must be laid out again */
+	for (b = box; b; b = b->parent)
+		b->flags |= NEED_LAYOUT;
+
 	/* Normalise the box type, now it has been replaced. */
 	switch (box->type) {
 	case BOX_TABLE:
@@ -185,6 +212,7 @@ html_object_callback(hlcache_handle *object,
 
 			/* Adjust parent content for new object size */
 			html_object_done(box, object, o->background);
+			html_display_list_invalidate(c, NULL);
 			if (c->base.status == CONTENT_STATUS_READY ||
 					c->base.status == CONTENT_STATUS_DONE)
 				content__reformat(&c->base, false,
@@ -198,6 +226,7 @@ html_object_callback(hlcache_handle *object,
 		NSLOG(neosurf, INFO, "%d fetches active", c->base.active);
 
 		html_object_done(box, object, o->background);
+		html_display_list_invalidate(c, NULL);
 
 		if (c->base.status != CONTENT_STATUS_LOADING &&
 				box->flags & REPLACE_DIM) {
@@ -550,7 +579,8 @@ static bool html_replace_object(struct content_html_object *object, nsurl *url)
 	}
 
 	/* initialise fetch */
-	error = hlcache_handle_retrieve(url, HLCACHE_RETRIEVE_SNIFF_TYPE,
+	error = hlcache_handle_retrieve(url,
+			html_object_fetch_flags(object),
 			content_get_url(&c->base), NULL,
 			html_object_callback, object, &child,
 			object->permitted_types,
@@ -744,7 +774,7 @@ html_fetch_object(html_content *c,
 	object->background = background;
 
 	error = hlcache_handle_retrieve(url,
-					HLCACHE_RETRIEVE_SNIFF_TYPE,
+					html_object_fetch_flags(object),
 					content_get_url(&c->base),
 					NULL,
 					object_callback,
@@ -59,6 +59,8 @@
 #include <neosurf/content/handlers/html/box.h>
 #include <neosurf/content/handlers/html/box_inspect.h>
 #include "content/handlers/html/box_manipulate.h"
+#include "content/handlers/html/box_index.h"
+#include "content/handlers/html/display_list.h"
 #include "content/handlers/html/font.h"
 #include <neosurf/content/handlers/html/form_internal.h>
 #include <neosurf/content/handlers/html/private.h>
@@ -573,6 +575,29 @@ static bool html_redraw_file(int x, int y, int width, int height,
 }
 
 
+/**
+ * Draw a content, or record it for later when recording a display list.
+ *
+ * \param  h     content to draw
+ * \param  data  redraw data for the content
+ * \param  clip  current clip rectangle
+ * \param  ctx   current redraw context
+ * \return true if successful, false otherwise
+ */
+static bool html_redraw_content(struct hlcache_handle *h,
+		struct content_redraw_data *data,
+		const struct rect *clip,
+		const struct redraw_context *ctx)
+{
+	if (html_display_list_recording(ctx)) {
+		return (html_display_list_add_content(ctx, h, data,
+				clip) == NSERROR_OK);
+	}
+
+	return content_redraw(h, data, clip, ctx);
+}
+
+
 /**
  * Plot background images.
  *
@@ -791,7 +816,7 @@ static bool html_redraw_background(int x, int y, struct box *box, float scale,
 				bg_data.repeat_y = repeat_y;
 
 				/* We just continue if redraw fails */
-				content_redraw(background->background,
+				html_redraw_content(background->background,
 						&bg_data, &r, ctx);
 			}
 		}
@@ -951,7 +976,7 @@ static bool html_redraw_inline_background(int x, int y, struct box *box,
 			bg_data.repeat_y = repeat_y;
 
 			/* We just continue if redraw fails */
-			content_redraw(box->background, &bg_data, &r, ctx);
+			html_redraw_content(box->background, &bg_data, &r, ctx);
 		}
 	}
 
@@ -1159,12 +1184,6 @@ static bool html_redraw_text_box(const html_content *html, struct box *box,
 	return true;
 }
 
-bool html_redraw_box(const html_content *html, struct box *box,
-		int x_parent, int y_parent,
-		const struct rect *clip, float scale,
-		colour current_background_color,
-		const struct redraw_context *ctx);
-
 /**
  * Draw the various children of a box.
  *
@@ -1186,8 +1205,29 @@ static bool html_redraw_box_children(const html_content *html, struct box *box,
 		const struct redraw_context *ctx)
 {
 	struct box *c;
+	struct box *first;
+	struct box *end;
+	int y_origin;
+	int y0, y1;
+
+	/* clip rectangle's vertical extent relative to the children,
+	 * widened to cover rounding in html_redraw_box */
+	y_origin = y_parent + box->y - scrollbar_get_offset(box->scroll_y);
+	if (scale == 1.0) {
+		y0 = clip->y0 - y_origin - 1;
+		y1 = clip->y1 - y_origin + 1;
+	} else {
+		y0 = floorf((clip->y0 - 2) / scale) - y_origin - 1;
+		y1 = ceilf((clip->y1 + 2) / scale) - y_origin + 1;
+	}
 
-	for (c = box->children; c; c = c->next) {
+	/* only the children the index can't rule out need visiting */
+	if (!box_index_find(box, false, y0, y1, &first, &end)) {
+		first = box->children;
+		end = NULL;
+	}
+
+	for (c = first; c != end; c = c->next) {
 
 		if (c->type != BOX_FLOAT_LEFT && c->type != BOX_FLOAT_RIGHT)
 			if (!html_redraw_box(html, c,
@@ -1199,7 +1239,13 @@ static bool html_redraw_box_children(const html_content *html, struct box *box,
 					ctx))
 				return false;
 	}
-	for (c = box->float_children; c; c = c->next_float)
+
+	if (!box_index_find(box, true, y0, y1, &first, &end)) {
+		first = box->float_children;
+		end = NULL;
+	}
+
+	for (c = first; c != end; c = c->next_float)
 		if (!html_redraw_box(html, c,
 				x_parent + box->x -
 				scrollbar_get_offset(box->scroll_x),
@@ -1212,6 +1258,91 @@ static bool html_redraw_box_children(const html_content *html, struct box *box,
 	return true;
 }
 
+/* exported function documented in html/private.h */
+bool html_redraw_replaced(struct box *box, dom_html_element_type tag_type,
+		int x, int y, int width, int height,
+		const struct rect *clip, float scale,
+		colour current_background_color,
+		const struct redraw_context *ctx)
+{
+	struct rect rect;
+	dom_exception exc;
+
+	if (box->object && width != 0 && height != 0) {
+		struct content_redraw_data obj_data;
+
+		obj_data.x = x - scrollbar_get_offset(box->scroll_x) * scale;
+		obj_data.y = y - scrollbar_get_offset(box->scroll_y) * scale;
+		obj_data.width = width;
+		obj_data.height = height;
+		obj_data.background_colour = current_background_color;
+		obj_data.scale = scale;
+		obj_data.repeat_x = false;
+		obj_data.repeat_y = false;
+
+		if (content_get_type(box->object) == CONTENT_HTML) {
+			obj_data.x /= scale;
+			obj_data.y /= scale;
+		}
+
+		if (!content_redraw(box->object, &obj_data, clip, ctx)) {
+			/* Show image fail */
+			/* Unicode (U+FFFC) 'OBJECT REPLACEMENT CHARACTER' */
+			const char *obj = "\xef\xbf\xbc";
+			int obj_width;
+			int obj_x = x;
+			nserror res;
+
+			rect.x0 = x;
+			rect.y0 = y;
+			rect.x1 = x + width - 1;
+			rect.y1 = y + height - 1;
+			res = ctx->plot->rectangle(ctx, plot_style_broken_object, &rect);
+			if (res != NSERROR_OK) {
+				return false;
+			}
+
+			res = guit->layout->width(plot_fstyle_broken_object,
+						  obj,
+						  sizeof(obj) - 1,
+						  &obj_width);
+			if (res != NSERROR_OK) {
+				obj_x += 1;
+			} else {
+				obj_x += width / 2 - obj_width / 2;
+			}
+
+			if (ctx->plot->text(ctx,
+					    plot_fstyle_broken_object,
+					    obj_x, y + (int)(height * 0.75),
+					    obj, sizeof(obj) - 1) != NSERROR_OK)
+				return false;
+		}
+	} else if (tag_type == DOM_HTML_ELEMENT_TYPE_CANVAS &&
+		   box->node != NULL &&
+		   box->flags & REPLACE_DIM) {
+		/* Canvas to draw */
+		struct bitmap *bitmap = NULL;
+		exc = dom_node_get_user_data(box->node,
+					     corestring_dom___ns_key_canvas_node_data,
+					     &bitmap);
+		if (exc != DOM_NO_ERR) {
+			bitmap = NULL;
+		}
+		if (bitmap != NULL &&
+		    ctx->plot->bitmap(ctx, bitmap, x, y,
+				      width, height, current_background_color,
+				      BITMAPF_NONE) != NSERROR_OK)
+			return false;
+	} else if (box->iframe) {
+		/* Offset is passed to browser window redraw unscaled */
+		browser_window_redraw(box->iframe, x, y, clip, ctx);
+	}
+
+	return true;
+}
+
+
 /**
  * Recursively draw a box.
  *
@@ -1241,7 +1372,6 @@ bool html_redraw_box(const html_content *html, struct box *box,
 	int border_left, border_top, border_right, border_bottom;
 	struct rect r;
 	struct rect rect;
-	int x_scrolled, y_scrolled;
 	struct box *bg_box = NULL;
 	css_computed_clip_rect css_rect;
 	enum css_overflow_e overflow_x = CSS_OVERFLOW_VISIBLE;
@@ -1755,81 +1885,24 @@ bool html_redraw_box(const html_content *html, struct box *box,
 		tag_type = DOM_HTML_ELEMENT_TYPE__UNKNOWN;
 	}
 
-	if (box->object && width != 0 && height != 0) {
-		struct content_redraw_data obj_data;
-
-		x_scrolled = x - scrollbar_get_offset(box->scroll_x) * scale;
-		y_scrolled = y - scrollbar_get_offset(box->scroll_y) * scale;
-
-		obj_data.x = x_scrolled + padding_left;
-		obj_data.y = y_scrolled + padding_top;
-		obj_data.width = width;
-		obj_data.height = height;
-		obj_data.background_colour = current_background_color;
-		obj_data.scale = scale;
-		obj_data.repeat_x = false;
-		obj_data.repeat_y = false;
-
-		if (content_get_type(box->object) == CONTENT_HTML) {
-			obj_data.x /= scale;
-			obj_data.y /= scale;
-		}
-
-		if (!content_redraw(box->object, &obj_data, &r, ctx)) {
-			/* Show image fail */
-			/* Unicode (U+FFFC) 'OBJECT REPLACEMENT CHARACTER' */
-			const char *obj = "\xef\xbf\xbc";
-			int obj_width;
-			int obj_x = x + padding_left;
-			nserror res;
-
-			rect.x0 = x + padding_left;
-			rect.y0 = y + padding_top;
-			rect.x1 = x + padding_left + width - 1;
-			rect.y1 = y + padding_top + height - 1;
-			res = ctx->plot->rectangle(ctx, plot_style_broken_object, &rect);
-			if (res != NSERROR_OK) {
-				return false;
-			}
-
-			res = guit->layout->width(plot_fstyle_broken_object,
-						  obj,
-						  sizeof(obj) - 1,
-						  &obj_width);
-			if (res != NSERROR_OK) {
-				obj_x += 1;
-			} else {
-				obj_x += width / 2 - obj_width / 2;
-			}
-
-			if (ctx->plot->text(ctx,
-					    plot_fstyle_broken_object,
-					    obj_x, y + padding_top + (int)(height * 0.75),
-					    obj, sizeof(obj) - 1) != NSERROR_OK)
+	if ((box->object && width != 0 && height != 0) ||
+	    (tag_type == DOM_HTML_ELEMENT_TYPE_CANVAS &&
+	     box->node != NULL &&
+	     box->flags & REPLACE_DIM) ||
+	    box->iframe) {
+		if (html_display_list_recording(ctx)) {
+			/* drawn live whenever the recording is replayed */
+			if (html_display_list_add_box(ctx, box, tag_type,
+					x + padding_left, y + padding_top,
+					width, height, &r,
+					current_background_color) != NSERROR_OK)
 				return false;
-		}
-	} else if (tag_type == DOM_HTML_ELEMENT_TYPE_CANVAS &&
-		   box->node != NULL &&
-		   box->flags & REPLACE_DIM) {
-		/* Canvas to draw */
-		struct bitmap *bitmap = NULL;
-		exc = dom_node_get_user_data(box->node,
-					     corestring_dom___ns_key_canvas_node_data,
-					     &bitmap);
-		if (exc != DOM_NO_ERR) {
-			bitmap = NULL;
-		}
-		if (bitmap != NULL &&
-		    ctx->plot->bitmap(ctx, bitmap, x + padding_left, y + padding_top,
-				      width, height, current_background_color,
-				      BITMAPF_NONE) != NSERROR_OK)
+		} else if (!html_redraw_replaced(box, tag_type,
+				x + padding_left, y + padding_top,
+				width, height, &r, scale,
+				current_background_color, ctx)) {
 			return false;
-	} else if (box->iframe) {
-		/* Offset is passed to browser window redraw unscaled */
-		browser_window_redraw(box->iframe,
-				x + padding_left,
-				y + padding_top, &r, ctx);
-
+		}
 	} else if (box->gadget && box->gadget->type == GADGET_CHECKBOX) {
 		if (!html_redraw_checkbox(x + padding_left, y + padding_top,
 				width, height, box->gadget->selected, ctx))
@@ -1979,8 +2052,12 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 
 		result &= (ctx->plot->rectangle(ctx, &pstyle_fill_bg, clip) == NSERROR_OK);
 
-		result &= html_redraw_box(html, box, data->x, data->y, clip,
-				data->scale, pstyle_fill_bg.fill_colour, ctx);
+		if (!html_display_list_redraw(html, data, clip,
+				pstyle_fill_bg.fill_colour, ctx, &result)) {
+			result &= html_redraw_box(html, box, data->x, data->y,
+					clip, data->scale,
+					pstyle_fill_bg.fill_colour, ctx);
+		}
 	}
 
 	if (select) {
@@ -35,6 +35,7 @@
 #include <neosurf/content/handlers/html/box_inspect.h>
 #include "content/handlers/html/font.h"
 #include "content/handlers/html/textselection.h"
+#include "content/handlers/html/display_list.h"
 
 #define SPACE_LEN(b) ((b->space == 0) ? 0 : 1)
 
@@ -491,6 +492,7 @@ html_textselection_redraw(struct content *c,
 	}
 
 	if (rdw.inited) {
+		html_display_list_invalidate(html, &rdw.r);
 		content__request_redraw(c,
 					rdw.r.x0,
 					rdw.r.y0,
@@ -26,19 +26,56 @@
 #include <stdbool.h>
 #include <string.h>
 #include <stdlib.h>
+#ifdef WITH_THREADS
+#include <pthread.h>
+#include <unistd.h>
+#endif
 
 #include <neosurf/inttypes.h>
 #include <neosurf/utils/utils.h>
 #include <neosurf/utils/log.h>
 #include <neosurf/misc.h>
 #include <neosurf/bitmap.h>
+#include <neosurf/plotters.h>
+#include <neosurf/content.h>
 #include <neosurf/content/llcache.h>
+#include <neosurf/content/content.h>
 #include <neosurf/content/content_protected.h>
 #include <neosurf/desktop/gui_internal.h>
 
+#include "utils/hashmap.h"
 #include "content/handlers/image/image_cache.h"
 #include "content/handlers/image/image.h"
 
+/**
+ * Fixed cost of converting an image, in bytes of bitmap.
+ *
+ * Converting an image has an overhead beyond the work proportional to
+ * its size, so per byte small images are more expensive to reconvert.
+ */
+#define IMAGE_CACHE_CONVERT_COST (64 * 1024)
+
+/** Fixed point shift applied to replacement priorities */
+#define IMAGE_CACHE_PRIORITY_SHIFT 8
+
+/**
+ * Smallest intrinsic bitmap size, in bytes, converted at display size.
+ *
+ * Below this the saving does not repay converting again when the
+ * display size changes.
+ */
+#define IMAGE_CACHE_SCALE_MIN_SIZE (256 * 1024)
+
+#ifdef WITH_THREADS
+/** Largest number of decode worker threads */
+#define IMAGE_CACHE_MAX_WORKERS 4
+
+/** Interval in ms at which finished background conversions are collected */
+#define IMAGE_CACHE_REAP_TIME 10
+#endif
+
+struct image_cache_job;
+
 /**
  * Age of an entry within the cache
  *
@@ -60,6 +97,15 @@ struct image_cache_entry_s {
 	struct bitmap *bitmap;
 	/** routine to convert content into bitmap */
 	image_cache_convert_fn *convert;
+	/** routine to convert content into bitmap at display size or NULL */
+	image_cache_convert_scaled_fn *convert_scaled;
+
+	/** display width bitmap was converted for, 0 for intrinsic size */
+	int scale_width;
+	/** display height bitmap was converted for, 0 for intrinsic size */
+	int scale_height;
+	/** Age the bitmap was last drawn at the size it was converted for */
+	cache_age scale_age;
 
 	/* Statistics for replacement algorithm */
 
@@ -69,8 +115,74 @@ struct image_cache_entry_s {
 	cache_age bitmap_age; /**< Age of last conversion to a bitmap by cache*/
 
 	int conversion_count; /**< Number of times image has been converted */
+
+	/**
+	 * GreedyDual-Size priority, the cache clean level when last used
+	 * plus the cost per byte of reconverting the bitmap.
+	 */
+	uint64_t priority;
+	/** bitmap was released by the cache cleaner */
+	bool evicted;
+
+	/** conversions may run on a decode worker */
+	bool background;
+	/** a background conversion failed so convert synchronously */
+	bool background_failed;
+#ifdef WITH_THREADS
+	/** conversion queued or running on a decode worker, or NULL */
+	struct image_cache_job *job;
+#endif
 };
 
+#ifdef WITH_THREADS
+/**
+ * Progress of a background conversion
+ */
+enum image_cache_job_state {
+	IMAGE_CACHE_JOB_QUEUED, /**< waiting for a worker */
+	IMAGE_CACHE_JOB_RUNNING, /**< being converted by a worker */
+	IMAGE_CACHE_JOB_DONE, /**< converted and awaiting collection */
+};
+
+/**
+ * A conversion performed by a decode worker.
+ *
+ * Jobs are created, collected and freed on the main thread. Workers
+ * only change the state, bitmap and queue linkage, with the decoder
+ * lock held.
+ */
+struct image_cache_job {
+	struct image_cache_job *next; /**< next job in queue */
+	struct image_cache_entry_s *centry; /**< entry being converted */
+	struct content *content; /**< content to convert */
+	image_cache_convert_fn *convert; /**< conversion function */
+	/** display size conversion function */
+	image_cache_convert_scaled_fn *convert_scaled;
+	int width; /**< display width to convert for, 0 for intrinsic */
+	int height; /**< display height to convert for, 0 for intrinsic */
+	size_t size; /**< estimated size of the bitmap */
+	struct bitmap *bitmap; /**< result of the conversion */
+	enum image_cache_job_state state; /**< progress of the job */
+};
+
+/**
+ * Decode worker pool state.
+ */
+struct image_cache_decoder {
+	pthread_t threads[IMAGE_CACHE_MAX_WORKERS]; /**< the workers */
+	unsigned int thread_count; /**< number of workers running */
+	pthread_mutex_t lock; /**< lock protecting queues, states and quit */
+	pthread_cond_t cond; /**< signalled when jobs are queued or on quit */
+	pthread_cond_t done; /**< broadcast when a job is converted */
+	struct image_cache_job *pending; /**< jobs waiting for a worker */
+	struct image_cache_job **pending_tail; /**< end of pending queue */
+	struct image_cache_job *complete; /**< converted jobs to collect */
+	bool quit; /**< the workers should exit */
+	unsigned int outstanding; /**< jobs queued and not yet collected */
+	uint64_t outstanding_size; /**< bitmap size of outstanding jobs */
+};
+#endif
+
 /**
  * Current state of the cache.
  *
@@ -89,6 +201,20 @@ struct image_cache_s {
 	/* The objects the cache holds */
 	struct image_cache_entry_s *entries;
 
+	/** map from content to cache entry */
+	hashmap_t *entry_map;
+
+#ifdef WITH_THREADS
+	/** decode worker pool or NULL if conversion is synchronous */
+	struct image_cache_decoder *decoder;
+#endif
+
+	/**
+	 * GreedyDual-Size clean level, the priority of the last bitmap
+	 * released by the cleaner.
+	 */
+	uint64_t clean_level;
+
 
 	/* Statistics for management algorithm */
 
@@ -134,6 +260,11 @@ struct image_cache_s {
 	int peak_conversions;
 	/** Size of bitmap with most conversions */
 	unsigned int peak_conversions_size;
+
+	/** Number of bitmaps released by the cache cleaner */
+	int evict_count;
+	/** Number of reads which reconverted a bitmap the cleaner released */
+	int reconvert_count;
 };
 
 /** image cache state */
@@ -159,6 +290,70 @@ static struct image_cache_entry_s *image_cache__findn(int entryn)
 }
 
 
+/**
+ * Entry map key clone, contents are keyed by identity
+ */
+static void *image_cache__key_clone(void *key)
+{
+	return key;
+}
+
+/**
+ * Entry map key destructor, contents are not owned by the map
+ */
+static void image_cache__key_destroy(void *key)
+{
+}
+
+/**
+ * Entry map key hash
+ */
+static uint32_t image_cache__key_hash(void *key)
+{
+	uint64_t x = (uintptr_t)key;
+
+	x ^= x >> 33;
+	x *= 0xff51afd7ed558ccdULL;
+	x ^= x >> 33;
+
+	return (uint32_t)x;
+}
+
+/**
+ * Entry map key comparison
+ */
+static bool image_cache__key_eq(void *a, void *b)
+{
+	return a == b;
+}
+
+/**
+ * Entry map value allocator
+ */
+static void *image_cache__value_alloc(void *key)
+{
+	return calloc(1, sizeof(struct image_cache_entry_s));
+}
+
+/**
+ * Entry map value destructor
+ */
+static void image_cache__value_destroy(void *value)
+{
+	free(value);
+}
+
+/** Parameters of the map from content to cache entry */
+static hashmap_parameters_t image_cache_entry_map_parameters = {
+	.key_clone = image_cache__key_clone,
+	.key_destroy = image_cache__key_destroy,
+	.key_hash = image_cache__key_hash,
+	.key_eq = image_cache__key_eq,
+	.value_alloc = image_cache__value_alloc,
+	.value_destroy = image_cache__value_destroy,
+};
+
+
 /**
  * Find the cache entry for a content
  *
@@ -167,13 +362,29 @@ static struct image_cache_entry_s *image_cache__findn(int entryn)
  */
 static struct image_cache_entry_s *image_cache__find(const struct content *c)
 {
-	struct image_cache_entry_s *found;
+	return hashmap_lookup(image_cache->entry_map, (void *)c);
+}
 
-	found = image_cache->entries;
-	while ((found != NULL) && (found->content != c)) {
-		found = found->next;
-	}
-	return found;
+
+/**
+ * Note a use of an entry's bitmap for the replacement policy
+ *
+ * Raises the entry's GreedyDual-Size priority above the clean level by
+ * the cost per byte of reconverting it, which grows with the number of
+ * times it has already had to be converted.
+ *
+ * \param centry The image cache entry which was used.
+ */
+static void image_cache__touch(struct image_cache_entry_s *centry)
+{
+	uint64_t size = centry->bitmap_size + 1;
+	uint64_t cost;
+
+	cost = (size + IMAGE_CACHE_CONVERT_COST) *
+		max(centry->conversion_count, 1);
+
+	centry->priority = image_cache->clean_level +
+		(cost << IMAGE_CACHE_PRIORITY_SHIFT) / size;
 }
 
 /**
@@ -214,6 +425,689 @@ static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
 		image_cache->peak_conversions = centry->conversion_count;
 		image_cache->peak_conversions_size = centry->bitmap_size;
 	}
+
+	image_cache__touch(centry);
+}
+
+/**
+ * Set the bitmap of an image cache entry, replacing any it already has
+ *
+ * \param centry The image cache entry.
+ * \param bitmap The converted bitmap.
+ * \param width The display width converted for, 0 for intrinsic size.
+ * \param height The display height converted for, 0 for intrinsic size.
+ */
+static void
+image_cache__set_bitmap(struct image_cache_entry_s *centry,
+			struct bitmap *bitmap,
+			int width,
+			int height)
+{
+	if (centry->bitmap != NULL) {
+		guit->bitmap->destroy(centry->bitmap);
+		image_cache->total_bitmap_size -= centry->bitmap_size;
+		image_cache->bitmap_count--;
+	}
+
+	centry->bitmap = bitmap;
+	centry->scale_width = width;
+	centry->scale_height = height;
+	centry->scale_age = image_cache->current_age;
+
+	if (width == 0) {
+		centry->bitmap_size = centry->content->width *
+			centry->content->height * 4llu;
+	} else {
+		centry->bitmap_size = guit->bitmap->get_width(bitmap) *
+			guit->bitmap->get_height(bitmap) * 4llu;
+	}
+
+	image_cache_stats_bitmap_add(centry);
+}
+
+/**
+ * Record the outcome of converting an entry on a read
+ *
+ * \param centry The image cache entry which was converted.
+ * \param bitmap The converted bitmap or NULL if conversion failed.
+ * \param width The display width converted for, 0 for intrinsic size.
+ * \param height The display height converted for, 0 for intrinsic size.
+ */
+static void
+image_cache__converted(struct image_cache_entry_s *centry,
+		       struct bitmap *bitmap,
+		       int width,
+		       int height)
+{
+	if (bitmap != NULL) {
+		image_cache__set_bitmap(centry, bitmap, width, height);
+		image_cache->miss_count++;
+		image_cache->miss_size += centry->bitmap_size;
+		if (centry->evicted) {
+			image_cache->reconvert_count++;
+			centry->evicted = false;
+		}
+	} else {
+		image_cache->fail_count++;
+		image_cache->fail_size += centry->bitmap_size;
+		if (width != 0) {
+			/* only convert at intrinsic size from now on */
+			centry->convert_scaled = NULL;
+		}
+	}
+}
+
+/**
+ * Convert an image cache entry's content into a bitmap
+ *
+ * \param centry The image cache entry to convert.
+ * \param width The display width to convert for, 0 for intrinsic size.
+ * \param height The display height to convert for, 0 for intrinsic size.
+ * \return The converted bitmap or NULL on error.
+ */
+static struct bitmap *
+image_cache__convert(struct image_cache_entry_s *centry, int width, int height)
+{
+	if ((width != 0) && (centry->convert_scaled != NULL)) {
+		return centry->convert_scaled(centry->content, width, height);
+	}
+
+	if (centry->convert != NULL) {
+		return centry->convert(centry->content);
+	}
+
+	return NULL;
+}
+
+/**
+ * Determine the size to convert an image cache entry for a redraw at
+ *
+ * Contents displayed at half their intrinsic size or less are
+ * converted at the displayed size if the content handler can do so.
+ *
+ * \param centry The image cache entry being redrawn.
+ * \param data The redraw data giving the displayed size.
+ * \param width Updated with the width to convert for, 0 for intrinsic size.
+ * \param height Updated with the height to convert for, 0 for intrinsic size.
+ */
+static void
+image_cache__request(struct image_cache_entry_s *centry,
+		     const struct content_redraw_data *data,
+		     int *width,
+		     int *height)
+{
+	const struct content *c = centry->content;
+
+	*width = 0;
+	*height = 0;
+
+	if ((centry->convert_scaled == NULL) ||
+	    ((c->width * c->height * 4llu) < IMAGE_CACHE_SCALE_MIN_SIZE) ||
+	    (data->width <= 0) ||
+	    (data->height <= 0) ||
+	    ((data->width * 2) > c->width) ||
+	    ((data->height * 2) > c->height)) {
+		return;
+	}
+
+	*width = data->width;
+	*height = data->height;
+}
+
+/**
+ * Check whether an image cache entry's bitmap suits a size
+ *
+ * A bitmap suits a size if it is at least that big and not twice as
+ * big in both dimensions. A bitmap which is too big continues to suit
+ * while it is still drawn at the size it was converted for so an image
+ * drawn at two sizes is not repeatedly converted. Records the use of
+ * the bitmap at the size it was converted for.
+ *
+ * \param centry The image cache entry.
+ * \param width The display width required, 0 for intrinsic size.
+ * \param height The display height required, 0 for intrinsic size.
+ * \return true if the entry's bitmap may be used else false.
+ */
+static bool
+image_cache__fits(struct image_cache_entry_s *centry, int width, int height)
+{
+	const struct content *c = centry->content;
+	int scale_width;
+	int scale_height;
+
+	if (centry->bitmap == NULL) {
+		return false;
+	}
+
+	if (width == 0) {
+		if (centry->scale_width != 0) {
+			return false;
+		}
+		width = c->width;
+		height = c->height;
+	}
+
+	if (centry->scale_width == 0) {
+		scale_width = c->width;
+		scale_height = c->height;
+	} else {
+		scale_width = centry->scale_width;
+		scale_height = centry->scale_height;
+	}
+
+	if ((scale_width != width || scale_height != height) &&
+	    ((guit->bitmap->get_width(centry->bitmap) < width) ||
+	     (guit->bitmap->get_height(centry->bitmap) < height))) {
+		/* too small */
+		return false;
+	}
+
+	if (((width * 2) <= scale_width) && ((height * 2) <= scale_height)) {
+		/* too big, but keep it while it is in use at its size */
+		return ((image_cache->current_age - centry->scale_age) <=
+			image_cache->params.bg_clean_time);
+	}
+
+	centry->scale_age = image_cache->current_age;
+
+	return true;
+}
+
+#ifdef WITH_THREADS
+/**
+ * Decode worker thread.
+ *
+ * \param p The decoder state.
+ * \return NULL
+ */
+static void *image_cache__decode_main(void *p)
+{
+	struct image_cache_decoder *decoder = p;
+	struct image_cache_job *job;
+	struct bitmap *bitmap;
+	int width;
+	int height;
+
+	pthread_mutex_lock(&decoder->lock);
+	for (;;) {
+		while ((decoder->pending == NULL) && (decoder->quit == false)) {
+			pthread_cond_wait(&decoder->cond, &decoder->lock);
+		}
+		if (decoder->quit) {
+			break;
+		}
+
+		job = decoder->pending;
+		decoder->pending = job->next;
+		if (decoder->pending == NULL) {
+			decoder->pending_tail = &decoder->pending;
+		}
+		job->state = IMAGE_CACHE_JOB_RUNNING;
+		width = job->width;
+		height = job->height;
+		pthread_mutex_unlock(&decoder->lock);
+
+		if (width != 0) {
+			bitmap = job->convert_scaled(job->content,
+						     width,
+						     height);
+		} else {
+			bitmap = job->convert(job->content);
+		}
+
+		pthread_mutex_lock(&decoder->lock);
+		job->bitmap = bitmap;
+		job->state = IMAGE_CACHE_JOB_DONE;
+		job->next = decoder->complete;
+		decoder->complete = job;
+		pthread_cond_broadcast(&decoder->done);
+	}
+	pthread_mutex_unlock(&decoder->lock);
+
+	return NULL;
+}
+
+/**
+ * Remove a job from a queue.
+ *
+ * Must be called with the decoder lock held.
+ *
+ * \param list The queue the job is on.
+ * \param job The job to remove.
+ * \return The link which referred to the job.
+ */
+static struct image_cache_job **
+image_cache__job_unlink(struct image_cache_job **list,
+			struct image_cache_job *job)
+{
+	while (*list != job) {
+		list = &(*list)->next;
+	}
+	*list = job->next;
+	job->next = NULL;
+
+	return list;
+}
+
+/**
+ * Take an entry's background conversion back from the decode workers.
+ *
+ * Waits for the conversion if a worker is running it.
+ *
+ * \param centry The image cache entry.
+ * \param width Updated with the display width converted for.
+ * \param height Updated with the display height converted for.
+ * \return The converted bitmap, now owned by the caller, or NULL if the
+ *         entry had no conversion, it had not started or it failed.
+ */
+static struct bitmap *
+image_cache__withdraw(struct image_cache_entry_s *centry, int *width, int *height)
+{
+	struct image_cache_decoder *decoder = image_cache->decoder;
+	struct image_cache_job *job = centry->job;
+	struct bitmap *bitmap;
+
+	if (job == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_lock(&decoder->lock);
+	while (job->state == IMAGE_CACHE_JOB_RUNNING) {
+		pthread_cond_wait(&decoder->done, &decoder->lock);
+	}
+	if (job->state == IMAGE_CACHE_JOB_QUEUED) {
+		struct image_cache_job **link;
+
+		link = image_cache__job_unlink(&decoder->pending, job);
+		if (decoder->pending_tail == &job->next) {
+			decoder->pending_tail = link;
+		}
+	} else {
+		image_cache__job_unlink(&decoder->complete, job);
+	}
+	pthread_mutex_unlock(&decoder->lock);
+
+	bitmap = job->bitmap;
+	*width = job->width;
+	*height = job->height;
+
+	centry->job = NULL;
+	decoder->outstanding--;
+	decoder->outstanding_size -= job->size;
+	free(job);
+
+	return bitmap;
+}
+
+/**
+ * Collect conversions finished by the decode workers.
+ *
+ * Scheduled while conversions are outstanding. Each converted content
+ * is asked to redraw in place of what was plotted while it converted.
+ *
+ * \param p The image cache context.
+ */
+static void image_cache__reap(void *p)
+{
+	struct image_cache_s *icache = p;
+	struct image_cache_decoder *decoder = icache->decoder;
+	struct image_cache_job *job;
+	struct image_cache_job *next;
+
+	pthread_mutex_lock(&decoder->lock);
+	job = decoder->complete;
+	decoder->complete = NULL;
+	pthread_mutex_unlock(&decoder->lock);
+
+	for (; job != NULL; job = next) {
+		struct image_cache_entry_s *centry = job->centry;
+
+		next = job->next;
+
+		centry->job = NULL;
+		decoder->outstanding--;
+		decoder->outstanding_size -= job->size;
+
+		if (job->bitmap != NULL) {
+			union content_msg_data data;
+
+			/* replaces any bitmap converted for another size */
+			image_cache__converted(centry,
+					       job->bitmap,
+					       job->width,
+					       job->height);
+
+			data.redraw.x = 0;
+			data.redraw.y = 0;
+			data.redraw.width = centry->content->width;
+			data.redraw.height = centry->content->height;
+			content_broadcast(centry->content,
+					  CONTENT_MSG_REDRAW,
+					  &data);
+		} else {
+			/* leave any retry to a synchronous conversion */
+			image_cache__converted(centry,
+					       NULL,
+					       job->width,
+					       job->height);
+			centry->background_failed = true;
+		}
+
+		free(job);
+	}
+
+	if (decoder->outstanding > 0) {
+		guit->misc->schedule(IMAGE_CACHE_REAP_TIME,
+				     image_cache__reap,
+				     icache);
+	}
+}
+
+/**
+ * Queue an entry for conversion by the decode workers.
+ *
+ * \param centry The image cache entry to convert.
+ * \param urgent The bitmap is wanted for display so the conversion
+ *               should be run ahead of speculative ones.
+ * \param width The display width to convert for, 0 for intrinsic size.
+ * \param height The display height to convert for, 0 for intrinsic size.
+ * \return true if the conversion is queued or running else false.
+ */
+static bool
+image_cache__queue(struct image_cache_entry_s *centry,
+		   bool urgent,
+		   int width,
+		   int height)
+{
+	struct image_cache_decoder *decoder = image_cache->decoder;
+	struct image_cache_job *job = centry->job;
+
+	if ((decoder == NULL) ||
+	    (centry->background == false) ||
+	    (centry->background_failed == true) ||
+	    (centry->convert == NULL)) {
+		return false;
+	}
+
+	if (job != NULL) {
+		pthread_mutex_lock(&decoder->lock);
+		if (job->state == IMAGE_CACHE_JOB_QUEUED) {
+			/* a started conversion for another size is
+			 * collected and superseded by a later redraw
+			 */
+			job->width = width;
+			job->height = height;
+		}
+		if (urgent) {
+			/* move a speculative conversion to the front */
+			if ((job->state == IMAGE_CACHE_JOB_QUEUED) &&
+			    (decoder->pending != job)) {
+				struct image_cache_job **link;
+
+				link = image_cache__job_unlink(
+					&decoder->pending, job);
+				if (decoder->pending_tail == &job->next) {
+					decoder->pending_tail = link;
+				}
+				job->next = decoder->pending;
+				decoder->pending = job;
+			}
+		}
+		pthread_mutex_unlock(&decoder->lock);
+		return true;
+	}
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL) {
+		return false;
+	}
+	job->centry = centry;
+	job->content = centry->content;
+	job->convert = centry->convert;
+	job->convert_scaled = centry->convert_scaled;
+	job->width = width;
+	job->height = height;
+	if (width == 0) {
+		job->size = centry->content->width *
+			centry->content->height * 4llu;
+	} else {
+		job->size = width * height * 4llu;
+	}
+	job->state = IMAGE_CACHE_JOB_QUEUED;
+
+	pthread_mutex_lock(&decoder->lock);
+	if (urgent) {
+		job->next = decoder->pending;
+		decoder->pending = job;
+		if (job->next == NULL) {
+			decoder->pending_tail = &job->next;
+		}
+	} else {
+		*decoder->pending_tail = job;
+		decoder->pending_tail = &job->next;
+	}
+	pthread_cond_signal(&decoder->cond);
+	pthread_mutex_unlock(&decoder->lock);
+
+	centry->job = job;
+	decoder->outstanding_size += job->size;
+	if (decoder->outstanding++ == 0) {
+		guit->misc->schedule(IMAGE_CACHE_REAP_TIME,
+				     image_cache__reap,
+				     image_cache);
+	}
+
+	return true;
+}
+
+/**
+ * Speculatively queue a newly added entry for background conversion.
+ *
+ * Background conversion does not hold up the browser so any image
+ * which fits within the cache limit is converted ahead of its first
+ * redraw.
+ *
+ * \param centry The image cache entry to convert.
+ * \return true if the conversion was queued else false.
+ */
+static bool image_cache__speculate_background(struct image_cache_entry_s *centry)
+{
+	if ((image_cache->decoder == NULL) ||
+	    ((image_cache->total_bitmap_size +
+	      image_cache->decoder->outstanding_size +
+	      centry->content->width * centry->content->height * 4llu) >
+	     image_cache->params.limit)) {
+		return false;
+	}
+
+	return image_cache__queue(centry, false, 0, 0);
+}
+
+/**
+ * Start the decode worker threads.
+ *
+ * \param icache The image cache context.
+ * \return NSERROR_OK on success else error code.
+ */
+static nserror image_cache__decoder_start(struct image_cache_s *icache)
+{
+	struct image_cache_decoder *decoder;
+	long cpus;
+	unsigned int count;
+
+	/* leave a processor for the browser itself */
+	cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	if (cpus <= 2) {
+		count = 1;
+	} else if (cpus > IMAGE_CACHE_MAX_WORKERS) {
+		count = IMAGE_CACHE_MAX_WORKERS;
+	} else {
+		count = cpus - 1;
+	}
+
+	decoder = calloc(1, sizeof(*decoder));
+	if (decoder == NULL) {
+		return NSERROR_NOMEM;
+	}
+	decoder->pending_tail = &decoder->pending;
+
+	if (pthread_mutex_init(&decoder->lock, NULL) != 0) {
+		free(decoder);
+		return NSERROR_INIT_FAILED;
+	}
+	if (pthread_cond_init(&decoder->cond, NULL) != 0) {
+		pthread_mutex_destroy(&decoder->lock);
+		free(decoder);
+		return NSERROR_INIT_FAILED;
+	}
+	if (pthread_cond_init(&decoder->done, NULL) != 0) {
+		pthread_cond_destroy(&decoder->cond);
+		pthread_mutex_destroy(&decoder->lock);
+		free(decoder);
+		return NSERROR_INIT_FAILED;
+	}
+
+	while (decoder->thread_count < count) {
+		if (pthread_create(&decoder->threads[decoder->thread_count],
+				   NULL,
+				   image_cache__decode_main,
+				   decoder) != 0) {
+			break;
+		}
+		decoder->thread_count++;
+	}
+
+	if (decoder->thread_count == 0) {
+		pthread_cond_destroy(&decoder->done);
+		pthread_cond_destroy(&decoder->cond);
+		pthread_mutex_destroy(&decoder->lock);
+		free(decoder);
+		return NSERROR_INIT_FAILED;
+	}
+
+	icache->decoder = decoder;
+
+	return NSERROR_OK;
+}
+
+/**
+ * Stop the decode worker threads and discard outstanding conversions.
+ *
+ * \param icache The image cache context.
+ */
+static void image_cache__decoder_stop(struct image_cache_s *icache)
+{
+	struct image_cache_decoder *decoder = icache->decoder;
+	struct image_cache_job *lists[2];
+	struct image_cache_job *job;
+	unsigned int idx;
+
+	if (decoder == NULL) {
+		return;
+	}
+
+	guit->misc->schedule(-1, image_cache__reap, icache);
+
+	pthread_mutex_lock(&decoder->lock);
+	decoder->quit = true;
+	pthread_cond_broadcast(&decoder->cond);
+	pthread_mutex_unlock(&decoder->lock);
+
+	for (idx = 0; idx < decoder->thread_count; idx++) {
+		pthread_join(decoder->threads[idx], NULL);
+	}
+
+	lists[0] = decoder->pending;
+	lists[1] = decoder->complete;
+	for (idx = 0; idx < 2; idx++) {
+		while (lists[idx] != NULL) {
+			job = lists[idx];
+			lists[idx] = job->next;
+
+			job->centry->job = NULL;
+			if (job->bitmap != NULL) {
+				guit->bitmap->destroy(job->bitmap);
+			}
+			free(job);
+		}
+	}
+
+	pthread_cond_destroy(&decoder->done);
+	pthread_cond_destroy(&decoder->cond);
+	pthread_mutex_destroy(&decoder->lock);
+	free(decoder);
+
+	icache->decoder = NULL;
+}
+#else
+static inline struct bitmap *
+image_cache__withdraw(struct image_cache_entry_s *centry, int *width, int *height)
+{
+	return NULL;
+}
+
+static inline bool
+image_cache__queue(struct image_cache_entry_s *centry,
+		   bool urgent,
+		   int width,
+		   int height)
+{
+	return false;
+}
+
+static inline bool
+image_cache__speculate_background(struct image_cache_entry_s *centry)
+{
+	return false;
+}
+#endif
+
+/**
+ * Discard any background conversion of an entry.
+ *
+ * \param centry The image cache entry.
+ */
+static void image_cache__discard(struct image_cache_entry_s *centry)
+{
+	struct bitmap *bitmap;
+	int width;
+	int height;
+
+	bitmap = image_cache__withdraw(centry, &width, &height);
+	if (bitmap != NULL) {
+		guit->bitmap->destroy(bitmap);
+	}
+}
+
+/**
+ * Ensure an entry has a bitmap suiting a size, converting it now if needed.
+ *
+ * The result of any background conversion is used first as it was
+ * requested more recently than the entry's bitmap was converted.
+ *
+ * \param centry The image cache entry.
+ * \param width The display width required, 0 for intrinsic size.
+ * \param height The display height required, 0 for intrinsic size.
+ */
+static void
+image_cache__collect(struct image_cache_entry_s *centry, int width, int height)
+{
+	struct bitmap *bitmap;
+	int bitmap_width;
+	int bitmap_height;
+
+	bitmap = image_cache__withdraw(centry, &bitmap_width, &bitmap_height);
+	if (bitmap != NULL) {
+		image_cache__converted(centry,
+				       bitmap,
+				       bitmap_width,
+				       bitmap_height);
+	}
+
+	if (image_cache__fits(centry, width, height) == false) {
+		bitmap = image_cache__convert(centry, width, height);
+		image_cache__converted(centry, bitmap, width, height);
+	}
 }
 
 static void image_cache__link(struct image_cache_entry_s *centry)
@@ -277,34 +1171,111 @@ static void image_cache__free_entry(struct image_cache_entry_s *centry)
 		image_cache->total_unrendered++;
 	}
 
+	/* the content is going away so must not be left with a worker */
+	image_cache__discard(centry);
+
 	image_cache__free_bitmap(centry);
 
 	image_cache__unlink(centry);
 
-	free(centry);
+	hashmap_remove(image_cache->entry_map, centry->content);
+}
+
+/**
+ * Restore the heap property below a node of the cleaner's heap
+ *
+ * \param heap Array of entries ordered by priority
+ * \param count Number of entries in the heap
+ * \param idx Index of the node to sift down
+ */
+static void
+image_cache__heap_sift_down(struct image_cache_entry_s **heap,
+			    size_t count,
+			    size_t idx)
+{
+	struct image_cache_entry_s *centry = heap[idx];
+
+	for (;;) {
+		size_t child = idx * 2 + 1;
+
+		if (child >= count)
+			break;
+
+		if ((child + 1 < count) &&
+		    (heap[child + 1]->priority < heap[child]->priority))
+			child++;
+
+		if (heap[child]->priority >= centry->priority)
+			break;
+
+		heap[idx] = heap[child];
+		idx = child;
+	}
+
+	heap[idx] = centry;
 }
 
 /**
  * Image cache cleaner
  *
+ * Releases bitmaps with the lowest GreedyDual-Size priority until the
+ * cache is below its limit less the hysteresis. Bitmaps redrawn within
+ * the last clean interval are left alone as they are in active use.
+ *
  * \param icache The image cache context.
  */
 static void image_cache__clean(struct image_cache_s *icache)
 {
-	struct image_cache_entry_s *centry = icache->entries;
+	struct image_cache_entry_s *centry;
+	struct image_cache_entry_s **heap;
+	size_t target;
+	size_t count = 0;
+	size_t idx;
 
-	while (centry != NULL) {
-		if ((icache->current_age - centry->redraw_age) >
-		    icache->params.bg_clean_time) {
-			/* only consider older entries, avoids active entries */
-			if ((icache->total_bitmap_size >
-			     (icache->params.limit - icache->params.hysteresis)) &&
-			    (rand() > (RAND_MAX / 2))) {
-				image_cache__free_bitmap(centry);
-			}
+	if (icache->params.limit < icache->params.hysteresis) {
+		target = 0;
+	} else {
+		target = icache->params.limit - icache->params.hysteresis;
+	}
+
+	if ((icache->total_bitmap_size <= target) ||
+	    (icache->bitmap_count <= 0)) {
+		return;
+	}
+
+	heap = malloc(icache->bitmap_count * sizeof(*heap));
+	if (heap == NULL) {
+		return;
+	}
+
+	for (centry = icache->entries; centry != NULL; centry = centry->next) {
+		if ((centry->bitmap != NULL) &&
+		    ((icache->current_age - centry->redraw_age) >
+		     icache->params.bg_clean_time)) {
+			heap[count++] = centry;
 		}
-		centry=centry->next;
 	}
+
+	for (idx = count / 2; idx > 0; idx--) {
+		image_cache__heap_sift_down(heap, count, idx - 1);
+	}
+
+	while ((count > 0) && (icache->total_bitmap_size > target)) {
+		centry = heap[0];
+		heap[0] = heap[--count];
+		image_cache__heap_sift_down(heap, count, 0);
+
+		/* later uses must outrank what was released */
+		if (centry->priority > icache->clean_level) {
+			icache->clean_level = centry->priority;
+		}
+
+		image_cache__free_bitmap(centry);
+		centry->evicted = true;
+		icache->evict_count++;
+	}
+
+	free(heap);
 }
 
 /**
@@ -336,22 +1307,18 @@ struct bitmap *image_cache_get_bitmap(const struct content *c)
 		return NULL;
 	}
 
-	if (centry->bitmap == NULL) {
-		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
-		}
-
-		if (centry->bitmap != NULL) {
-			image_cache_stats_bitmap_add(centry);
-			image_cache->miss_count++;
-			image_cache->miss_size += centry->bitmap_size;
-		} else {
-			image_cache->fail_count++;
-			image_cache->fail_size += centry->bitmap_size;
+	if (image_cache__fits(centry, 0, 0) == false) {
+		/* needed now at intrinsic size, so take any background
+		 * conversion over
+		 */
+		image_cache__collect(centry, 0, 0);
+		if (image_cache__fits(centry, 0, 0) == false) {
+			return NULL;
 		}
 	} else {
 		image_cache->hit_count++;
 		image_cache->hit_size += centry->bitmap_size;
+		image_cache__touch(centry);
 	}
 
 	return centry->bitmap;
@@ -397,6 +1364,21 @@ image_cache_init(const struct image_cache_parameters *image_cache_parameters)
 
 	image_cache->params = *image_cache_parameters;
 
+	image_cache->entry_map = hashmap_create(
+		&image_cache_entry_map_parameters);
+	if (image_cache->entry_map == NULL) {
+		free(image_cache);
+		image_cache = NULL;
+		return NSERROR_NOMEM;
+	}
+
+#ifdef WITH_THREADS
+	if (image_cache__decoder_start(image_cache) != NSERROR_OK) {
+		NSLOG(neosurf, WARNING,
+		      "Unable to start decode workers, converting synchronously");
+	}
+#endif
+
 	guit->misc->schedule(image_cache->params.bg_clean_time,
 				image_cache__background_update,
 				image_cache);
@@ -417,6 +1399,10 @@ nserror image_cache_fini(void)
 
 	guit->misc->schedule(-1, image_cache__background_update, image_cache);
 
+#ifdef WITH_THREADS
+	image_cache__decoder_stop(image_cache);
+#endif
+
 	NSLOG(neosurf, INFO, "Size at finish %"PRIsizet" (in %d)",
 	      image_cache->total_bitmap_size, image_cache->bitmap_count);
 
@@ -476,15 +1462,34 @@ nserror image_cache_fini(void)
 	      image_cache->peak_conversions_size,
 	      image_cache->peak_conversions);
 
+	NSLOG(neosurf, INFO,
+	      "Cleaner released %d bitmaps of which %d were read again",
+	      image_cache->evict_count,
+	      image_cache->reconvert_count);
+
+	hashmap_destroy(image_cache->entry_map);
+
 	free(image_cache);
 
 	return NSERROR_OK;
 }
 
-/* exported interface documented in image_cache.h */
-nserror image_cache_add(struct content *content,
-			struct bitmap *bitmap,
-			image_cache_convert_fn *convert)
+/**
+ * Add a content to the cache.
+ *
+ * \param content The content the bitmap belongs to.
+ * \param bitmap The converted bitmap or NULL to convert on demand.
+ * \param convert The function to convert the content with.
+ * \param convert_scaled The function to convert the content at display
+ *                       size with or NULL.
+ * \param background The conversion may be run on a decode worker.
+ * \return NSERROR_OK on success else error code.
+ */
+static nserror image_cache__add(struct content *content,
+				struct bitmap *bitmap,
+				image_cache_convert_fn *convert,
+				image_cache_convert_scaled_fn *convert_scaled,
+				bool background)
 {
 	struct image_cache_entry_s *centry;
 
@@ -496,7 +1501,7 @@ nserror image_cache_add(struct content *content,
 	centry = image_cache__find(content);
 	if (centry == NULL) {
 		/* new cache entry, content not previously added */
-		centry = calloc(1, sizeof(struct image_cache_entry_s));
+		centry = hashmap_insert(image_cache->entry_map, content);
 		if (centry == NULL) {
 			return NSERROR_NOMEM;
 		}
@@ -509,33 +1514,63 @@ nserror image_cache_add(struct content *content,
 	NSLOG(neosurf, INFO, "centry %p, content %p, bitmap %p", centry,
 	      content, bitmap);
 
+	/* any conversion in progress is of the previous source data */
+	image_cache__discard(centry);
+
 	centry->convert = convert;
+	centry->convert_scaled = convert_scaled;
+	centry->background = background;
+	centry->background_failed = false;
 
 	/* set bitmap entry if one is passed, free extant one if present */
 	if (bitmap != NULL) {
-		if (centry->bitmap != NULL) {
-			guit->bitmap->destroy(centry->bitmap);
-		} else {
-			image_cache_stats_bitmap_add(centry);
-		}
-		centry->bitmap = bitmap;
-	} else {
-		/* no bitmap, check to see if we should speculatively convert */
-		if ((centry->convert != NULL) &&
-		    (image_cache_speculate(content) == true)) {
-			centry->bitmap = centry->convert(centry->content);
-
-			if (centry->bitmap != NULL) {
-				image_cache_stats_bitmap_add(centry);
+		image_cache__set_bitmap(centry, bitmap, 0, 0);
+	} else if ((centry->bitmap == NULL) &&
+		   (centry->convert != NULL) &&
+		   ((centry->convert_scaled == NULL) ||
+		    ((content->width * content->height * 4llu) <
+		     IMAGE_CACHE_SCALE_MIN_SIZE)) &&
+		   (image_cache__speculate_background(centry) == false)) {
+		/* no bitmap, check to see if we should speculatively
+		 * convert. Images which may be converted at display size
+		 * wait until that is known at their first redraw.
+		 */
+		if (image_cache_speculate(content) == true) {
+			bitmap = centry->convert(centry->content);
+
+			if (bitmap != NULL) {
+				image_cache__set_bitmap(centry, bitmap, 0, 0);
 			} else {
 				image_cache->fail_count++;
 			}
 		}
 	}
 
+	return NSERROR_OK;
+}
 
+/* exported interface documented in image_cache.h */
+nserror image_cache_add(struct content *content,
+			struct bitmap *bitmap,
+			image_cache_convert_fn *convert)
+{
+	return image_cache__add(content, bitmap, convert, NULL, false);
+}
 
-	return NSERROR_OK;
+/* exported interface documented in image_cache.h */
+nserror image_cache_add_background(struct content *content,
+				   struct bitmap *bitmap,
+				   image_cache_convert_fn *convert)
+{
+	return image_cache__add(content, bitmap, convert, NULL, true);
+}
+
+/* exported interface documented in image_cache.h */
+nserror image_cache_add_scaled(struct content *content,
+			       image_cache_convert_fn *convert,
+			       image_cache_convert_scaled_fn *convert_scaled)
+{
+	return image_cache__add(content, NULL, convert, convert_scaled, true);
 }
 
 /* exported interface documented in image_cache.h */
@@ -642,6 +1677,8 @@ case chr :					\
 			FMTCHR('v', "d", total_extra_conversions_count);
 			FMTCHR('w', "u", peak_conversions_size);
 			FMTCHR('x', "d", peak_conversions);
+			FMTCHR('y', "d", evict_count);
+			FMTPCHR('z', "d", reconvert_count, op_count);
 
 
 			}
@@ -776,6 +1813,8 @@ bool image_cache_redraw(struct content *c,
 			const struct redraw_context *ctx)
 {
 	struct image_cache_entry_s *centry;
+	int width;
+	int height;
 
 	/* get the cache entry */
 	centry = image_cache__find(c);
@@ -785,23 +1824,33 @@ bool image_cache_redraw(struct content *c,
 		return false;
 	}
 
-	if (centry->bitmap == NULL) {
-		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
-		}
+	image_cache__request(centry, data, &width, &height);
 
-		if (centry->bitmap != NULL) {
-			image_cache_stats_bitmap_add(centry);
-			image_cache->miss_count++;
-			image_cache->miss_size += centry->bitmap_size;
+	if (image_cache__fits(centry, width, height) == false) {
+		if (ctx->interactive &&
+		    image_cache__queue(centry, true, width, height)) {
+			if (centry->bitmap == NULL) {
+				/* plot nothing until a worker has
+				 * converted it
+				 */
+				return true;
+			}
+			/* plot the bitmap converted for another size
+			 * until then
+			 */
+			image_cache->hit_count++;
+			image_cache->hit_size += centry->bitmap_size;
+			image_cache__touch(centry);
 		} else {
-			image_cache->fail_count++;
-			image_cache->fail_size += centry->bitmap_size;
-			return false;
+			image_cache__collect(centry, width, height);
+			if (centry->bitmap == NULL) {
+				return false;
+			}
 		}
 	} else {
 		image_cache->hit_count++;
 		image_cache->hit_size += centry->bitmap_size;
+		image_cache__touch(centry);
 	}
 
 
@@ -837,7 +1886,12 @@ void *image_cache_get_internal(const struct content *c, void *context)
 bool image_cache_is_opaque(struct content *c)
 {
 	struct bitmap *bmp;
-	bmp = image_cache_get_bitmap(c);
+
+	/* a bitmap converted at display size is as opaque as any other */
+	bmp = image_cache_find_bitmap(c);
+	if (bmp == NULL) {
+		bmp = image_cache_get_bitmap(c);
+	}
 	if (bmp != NULL) {
 		return guit->bitmap->get_opaque(bmp);
 	}
@@ -46,6 +46,22 @@ struct redraw_context;
 
 typedef struct bitmap * (image_cache_convert_fn) (struct content *content);
 
+/**
+ * Convert a content into a bitmap for display at a reduced size.
+ *
+ * The bitmap may be larger than requested, as decoders can often only
+ * scale by fixed factors, but must be no smaller unless it is the
+ * content's intrinsic size.
+ *
+ * \param content The content to convert.
+ * \param width The width the content will be displayed at.
+ * \param height The height the content will be displayed at.
+ * \return The converted bitmap or NULL on error.
+ */
+typedef struct bitmap * (image_cache_convert_scaled_fn) (struct content *content,
+							 int width,
+							 int height);
+
 struct image_cache_parameters {
 	/** How frequently the background cache clean process is run (ms) */
 	unsigned int bg_clean_time;
@@ -78,6 +94,44 @@ nserror image_cache_add(struct content *content,
 			struct bitmap *bitmap, 
 			image_cache_convert_fn *convert);
 
+/** adds an image content to be cached, converting it in the background.
+ *
+ * As image_cache_add() except that conversions for interactive redraw
+ * may be run on a decode worker thread, with nothing plotted for the
+ * image until its bitmap is ready. The convert function must only read
+ * the content's source data and use the bitmap operations which the
+ * frontend's bitmap table allows on other threads.
+ *
+ * Without worker thread support this is the same as image_cache_add().
+ *
+ * @param content The content handle used as a key
+ * @param bitmap A bitmap representing the already converted content or NULL.
+ * @param convert A function pointer to convert the content into a bitmap.
+ * @return A netsurf error code.
+ */
+nserror image_cache_add_background(struct content *content,
+				   struct bitmap *bitmap,
+				   image_cache_convert_fn *convert);
+
+/** adds an image content to be cached, converting it at its displayed size.
+ *
+ * As image_cache_add_background() except that when the content is
+ * displayed at half its intrinsic size or less it is converted at the
+ * displayed size with convert_scaled. The bitmap is converted again
+ * when the display size changes. Callers wanting the intrinsic size
+ * bitmap, such as image_cache_get_bitmap(), are given one made with
+ * convert.
+ *
+ * @param content The content handle used as a key
+ * @param convert A function pointer to convert the content into a bitmap.
+ * @param convert_scaled A function pointer to convert the content into
+ *                       a bitmap for a given display size.
+ * @return A netsurf error code.
+ */
+nserror image_cache_add_scaled(struct content *content,
+			       image_cache_convert_fn *convert,
+			       image_cache_convert_scaled_fn *convert_scaled);
+
 nserror image_cache_remove(struct content *content);
 
 
@@ -156,6 +210,10 @@ int image_cache_snentryf(char *string, size_t size, unsigned int entryn,
  *     of times.
  * x The number of times the image that was converted (read missed cache) 
  *     highest number of times.
+ * y The number of bitmaps released by the cache cleaner.
+ * z The total number of read operations which had to reconvert a bitmap
+ *     released by the cache cleaner. ie. the misses caused by the
+ *     replacement policy.
  *
  * format modifiers:
  * A p before the value modifies the replacement to be a percentage.
@@ -160,6 +160,32 @@ static void nsjpeg_error_exit(j_common_ptr cinfo)
 	longjmp(*setjmp_buffer, 1);
 }
 
+/**
+ * Error output handler for bitmap conversion.
+ *
+ * Conversions may run on a decode worker thread so the message is
+ * formatted on the stack rather than in the shared error buffer.
+ */
+static void nsjpeg_cache_error_log(j_common_ptr cinfo)
+{
+	char buffer[JMSG_LENGTH_MAX];
+
+	cinfo->err->format_message(cinfo, buffer);
+	NSLOG(neosurf, INFO, "%s", buffer);
+}
+
+/**
+ * Fatal error handler for bitmap conversion.
+ */
+static void nsjpeg_cache_error_exit(j_common_ptr cinfo)
+{
+	jmp_buf *setjmp_buffer = (jmp_buf *) cinfo->client_data;
+
+	nsjpeg_cache_error_log(cinfo);
+
+	longjmp(*setjmp_buffer, 1);
+}
+
 /**
  * Convert scan lines from CMYK to core client bitmap layout.
  */
@@ -250,9 +276,17 @@ static inline void nsjpeg__decode_client_fmt(
 
 /**
  * create a bitmap from jpeg content.
+ *
+ * When a display size is given the image is decoded with DCT scaling
+ * at the smallest eighth of its size no smaller than the display size.
+ *
+ * \param c The jpeg content.
+ * \param width The display width or 0 to decode at intrinsic size.
+ * \param height The display height or 0 to decode at intrinsic size.
+ * \return The decoded bitmap or NULL on error.
  */
 static struct bitmap *
-jpeg_cache_convert(struct content *c)
+jpeg_cache_decode(struct content *c, int width, int height)
 {
 	const uint8_t *source_data; /* Jpeg source data */
 	size_t source_size; /* length of Jpeg source data */
@@ -281,8 +315,8 @@ jpeg_cache_convert(struct content *c)
 
 	/* setup a JPEG library error handler */
 	cinfo.err = jpeg_std_error(&jerr);
-	jerr.error_exit = nsjpeg_error_exit;
-	jerr.output_message = nsjpeg_error_log;
+	jerr.error_exit = nsjpeg_cache_error_exit;
+	jerr.output_message = nsjpeg_cache_error_log;
 
 	/* handler for fatal errors during decompression */
 	if (setjmp(setjmp_buffer)) {
@@ -332,6 +366,20 @@ jpeg_cache_convert(struct content *c)
 	}
 	cinfo.dct_method = JDCT_ISLOW;
 
+	if ((width > 0) && (height > 0)) {
+		unsigned int scale_num = 1;
+
+		while ((scale_num < DCTSIZE) &&
+		       ((cinfo.image_width * scale_num <
+			 (unsigned int)width * DCTSIZE) ||
+			(cinfo.image_height * scale_num <
+			 (unsigned int)height * DCTSIZE))) {
+			scale_num++;
+		}
+		cinfo.scale_num = scale_num;
+		cinfo.scale_denom = DCTSIZE;
+	}
+
 	/* commence the decompression, output parameters now valid */
 	jpeg_start_decompress(&cinfo);
 
@@ -378,6 +426,23 @@ jpeg_cache_convert(struct content *c)
 	return bitmap;
 }
 
+/**
+ * create a bitmap from jpeg content at its intrinsic size.
+ */
+static struct bitmap *jpeg_cache_convert(struct content *c)
+{
+	return jpeg_cache_decode(c, 0, 0);
+}
+
+/**
+ * create a bitmap from jpeg content for display at a reduced size.
+ */
+static struct bitmap *
+jpeg_cache_convert_scaled(struct content *c, int width, int height)
+{
+	return jpeg_cache_decode(c, width, height);
+}
+
 /**
  * Convert a CONTENT_JPEG for display.
  */
@@ -428,7 +493,7 @@ static bool nsjpeg_convert(struct content *c)
 
 	jpeg_destroy_decompress(&cinfo);
 
-	image_cache_add(c, NULL, jpeg_cache_convert);
+	image_cache_add_scaled(c, jpeg_cache_convert, jpeg_cache_convert_scaled);
 
 	/* set title text */
 	title = messages_get_buff("JPEGTitle",
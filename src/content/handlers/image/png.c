@@ -580,7 +580,7 @@ static bool nspng_convert(struct content *c)
 		guit->bitmap->modified(png_c->bitmap);
 	}
 
-	image_cache_add(c, png_c->bitmap, png_cache_convert);
+	image_cache_add_background(c, png_c->bitmap, png_cache_convert);
 
 	content_set_ready(c);
 	content_set_done(c);
@@ -85,17 +85,24 @@ webp_create(const content_handler *handler,
 
 /**
  * create a bitmap from webp content.
+ *
+ * When a display size is given the image is decoded with the library's
+ * scaler straight to that size.
+ *
+ * \param c The webp content.
+ * \param width The display width or 0 to decode at intrinsic size.
+ * \param height The display height or 0 to decode at intrinsic size.
+ * \return The decoded bitmap or NULL on error.
  */
 static struct bitmap *
-webp_cache_convert(struct content *c)
+webp_cache_decode(struct content *c, int width, int height)
 {
 	const uint8_t *source_data; /* webp source data */
 	size_t source_size; /* length of webp source data */
 	VP8StatusCode webpres;
-	WebPBitstreamFeatures webpfeatures;
+	WebPDecoderConfig config;
 	unsigned int bmap_flags;
 	uint8_t *pixels = NULL;
-	uint8_t *decoded;
 	size_t rowstride;
 	struct bitmap *bitmap = NULL;
 	bitmap_fmt_t webp_fmt = {
@@ -104,13 +111,26 @@ webp_cache_convert(struct content *c)
 
 	source_data = content__get_source_data(c, &source_size);
 
-	webpres = WebPGetFeatures(source_data, source_size, &webpfeatures);
+	if (WebPInitDecoderConfig(&config) == 0) {
+		return NULL;
+	}
+
+	webpres = WebPGetFeatures(source_data, source_size, &config.input);
 
 	if (webpres != VP8_STATUS_OK) {
 		return NULL;
 	}
 
-	if (webpfeatures.has_alpha == 0) {
+	if ((width > 0) && (height > 0)) {
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
+	} else {
+		width = config.input.width;
+		height = config.input.height;
+	}
+
+	if (config.input.has_alpha == 0) {
 		bmap_flags = BITMAP_OPAQUE;
 		/* Image has no alpha. Premultiplied alpha makes no difference.
 		 * Optimisation: Avoid unnecessary conversion by copying format.
@@ -121,9 +141,7 @@ webp_cache_convert(struct content *c)
 	}
 
 	/* create bitmap */
-	bitmap = guit->bitmap->create(webpfeatures.width,
-				      webpfeatures.height,
-				      bmap_flags);
+	bitmap = guit->bitmap->create(width, height, bmap_flags);
 	if (bitmap == NULL) {
 		/* empty bitmap could not be created */
 		return NULL;
@@ -144,21 +162,27 @@ webp_cache_convert(struct content *c)
 		webp_fmt.layout = BITMAP_LAYOUT_R8G8B8A8;
 		/* Fall through. */
 	case BITMAP_LAYOUT_R8G8B8A8:
-		decoded = WebPDecodeRGBAInto(source_data, source_size, pixels,
-				rowstride * webpfeatures.height, rowstride);
+		config.output.colorspace = MODE_RGBA;
 		break;
 
 	case BITMAP_LAYOUT_B8G8R8A8:
-		decoded = WebPDecodeBGRAInto(source_data, source_size, pixels,
-				rowstride * webpfeatures.height, rowstride);
+		config.output.colorspace = MODE_BGRA;
 		break;
 
 	case BITMAP_LAYOUT_A8R8G8B8:
-		decoded = WebPDecodeARGBInto(source_data, source_size, pixels,
-				rowstride * webpfeatures.height, rowstride);
+		config.output.colorspace = MODE_ARGB;
 		break;
 	}
-	if (decoded == NULL) {
+
+	/* decode directly into the bitmap */
+	config.output.is_external_memory = 1;
+	config.output.u.RGBA.rgba = pixels;
+	config.output.u.RGBA.stride = rowstride;
+	config.output.u.RGBA.size = rowstride * height;
+
+	webpres = WebPDecode(source_data, source_size, &config);
+	WebPFreeDecBuffer(&config.output);
+	if (webpres != VP8_STATUS_OK) {
 		/* decode failed */
 		guit->bitmap->destroy(bitmap);
 		return NULL;
@@ -170,6 +194,23 @@ webp_cache_convert(struct content *c)
 	return bitmap;
 }
 
+/**
+ * create a bitmap from webp content at its intrinsic size.
+ */
+static struct bitmap *webp_cache_convert(struct content *c)
+{
+	return webp_cache_decode(c, 0, 0);
+}
+
+/**
+ * create a bitmap from webp content for display at a reduced size.
+ */
+static struct bitmap *
+webp_cache_convert_scaled(struct content *c, int width, int height)
+{
+	return webp_cache_decode(c, width, height);
+}
+
 /**
  * Convert the webp source data content.
  *
@@ -200,7 +241,7 @@ static bool webp_convert(struct content *c)
 	c->height = height;
 	c->size = c->width * c->height * 4;
 
-	image_cache_add(c, NULL, webp_cache_convert);
+	image_cache_add_scaled(c, webp_cache_convert, webp_cache_convert_scaled);
 
 	content_set_ready(c);
 	content_set_done(c);
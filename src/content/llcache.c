@@ -170,6 +170,9 @@ struct llcache_object {
 	llcache_object *prev;	     /**< Previous in list */
 	llcache_object *next;	     /**< Next in list */
 
+	llcache_object *hash_prev;   /**< Previous in URL hash chain */
+	llcache_object *hash_next;   /**< Next in URL hash chain */
+
 	nsurl *url;		     /**< Post-redirect URL for object */
 
 	/** \todo We need a generic dynamic buffer object */
@@ -214,6 +217,21 @@ struct llcache_s {
 	/** Head of the low-level uncached object list */
 	llcache_object *uncached_objects;
 
+	/**
+	 * URL hash index of the cached object list.
+	 *
+	 * Each bucket is a chain of objects linked through
+	 * llcache_object::hash_next with the most recently inserted
+	 * (and hence most recently requested) object at the head.
+	 */
+	llcache_object **cached_index;
+
+	/** Number of buckets in the cached object index (power of two) */
+	uint32_t cached_index_size;
+
+	/** Number of objects in the cached object list */
+	uint32_t cached_count;
+
 	/** The target upper bound for the RAM cache size */
 	uint32_t limit;
 
@@ -263,6 +281,12 @@ struct llcache_s {
 
 };
 
+/** Initial number of buckets in the cached object URL index */
+#define LLCACHE_INDEX_INITIAL_SIZE 256
+
+/** Average chain length at which the cached object URL index is grown */
+#define LLCACHE_INDEX_LOAD_FACTOR 2
+
 /** low level cache state */
 static struct llcache_s *llcache = NULL;
 
@@ -906,6 +930,7 @@ static nserror llcache_object_refetch(llcache_object *object)
 	struct fetch_multipart_data *multipart = NULL;
 	char **headers = NULL;
 	int header_idx = 0;
+	fetch_priority priority;
 	nserror res;
 
 	if (object->fetch.post != NULL) {
@@ -978,6 +1003,15 @@ static nserror llcache_object_refetch(llcache_object *object)
 
 	NSLOG(llcache, DEBUG, "Re-fetching %p", object);
 
+	/* Determine the dispatch priority */
+	if ((object->fetch.flags & LLCACHE_RETRIEVE_PRIORITY_HIGH) != 0) {
+		priority = FETCH_PRIORITY_HIGH;
+	} else if ((object->fetch.flags & LLCACHE_RETRIEVE_PRIORITY_LOW) != 0) {
+		priority = FETCH_PRIORITY_LOW;
+	} else {
+		priority = FETCH_PRIORITY_NORMAL;
+	}
+
 	/* Kick off fetch */
 	res = fetch_start(object->url,
 			  object->fetch.referer,
@@ -988,6 +1022,7 @@ static nserror llcache_object_refetch(llcache_object *object)
 			  multipart,
 			  object->fetch.flags & LLCACHE_RETRIEVE_VERIFIABLE,
 			  object->fetch.tried_with_tls_downgrade,
+			  priority,
 			  (const char **)headers,
 			  &object->fetch.fetch);
 
@@ -1277,6 +1312,148 @@ llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
 	return NSERROR_OK;
 }
 
+/**
+ * Get the URL index bucket for a URL hash
+ *
+ * \param hash The nsurl_hash() of the URL
+ * \return Pointer to the head of the bucket chain
+ */
+static inline llcache_object **llcache_index_bucket(uint32_t hash)
+{
+	return &llcache->cached_index[hash & (llcache->cached_index_size - 1)];
+}
+
+/**
+ * Grow the cached object URL index
+ *
+ * Failure to allocate a larger index is not fatal, the existing index
+ * simply continues to be used with longer chains.
+ *
+ * \param size The new number of buckets, must be a power of two.
+ */
+static void llcache_index_resize(uint32_t size)
+{
+	llcache_object **old_index = llcache->cached_index;
+	uint32_t old_size = llcache->cached_index_size;
+	llcache_object *object, *next, **bucket;
+	uint32_t idx;
+
+	llcache->cached_index = calloc(size, sizeof(llcache_object *));
+	if (llcache->cached_index == NULL) {
+		llcache->cached_index = old_index;
+		return;
+	}
+	llcache->cached_index_size = size;
+
+	NSLOG(llcache, DEBUG, "Resizing URL index from %u to %u buckets",
+	      old_size, size);
+
+	/* Chains are walked from the tail so the relative order of
+	 * objects with the same URL is preserved in the new chains.
+	 */
+	for (idx = 0; idx < old_size; idx++) {
+		object = old_index[idx];
+		if (object == NULL) {
+			continue;
+		}
+		while (object->hash_next != NULL) {
+			object = object->hash_next;
+		}
+		for (; object != NULL; object = next) {
+			next = object->hash_prev;
+
+			bucket = llcache_index_bucket(nsurl_hash(object->url));
+			object->hash_prev = NULL;
+			object->hash_next = *bucket;
+			if (*bucket != NULL) {
+				(*bucket)->hash_prev = object;
+			}
+			*bucket = object;
+		}
+	}
+
+	free(old_index);
+}
+
+/**
+ * Add a low-level cache object to the cached object list and URL index
+ *
+ * \param object  Object to add
+ * \return NSERROR_OK
+ */
+static nserror llcache_object_add_to_cache(llcache_object *object)
+{
+	llcache_object **bucket;
+
+	llcache_object_add_to_list(object, &llcache->cached_objects);
+
+	if (llcache->cached_count >=
+	    llcache->cached_index_size * LLCACHE_INDEX_LOAD_FACTOR) {
+		llcache_index_resize(llcache->cached_index_size * 2);
+	}
+
+	bucket = llcache_index_bucket(nsurl_hash(object->url));
+	object->hash_prev = NULL;
+	object->hash_next = *bucket;
+	if (*bucket != NULL) {
+		(*bucket)->hash_prev = object;
+	}
+	*bucket = object;
+
+	llcache->cached_count++;
+
+	return NSERROR_OK;
+}
+
+/**
+ * Remove a low-level cache object from the cached object list and URL index
+ *
+ * \param object  Object to remove
+ * \return NSERROR_OK
+ */
+static nserror llcache_object_remove_from_cache(llcache_object *object)
+{
+	llcache_object_remove_from_list(object, &llcache->cached_objects);
+
+	if (object->hash_prev == NULL) {
+		*llcache_index_bucket(nsurl_hash(object->url)) =
+			object->hash_next;
+	} else {
+		object->hash_prev->hash_next = object->hash_next;
+	}
+
+	if (object->hash_next != NULL) {
+		object->hash_next->hash_prev = object->hash_prev;
+	}
+
+	object->hash_prev = object->hash_next = NULL;
+
+	llcache->cached_count--;
+
+	return NSERROR_OK;
+}
+
+/**
+ * Determine if a low-level cache object is in the cached object list
+ *
+ * \param object  Object to search for
+ * \return True if object resides in the cached list, false otherwise
+ */
+static bool llcache_object_in_cache(const llcache_object *object)
+{
+	const llcache_object *obj;
+
+	for (obj = *llcache_index_bucket(nsurl_hash(object->url));
+	     obj != NULL;
+	     obj = obj->hash_next) {
+		if (obj == object) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 /**
  * Retrieve source data for an object from persistent store if necessary.
  *
@@ -1928,8 +2105,13 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	      referer==NULL?"":nsurl_access(referer),
 	      post);
 
-	/* Search for the most recently fetched matching object */
-	for (obj = llcache->cached_objects; obj != NULL; obj = obj->next) {
+	/* Search for the most recently fetched matching object. The
+	 * chain is in insertion order but the request time may since
+	 * have been updated by a refetch so it must still be compared.
+	 */
+	for (obj = *llcache_index_bucket(nsurl_hash(url));
+	     obj != NULL;
+	     obj = obj->hash_next) {
 
 		if ((newest == NULL ||
 		     obj->cache.req_time > newest->cache.req_time) &&
@@ -1960,7 +2142,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			newest = obj;
 
 			/* Add new object to cached object list */
-			llcache_object_add_to_list(obj, &llcache->cached_objects);
+			llcache_object_add_to_cache(obj);
 
 		}
 		/* else no object found and irretrievable from cache,
@@ -1993,7 +2175,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 		 */
 		NSLOG(llcache, DEBUG, "Persistent retrieval failed for %p", newest);
 
-		llcache_object_remove_from_list(newest,	&llcache->cached_objects);
+		llcache_object_remove_from_cache(newest);
 		llcache_object_destroy(newest);
 
 		error = llcache_object_new(url, &obj);
@@ -2035,7 +2217,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 			}
 
 			/* Add new object to cache */
-			llcache_object_add_to_list(obj, &llcache->cached_objects);
+			llcache_object_add_to_cache(obj);
 
 			*result = obj;
 
@@ -2048,8 +2230,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 		 * failed, destroy cache object and fall though to
 		 * cache miss to re-retch
 		 */
-		llcache_object_remove_from_list(newest,
-						&llcache->cached_objects);
+		llcache_object_remove_from_cache(newest);
 		llcache_object_destroy(newest);
 
 		error = llcache_object_new(url, &obj);
@@ -2067,7 +2248,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	}
 
 	/* Add new object to cache */
-	llcache_object_add_to_list(obj, &llcache->cached_objects);
+	llcache_object_add_to_cache(obj);
 
 	*result = obj;
 
@@ -2749,6 +2930,54 @@ static nserror llcache_fetch_timeout(llcache_object *object)
 }
 
 
+/**
+ * An object ranked for eviction or writeout.
+ */
+struct llcache_ranked_object {
+	llcache_object *object; /**< The ranked object or NULL if discarded */
+	double value; /**< The rank value of the object */
+};
+
+/**
+ * Number of seconds since an object was last in use.
+ *
+ * \param object The object to consider.
+ * \param now The current time.
+ * \return The idle time in seconds, zero if the object has users.
+ */
+static inline time_t
+llcache_object_idle_time(const llcache_object *object, time_t now)
+{
+	if ((object->users != NULL) || (object->last_used > now)) {
+		return 0;
+	}
+	return now - object->last_used;
+}
+
+/**
+ * Compare two ranked objects by ascending value.
+ */
+static int llcache_ranked_compar_ascending(const void *a, const void *b)
+{
+	const struct llcache_ranked_object *ra = a;
+	const struct llcache_ranked_object *rb = b;
+
+	if (ra->value < rb->value) {
+		return -1;
+	} else if (ra->value > rb->value) {
+		return 1;
+	}
+	return 0;
+}
+
+/**
+ * Compare two ranked objects by descending value.
+ */
+static int llcache_ranked_compar_descending(const void *a, const void *b)
+{
+	return llcache_ranked_compar_ascending(b, a);
+}
+
 /**
  * Construct a sorted list of objects available for writeout operation.
  *
@@ -2757,7 +2986,8 @@ static nserror llcache_fetch_timeout(llcache_object *object)
  * the configured minimum lifetime are simply not considered, they will
  * become stale before pushing to backing store is worth the cost.
  *
- * \todo calculate useful cost metrics to improve sorting.
+ * The objects are ordered so the most recently used objects with the
+ * longest remaining lifetime are written first.
  *
  * \param[out] lst_out list of candidate objects.
  * \param[out] lst_len_out Number of candidate objects in result.
@@ -2767,21 +2997,23 @@ static nserror llcache_fetch_timeout(llcache_object *object)
 static nserror
 build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 {
-	llcache_object *object, *next;
+#define MAX_PERSIST_PER_RUN 128
+	llcache_object *object;
+	struct llcache_ranked_object ranked[MAX_PERSIST_PER_RUN];
+	struct llcache_ranked_object cand;
 	struct llcache_object **lst;
-	int lst_len = 0;
+	int ranked_len = 0;
+	int idx, child;
 	int remaining_lifetime;
+	time_t now = time(NULL);
 
-#define MAX_PERSIST_PER_RUN 128
-
-	lst = calloc(MAX_PERSIST_PER_RUN, sizeof(struct llcache_object *));
-	if (lst == NULL) {
-		return NSERROR_NOMEM;
-	}
-
-	for (object = llcache->cached_objects; object != NULL; object = next) {
-		next = object->next;
-
+	/* The most valuable objects are selected with a bounded min
+	 * heap, whose root is the least valuable object selected so
+	 * far, so only those written this run are ever sorted.
+	 */
+	for (object = llcache->cached_objects;
+	     object != NULL;
+	     object = object->next) {
 		/* Only consider http(s) for the disc cache. */
 		if (!llcache__scheme_is_persistable(object->url)) {
 			continue;
@@ -2794,25 +3026,62 @@ build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 		 * already on disc and with sufficient lifetime to
 		 * make disc cache worthwhile
 		 */
-		if ((object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_RAM) &&
-		    (remaining_lifetime > llcache->minimum_lifetime)) {
-			lst[lst_len] = object;
-			lst_len++;
-			if (lst_len == MAX_PERSIST_PER_RUN)
-				break;
+		if ((object->candidate_count != 0) ||
+		    (object->fetch.fetch != NULL) ||
+		    (object->store_state != LLCACHE_STATE_RAM) ||
+		    (remaining_lifetime <= llcache->minimum_lifetime)) {
+			continue;
+		}
+
+		cand.object = object;
+		cand.value = (double)remaining_lifetime /
+			(llcache_object_idle_time(object, now) + 1);
+
+		if (ranked_len < MAX_PERSIST_PER_RUN) {
+			/* sift up */
+			idx = ranked_len++;
+			while ((idx > 0) &&
+			       (ranked[(idx - 1) / 2].value > cand.value)) {
+				ranked[idx] = ranked[(idx - 1) / 2];
+				idx = (idx - 1) / 2;
+			}
+			ranked[idx] = cand;
+		} else if (cand.value > ranked[0].value) {
+			/* replace the root and sift down */
+			idx = 0;
+			while ((child = (idx * 2) + 1) < ranked_len) {
+				if ((child + 1 < ranked_len) &&
+				    (ranked[child + 1].value <
+				     ranked[child].value)) {
+					child++;
+				}
+				if (ranked[child].value >= cand.value) {
+					break;
+				}
+				ranked[idx] = ranked[child];
+				idx = child;
+			}
+			ranked[idx] = cand;
 		}
 	}
 
-	if (lst_len == 0) {
-		free(lst);
+	if (ranked_len == 0) {
 		return NSERROR_NOT_FOUND;
 	}
 
-	/** \todo sort list here */
+	qsort(ranked, ranked_len, sizeof(*ranked),
+	      llcache_ranked_compar_descending);
+
+	lst = calloc(ranked_len, sizeof(struct llcache_object *));
+	if (lst == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	for (idx = 0; idx < ranked_len; idx++) {
+		lst[idx] = ranked[idx].object;
+	}
 
-	*lst_len_out = lst_len;
+	*lst_len_out = ranked_len;
 	*lst_out = lst;
 
 #undef MAX_PERSIST_PER_RUN
@@ -3277,26 +3546,6 @@ static llcache_object_user *llcache_object_find_user(
 }
 
 
-/**
- * Determine if a low-level cache object resides in a given list
- *
- * \param object  Object to search for
- * \param list	  List to search in
- * \return True if object resides in list, false otherwise
- */
-static bool llcache_object_in_list(const llcache_object *object,
-		const llcache_object *list)
-{
-	while (list != NULL) {
-		if (list == object)
-			break;
-
-		list = list->next;
-	}
-
-	return list != NULL;
-}
-
 /**
  * Notify users of an object's current state
  *
@@ -3704,6 +3953,86 @@ static void llcache_users_not_caught_up(void)
 }
 
 
+/**
+ * Passes made over objects by size based cache cleaning.
+ */
+enum llcache_clean_pass {
+	LLCACHE_CLEAN_RELEASE_SOURCE, /**< release data held on disc */
+	LLCACHE_CLEAN_DISCARD_BACKED, /**< discard objects held on disc */
+	LLCACHE_CLEAN_DISCARD_FRESH /**< discard objects only in RAM */
+};
+
+/**
+ * Reclaim the storage of an unused object in a size based clean pass.
+ *
+ * \param pass The clean pass being made.
+ * \param object The object with no users or pending fetches.
+ * \param llcache_size The cache size, updated for any storage reclaimed.
+ * \param now The current time.
+ * \return true if the object was destroyed else false.
+ */
+static bool
+llcache_clean_object(enum llcache_clean_pass pass,
+		     llcache_object *object,
+		     uint32_t *llcache_size,
+		     time_t now)
+{
+	switch (pass) {
+	case LLCACHE_CLEAN_RELEASE_SOURCE:
+		if ((object->store_state == LLCACHE_STATE_DISC) &&
+		    (object->source_data != NULL)) {
+			guit->llcache->release(object->url, BACKING_STORE_NONE);
+
+			object->source_data = NULL;
+
+			*llcache_size -= object->source_len;
+
+			NSLOG(llcache, DEBUG,
+			      "Freeing source data for %p len:%"PRIsizet,
+			      object, object->source_len);
+		}
+		break;
+
+	case LLCACHE_CLEAN_DISCARD_BACKED:
+		if ((object->store_state == LLCACHE_STATE_DISC) &&
+		    (object->source_data == NULL)) {
+			NSLOG(llcache, DEBUG,
+			     "discarding backed object len:%"PRIsizet" age:%ld (%p) %s",
+			      object->source_len,
+			      (long)(now - object->last_used),
+			      object,
+			      nsurl_access(object->url));
+
+			*llcache_size -= total_object_size(object);
+
+			llcache_object_remove_from_cache(object);
+			llcache_object_destroy(object);
+			return true;
+		}
+		break;
+
+	case LLCACHE_CLEAN_DISCARD_FRESH:
+		if (object->store_state == LLCACHE_STATE_RAM) {
+			NSLOG(llcache, DEBUG,
+			      "discarding fresh object len:%"PRIsizet" age:%ld (%p) %s",
+			      object->source_len,
+			      (long)(now - object->last_used),
+			      object,
+			      nsurl_access(object->url));
+
+			*llcache_size -= object->source_len + sizeof(*object);
+
+			llcache_object_remove_from_cache(object);
+			llcache_object_destroy(object);
+			return true;
+		}
+		break;
+	}
+
+	return false;
+}
+
+
 /******************************************************************************
  * Public API								      *
  ******************************************************************************/
@@ -3721,6 +4050,12 @@ void llcache_clean(bool purge)
 	uint32_t llcache_size = 0;
 	int remaining_lifetime;
 	uint32_t limit;
+	struct llcache_ranked_object *ranked = NULL;
+	uint32_t ranked_len = 0;
+	uint32_t evictable = 0;
+	uint32_t idx;
+	enum llcache_clean_pass pass;
+	time_t now = time(NULL);
 
 	NSLOG(llcache, DEBUG, "Attempting cache clean");
 
@@ -3771,8 +4106,7 @@ void llcache_clean(bool purge)
 					"users or pending fetches (%p) %s",
 					object, nsurl_access(object->url));
 
-				llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
+				llcache_object_remove_from_cache(object);
 
 				if (object->store_state == LLCACHE_STATE_DISC) {
 					guit->llcache->invalidate(object->url);
@@ -3783,99 +4117,99 @@ void llcache_clean(bool purge)
 		} else {
 			/* object has users so account for the storage */
 			llcache_size += total_object_size(object);
-		}
-	}
-
-	/* if the cache limit is exceeded try to make some objects
-	 * persistent so their RAM can be reclaimed in the next
-	 * step
-	 */
-	if (limit < llcache_size) {
-		llcache_persist(NULL);
-	}
 
-	/* Source data of fresh cacheable objects with no users, no
-	 * pending fetches and pushed to persistent store while the
-	 * cache exceeds the configured size.
-	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_DISC)) {
-			guit->llcache->release(object->url, BACKING_STORE_NONE);
-
-			object->source_data = NULL;
-
-			llcache_size -=	object->source_len;
-
-			NSLOG(llcache, DEBUG,
-			      "Freeing source data for %p len:%"PRIsizet,
-			      object, object->source_len);
+			if ((object->users == NULL) &&
+			    (object->candidate_count == 0) &&
+			    (object->fetch.fetch == NULL)) {
+				evictable++;
+			}
 		}
 	}
 
-	/* Fresh cacheable objects with no users, no pending fetches
-	 * and pushed to persistent store while the cache exceeds
-	 * the configured size. Effectively just the llcache object metadata.
-	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_DISC) &&
-		    (object->source_data == NULL)) {
-			NSLOG(llcache, DEBUG,
-			     "discarding backed object len:%"PRIsizet" age:%ld (%p) %s",
-			      object->source_len,
-			      (long)(time(NULL) - object->last_used),
-			      object,
-			      nsurl_access(object->url));
-
-			llcache_size -=	total_object_size(object);
-
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-			llcache_object_destroy(object);
+	if ((limit < llcache_size) && (evictable > 0)) {
+		/* Candidates for size based eviction are ranked by
+		 * the value of retaining them per byte of RAM. This is
+		 * the remaining freshness lifetime weighted against
+		 * how long the object has been idle, the least
+		 * valuable are considered first.
+		 *
+		 * The value changes with time so no ordering is kept
+		 * between cleans; the ranking is only built when the
+		 * cache is over its limit.
+		 */
+		ranked = malloc(evictable * sizeof(*ranked));
+		if (ranked != NULL) {
+			for (object = llcache->cached_objects;
+			     object != NULL;
+			     object = object->next) {
+				if ((object->users != NULL) ||
+				    (object->candidate_count != 0) ||
+				    (object->fetch.fetch != NULL)) {
+					continue;
+				}
+				remaining_lifetime =
+					llcache_object_rfc2616_remaining_lifetime(
+						&object->cache);
+				ranked[ranked_len].object = object;
+				ranked[ranked_len].value =
+					(double)remaining_lifetime /
+					((double)total_object_size(object) *
+					 (llcache_object_idle_time(object, now) + 1));
+				ranked_len++;
+			}
 
+			qsort(ranked, ranked_len, sizeof(*ranked),
+			      llcache_ranked_compar_ascending);
+		} else {
+			NSLOG(llcache, WARNING,
+			      "Unable to rank %u objects, evicting in list order",
+			      evictable);
 		}
+
+		/* if the cache limit is exceeded try to make some
+		 * objects persistent so their RAM can be reclaimed in
+		 * the next step
+		 */
+		llcache_persist(NULL);
 	}
 
-	/* Fresh cacheable objects with no users or pending fetches
-	 * while the cache exceeds the configured size. These are the
-	 * most valuable objects as replacing them is a full network
-	 * fetch
+	/* Source data of objects pushed to persistent store is released
+	 * first, then the metadata of those objects and finally fresh
+	 * objects only held in RAM, whose replacement is a full network
+	 * fetch, until the cache is under the configured size.
 	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_RAM)) {
-			NSLOG(llcache, DEBUG,
-			      "discarding fresh object len:%"PRIsizet" age:%ld (%p) %s",
-			      object->source_len,
-			      (long)(time(NULL) - object->last_used),
-			      object,
-			      nsurl_access(object->url));
-
-			llcache_size -=	object->source_len + sizeof(*object);
-
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-			llcache_object_destroy(object);
+	for (pass = LLCACHE_CLEAN_RELEASE_SOURCE;
+	     pass <= LLCACHE_CLEAN_DISCARD_FRESH;
+	     pass++) {
+		if (ranked != NULL) {
+			for (idx = 0;
+			     (limit < llcache_size) && (idx < ranked_len);
+			     idx++) {
+				object = ranked[idx].object;
+				if ((object != NULL) &&
+				    llcache_clean_object(pass, object,
+							 &llcache_size, now)) {
+					ranked[idx].object = NULL;
+				}
+			}
+		} else {
+			for (object = llcache->cached_objects;
+			     (limit < llcache_size) && (object != NULL);
+			     object = next) {
+				next = object->next;
+				if ((object->users == NULL) &&
+				    (object->candidate_count == 0) &&
+				    (object->fetch.fetch == NULL)) {
+					llcache_clean_object(pass, object,
+							     &llcache_size,
+							     now);
+				}
+			}
 		}
 	}
 
+	free(ranked);
+
 	NSLOG(llcache, DEBUG, "Size: %u (limit: %u)", llcache_size, limit);
 }
 
@@ -3896,6 +4230,15 @@ llcache_initialise(const struct llcache_parameters *prm)
 	llcache->fetch_attempts = prm->fetch_attempts;
 	llcache->all_caught_up = true;
 
+	llcache->cached_index = calloc(LLCACHE_INDEX_INITIAL_SIZE,
+				       sizeof(llcache_object *));
+	if (llcache->cached_index == NULL) {
+		free(llcache);
+		llcache = NULL;
+		return NSERROR_NOMEM;
+	}
+	llcache->cached_index_size = LLCACHE_INDEX_INITIAL_SIZE;
+
 	NSLOG(llcache, INFO,
 	      "llcache initialising with a limit of %d bytes",
 	      llcache->limit);
@@ -3972,6 +4315,7 @@ void llcache_finalise(void)
 	      llcache->total_elapsed,
 	      total_bandwidth);
 
+	free(llcache->cached_index);
 	free(llcache);
 	llcache = NULL;
 }
@@ -4160,9 +4504,8 @@ nserror llcache_handle_force_stream(llcache_handle *handle)
 		return NSERROR_OK;
 
 	/* Forcibly uncache this object */
-	if (llcache_object_in_list(object, llcache->cached_objects)) {
-		llcache_object_remove_from_list(object,
-				&llcache->cached_objects);
+	if (llcache_object_in_cache(object)) {
+		llcache_object_remove_from_cache(object);
 		llcache_object_add_to_list(object, &llcache->uncached_objects);
 	}
 
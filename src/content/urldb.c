@@ -89,13 +89,24 @@
 
 #include <assert.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <libpsl.h>
+#include <nsutils/unistd.h>
 
+#include <neosurf/utils/config.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+
+#include "neosurf/inttypes.h"
 #include <neosurf/utils/inet.h>
 #include <neosurf/utils/nsoption.h>
 #include <neosurf/utils/log.h>
@@ -238,6 +249,11 @@ struct host_part {
 	bool permit_invalid_certs;
 	/* HSTS data */
 	struct hsts_data hsts;
+	/**
+	 * Value of cookie_generation when cookies stored on this
+	 * host were last changed
+	 */
+	unsigned int cookie_generation;
 
 	/**
 	 * Part of host string
@@ -285,6 +301,35 @@ static struct search_node *search_trees[NUM_SEARCH_TREES] = {
 	&empty, &empty, &empty, &empty
 };
 
+/** Number of entries in the Cookie header cache, a power of two */
+#define COOKIE_CACHE_SIZE 64
+
+/**
+ * Cached Cookie header.
+ *
+ * Unless a URL has cookies set for its exact path, or a domain
+ * cookie path extends into its directory, the Cookie header of a URL
+ * depends only upon its directory node and scheme. Such headers are
+ * cached by directory so they are shared by every resource in it.
+ */
+struct cookie_cache_entry {
+	const struct path_data *dir; /**< directory node or NULL if unused */
+	lwc_string *scheme; /**< scheme of the URL */
+	bool include_http_only; /**< HttpOnly cookies were included */
+	const struct host_part *host; /**< host of the directory */
+	unsigned int generation; /**< cookie_generation when built */
+	time_t expires; /**< earliest expiry of matched cookies or -1 */
+	char *header; /**< Cookie header or NULL if no cookies matched */
+	struct cookie_internal_data **cookies; /**< matched cookies */
+	int count; /**< number of matched cookies */
+};
+
+/** Cookie header cache */
+static struct cookie_cache_entry cookie_cache[COOKIE_CACHE_SIZE];
+
+/** Count of changes made to stored cookies */
+static unsigned int cookie_generation;
+
 /** Minimum cookie database file version */
 #define MIN_COOKIE_FILE_VERSION 100
 /** Current cookie database file version */
@@ -292,72 +337,248 @@ static struct search_node *search_trees[NUM_SEARCH_TREES] = {
 /** loaded cookie file version */
 static int loaded_cookie_file_version;
 
-/** Minimum URL database file version */
+/** Minimum text URL database file version */
 #define MIN_URL_FILE_VERSION 106
-/** Current URL database file version */
+/** Current text URL database file version */
 #define URL_FILE_VERSION 107
 
+/** Binary URL database file magic ("NSUD") */
+#define URLDB_FILE_MAGIC 0x4e535544
+/** Current binary URL database file version */
+#define URLDB_FILE_VERSION 1
+/** String table offset of an absent string */
+#define URLDB_FILE_NO_STRING UINT32_MAX
+
+/**
+ * Binary URL database file header.
+ *
+ * The header is followed by the host records, then the URL records
+ * of every host in host order and finally a table of NUL terminated
+ * strings which the records refer to by offset. All records are
+ * multiples of eight bytes so the file can be used in place once
+ * mapped.
+ */
+struct urldb_file_header {
+	uint32_t magic; /**< URLDB_FILE_MAGIC */
+	uint32_t version; /**< URLDB_FILE_VERSION */
+	uint32_t host_count; /**< number of host records */
+	uint32_t url_count; /**< number of URL records */
+	uint32_t strings_size; /**< size of string table */
+	uint32_t reserved; /**< padding */
+};
+
+/**
+ * Binary URL database host record.
+ */
+struct urldb_file_host {
+	int64_t hsts_expires; /**< HSTS expiry time */
+	uint32_t host; /**< host name string */
+	uint32_t url_count; /**< number of URL records of this host */
+	uint32_t hsts_include_sub_domains; /**< HSTS includes subdomains */
+	uint32_t reserved; /**< padding */
+};
+
+/**
+ * Binary URL database URL record.
+ */
+struct urldb_file_url {
+	int64_t last_visit; /**< Last visit time */
+	uint32_t scheme; /**< scheme string */
+	uint32_t path; /**< path and query string */
+	uint32_t title; /**< title string or URLDB_FILE_NO_STRING */
+	uint32_t visits; /**< Visit count */
+	uint16_t port; /**< Port number, 0 for default */
+	uint16_t type; /**< Type of resource */
+	uint32_t reserved; /**< padding */
+};
+
+/**
+ * Loaded binary URL database.
+ *
+ * Titles of URLs loaded from the file refer into its string table so
+ * they are only read from disc when used.
+ */
+static uint8_t *url_file_data;
+/** Size of loaded binary URL database */
+static size_t url_file_size;
+/** Loaded binary URL database is mapped rather than on the heap */
+static bool url_file_mapped;
+
 /**
  * filter for url presence in database
  *
  * Bloom filter used for short-circuting the false case of "is this
- * URL in the database?".  BLOOM_SIZE controls how large the filter is
- * in bytes.  Primitive experimentation shows that for a filter of X
- * bytes filled with X items, searching for X items not in the filter
- * has a 5% false-positive rate.  We set it to 32kB, which should be
- * enough for all but the largest databases, while not being
- * shockingly wasteful on memory.
+ * URL in the database?".  The filter grows as URLs are added, keeping
+ * its false positive rate below 1% however large the database gets.
+ * It is sized for the URL count when a binary database is loaded and
+ * for BLOOM_CAPACITY URLs otherwise.
  */
 static struct bloom_filter *url_bloom;
 /**
- * Size of url filter
+ * Initial capacity of url filter
+ */
+#define BLOOM_CAPACITY (1024 * 16)
+
+/** Number of URL searches which passed the url filter */
+static unsigned int url_bloom_passes;
+/** Number of URL searches which passed the url filter but found nothing */
+static unsigned int url_bloom_false_positives;
+
+
+/**
+ * Growable buffer used to build a binary URL database.
+ */
+struct urldb_buffer {
+	uint8_t *data; /**< buffer contents */
+	size_t len; /**< length of contents */
+	size_t alloc; /**< allocated size of buffer */
+};
+
+/** Number of schemes remembered when deduplicating saved strings */
+#define URLDB_SCHEME_CACHE 4
+
+/**
+ * State of a binary URL database save.
+ */
+struct urldb_save_state {
+	struct urldb_buffer hosts; /**< host records */
+	struct urldb_buffer urls; /**< URL records */
+	struct urldb_buffer strings; /**< string table */
+	/** recently saved schemes */
+	lwc_string *scheme[URLDB_SCHEME_CACHE];
+	/** string table offsets of recently saved schemes */
+	uint32_t scheme_offset[URLDB_SCHEME_CACHE];
+	time_t expiry; /**< URLs last visited before this are not saved */
+	bool failed; /**< an allocation failed */
+};
+
+/**
+ * Append data to a buffer
+ *
+ * \param buf Buffer to append to
+ * \param data Data to append
+ * \param len Length of data
+ * \return true on success, false on memory exhaustion
  */
-#define BLOOM_SIZE (1024 * 32)
+static bool
+urldb_buffer_append(struct urldb_buffer *buf, const void *data, size_t len)
+{
+	uint8_t *temp;
+	size_t alloc;
+
+	if (buf->len + len > buf->alloc) {
+		alloc = (buf->alloc + len) * 2;
+		temp = realloc(buf->data, alloc);
+		if (temp == NULL) {
+			return false;
+		}
+		buf->data = temp;
+		buf->alloc = alloc;
+	}
 
+	memcpy(buf->data + buf->len, data, len);
+	buf->len += len;
+
+	return true;
+}
 
 /**
- * write a time_t to a file portably
+ * Add a string to the string table of a save
  *
- * \param fp File to write to
- * \param val the unix time value to output
- * \return NSERROR_OK on success
+ * \param state Save state
+ * \param str String to add
+ * \return Offset of the string in the table
  */
-static nserror urldb_write_timet(FILE *fp, time_t val)
+static uint32_t urldb_save_string(struct urldb_save_state *state, const char *str)
 {
-	int use;
-	char op[32];
+	uint32_t offset = state->strings.len;
 
-	use = nsc_sntimet(op, 32, &val);
-	if (use == 0) {
-		fprintf(fp, "%i\n", (int)val);
+	if (!urldb_buffer_append(&state->strings, str, strlen(str) + 1)) {
+		state->failed = true;
+	}
+	return offset;
+}
+
+/**
+ * Add a scheme to the string table of a save
+ *
+ * There are very few distinct schemes so recently added ones are
+ * reused rather than stored for every URL.
+ *
+ * \param state Save state
+ * \param scheme Scheme to add
+ * \return Offset of the scheme in the table
+ */
+static uint32_t urldb_save_scheme(struct urldb_save_state *state, lwc_string *scheme)
+{
+	int i;
+
+	for (i = 0; i < URLDB_SCHEME_CACHE; i++) {
+		if (state->scheme[i] == scheme) {
+			return state->scheme_offset[i];
+		}
+	}
+
+	memmove(&state->scheme[1], &state->scheme[0],
+		sizeof(state->scheme[0]) * (URLDB_SCHEME_CACHE - 1));
+	memmove(&state->scheme_offset[1], &state->scheme_offset[0],
+		sizeof(state->scheme_offset[0]) * (URLDB_SCHEME_CACHE - 1));
+	state->scheme[0] = scheme;
+	state->scheme_offset[0] = urldb_save_string(state,
+						    lwc_string_data(scheme));
+
+	return state->scheme_offset[0];
+}
+
+/**
+ * Add the record of a URL to a save
+ *
+ * \param state Save state
+ * \param p Path data of the URL
+ * \param path Path of the URL
+ */
+static void
+urldb_save_url(struct urldb_save_state *state,
+	       const struct path_data *p,
+	       const char *path)
+{
+	struct urldb_file_url rec;
+
+	memset(&rec, 0, sizeof(rec));
+	rec.last_visit = p->urld.last_visit;
+	rec.scheme = urldb_save_scheme(state, p->scheme);
+	rec.path = urldb_save_string(state, path);
+	if (p->urld.title != NULL) {
+		rec.title = urldb_save_string(state, p->urld.title);
 	} else {
-		fprintf(fp, "%.*s\n", use, op);
+		rec.title = URLDB_FILE_NO_STRING;
+	}
+	rec.visits = p->urld.visits;
+	rec.port = p->port;
+	rec.type = p->urld.type;
+
+	if (!urldb_buffer_append(&state->urls, &rec, sizeof(rec))) {
+		state->failed = true;
 	}
-	return NSERROR_OK;
 }
 
 /**
- * Write paths associated with a host
+ * Save paths associated with a host
  *
  * \param parent Root of (sub)tree to write
- * \param host Current host name
- * \param fp File to write to
+ * \param state Save state
  * \param path Current path string
  * \param path_alloc Allocated size of path
  * \param path_used Used size of path
- * \param expiry Expiry time of URLs
  */
 static void
 urldb_write_paths(const struct path_data *parent,
-		  const char *host,
-		  FILE *fp,
+		  struct urldb_save_state *state,
 		  char **path,
 		  int *path_alloc,
-		  int *path_used,
-		  time_t expiry)
+		  int *path_used)
 {
 	const struct path_data *p = parent;
-	int i;
 
 	do {
 		int seglen = p->segment != NULL ? strlen(p->segment) : 0;
@@ -368,6 +589,7 @@ urldb_write_paths(const struct path_data *parent,
 			temp = realloc(*path,
 				       (len > 64) ? len : *path_alloc + 64);
 			if (!temp) {
+				state->failed = true;
 				return;
 			}
 			*path = temp;
@@ -394,44 +616,10 @@ urldb_write_paths(const struct path_data *parent,
 		} else {
 			/* leaf node */
 			if (p->persistent ||
-			    ((p->urld.last_visit > expiry) &&
+			    ((p->urld.last_visit > state->expiry) &&
 			     (p->urld.visits > 0))) {
-				fprintf(fp, "%s\n", lwc_string_data(p->scheme));
-
-				if (p->port) {
-					fprintf(fp,"%d\n", p->port);
-				} else {
-					fprintf(fp, "\n");
-				}
-
-				fprintf(fp, "%s\n", *path);
-
 				/** \todo handle fragments? */
-
-				/* number of visits */
-				fprintf(fp, "%i\n", p->urld.visits);
-
-				/* time entry was last used */
-				urldb_write_timet(fp, p->urld.last_visit);
-
-				/* entry type */
-				fprintf(fp, "%i\n", (int)p->urld.type);
-
-				fprintf(fp, "\n");
-
-				if (p->urld.title) {
-					uint8_t *s = (uint8_t *) p->urld.title;
-
-					for (i = 0; s[i] != '\0'; i++)
-						if (s[i] < 32)
-							s[i] = ' ';
-					for (--i; ((i > 0) && (s[i] == ' '));
-					     i--)
-						s[i] = '\0';
-					fprintf(fp, "%s\n", p->urld.title);
-				} else {
-					fprintf(fp, "\n");
-				}
+				urldb_save_url(state, p, *path);
 			}
 
 			/* Now, find next node to process. */
@@ -461,74 +649,37 @@ urldb_write_paths(const struct path_data *parent,
 }
 
 
-/**
- * Count number of URLs associated with a host
- *
- * \param root Root of path data tree
- * \param expiry Expiry time for URLs
- * \param count Pointer to count
- */
-static void
-urldb_count_urls(const struct path_data *root,
-		 time_t expiry,
-		 unsigned int *count)
-{
-	const struct path_data *p = root;
-
-	do {
-		if (p->children != NULL) {
-			/* Drill down into children */
-			p = p->children;
-		} else {
-			/* No more children, increment count if required */
-			if (p->persistent ||
-			    ((p->urld.last_visit > expiry) &&
-			     (p->urld.visits > 0))) {
-				(*count)++;
-			}
-
-			/* Now, find next node to process. */
-			while (p != root) {
-				if (p->next != NULL) {
-					/* Have a sibling, process that */
-					p = p->next;
-					break;
-				}
-
-				/* Ascend tree */
-				p = p->parent;
-			}
-		}
-	} while (p != root);
-}
-
-
 /**
  * Save a search (sub)tree
  *
+ * Hosts are saved in search tree order with their URLs in path tree
+ * order so loading inserts them in the order they are kept.
+ *
  * \param parent root node of search tree to save.
- * \param fp File to write to
+ * \param state Save state
  */
-static void urldb_save_search_tree(struct search_node *parent, FILE *fp)
+static void
+urldb_save_search_tree(struct search_node *parent, struct urldb_save_state *state)
 {
 	char host[256];
 	const struct host_part *h;
-	unsigned int path_count = 0;
+	struct urldb_file_host rec;
 	char *path, *p, *end;
 	int path_alloc = 64, path_used = 1;
-	time_t expiry, hsts_expiry = 0;
+	size_t urls_len;
+	time_t hsts_expiry = 0;
 	int hsts_include_subdomains = 0;
 
-	expiry = time(NULL) - ((60 * 60 * 24) * nsoption_int(expire_url));
-
 	if (parent == &empty)
 		return;
 
-	urldb_save_search_tree(parent->left, fp);
+	urldb_save_search_tree(parent->left, state);
 
 	path = malloc(path_alloc);
-	if (!path)
+	if (!path) {
+		state->failed = true;
 		return;
+	}
 
 	path[0] = '\0';
 
@@ -544,29 +695,30 @@ static void urldb_save_search_tree(struct search_node *parent, FILE *fp)
 	}
 
 	h = parent->data;
-	if (h && h->hsts.expires > expiry) {
+	if (h && h->hsts.expires > state->expiry) {
 		hsts_expiry = h->hsts.expires;
 		hsts_include_subdomains = h->hsts.include_sub_domains;
 	}
 
-	urldb_count_urls(&parent->data->paths, expiry, &path_count);
-
-	if (path_count > 0) {
-		fprintf(fp, "%s %i ", host, hsts_include_subdomains);
-		urldb_write_timet(fp, hsts_expiry);
-		fprintf(fp, "%i\n", path_count);
-
-		urldb_write_paths(&parent->data->paths, host, fp,
-				  &path, &path_alloc, &path_used, expiry);
-	} else if (hsts_expiry) {
-		fprintf(fp, "%s %i ", host, hsts_include_subdomains);
-		urldb_write_timet(fp, hsts_expiry);
-		fprintf(fp, "0\n");
+	urls_len = state->urls.len;
+	urldb_write_paths(&parent->data->paths, state,
+			  &path, &path_alloc, &path_used);
+
+	if ((state->urls.len > urls_len) || hsts_expiry) {
+		memset(&rec, 0, sizeof(rec));
+		rec.hsts_expires = hsts_expiry;
+		rec.host = urldb_save_string(state, host);
+		rec.url_count = (state->urls.len - urls_len) /
+			sizeof(struct urldb_file_url);
+		rec.hsts_include_sub_domains = hsts_include_subdomains;
+		if (!urldb_buffer_append(&state->hosts, &rec, sizeof(rec))) {
+			state->failed = true;
+		}
 	}
 
 	free(path);
 
-	urldb_save_search_tree(parent->right, fp);
+	urldb_save_search_tree(parent->right, state);
 }
 
 
@@ -1348,12 +1500,12 @@ urldb_match_path(const struct path_data *parent,
 
 
 /**
- * Find an URL in the database
+ * Search the host and path trees for an URL
  *
  * \param url Absolute URL to find
  * \return Pointer to path data, or NULL if not found
  */
-static struct path_data *urldb_find_url(nsurl *url)
+static struct path_data *urldb_search_url(nsurl *url)
 {
 	const struct host_part *h;
 	struct path_data *p;
@@ -1367,12 +1519,6 @@ static struct path_data *urldb_find_url(nsurl *url)
 
 	assert(url);
 
-	if (url_bloom != NULL) {
-		if (bloom_search_hash(url_bloom, nsurl_hash(url)) == false) {
-			return NULL;
-		}
-	}
-
 	scheme = nsurl_get_component(url, NSURL_SCHEME);
 	if (scheme == NULL)
 		return NULL;
@@ -1428,6 +1574,57 @@ static struct path_data *urldb_find_url(nsurl *url)
 }
 
 
+/**
+ * Find an URL in the database
+ *
+ * \param url Absolute URL to find
+ * \return Pointer to path data, or NULL if not found
+ */
+static struct path_data *urldb_find_url(nsurl *url)
+{
+	struct path_data *p;
+
+	assert(url);
+
+	if (url_bloom != NULL) {
+		if (bloom_search_hash(url_bloom, nsurl_hash(url)) == false) {
+			return NULL;
+		}
+	}
+
+	p = urldb_search_url(url);
+
+	if (url_bloom != NULL) {
+		url_bloom_passes++;
+		if (p == NULL)
+			url_bloom_false_positives++;
+	}
+
+	return p;
+}
+
+
+/**
+ * Add an URL to the url filter
+ *
+ * The filter is created with the default capacity if need be.  URLs
+ * which are already present are not added again, so repeated visits
+ * do not grow the filter.
+ *
+ * \param url URL to add
+ */
+static void urldb_bloom_insert(nsurl *url)
+{
+	uint32_t hash = nsurl_hash(url);
+
+	if (url_bloom == NULL)
+		url_bloom = bloom_create(BLOOM_CAPACITY, false);
+
+	if (url_bloom != NULL && !bloom_search_hash(url_bloom, hash))
+		bloom_insert_hash(url_bloom, hash);
+}
+
+
 /**
  * Dump URL database paths to stderr
  *
@@ -2243,6 +2440,119 @@ static struct host_part *urldb_add_host(const char *host)
 }
 
 
+/**
+ * Record that the cookies stored on a host have changed
+ *
+ * Invalidates every cached Cookie header which the host contributed to.
+ *
+ * \param h Host whose cookies changed
+ */
+static void urldb_cookies_changed(const struct host_part *h)
+{
+	((struct host_part *)h)->cookie_generation = ++cookie_generation;
+}
+
+
+/**
+ * Determine whether cookies are set for a URL's exact path
+ *
+ * \param p Leaf node of the URL
+ * \return true if the Cookie header of the URL depends on its leaf
+ */
+static bool urldb_cookies_exact(const struct path_data *p)
+{
+	const struct path_data *q;
+
+	if (*(p->segment) == '\0')
+		return false;
+
+	if (p->parent->parent != NULL) {
+		/* Below the top level all siblings share p's scheme
+		 * and port, so the only node with p's segment is p */
+		return (p->cookies != NULL);
+	}
+
+	for (q = p->parent->children; q; q = q->next) {
+		if (q->cookies != NULL && strcmp(q->segment, p->segment) == 0)
+			return true;
+	}
+
+	return false;
+}
+
+
+/**
+ * Find the Cookie header cache slot for a directory
+ *
+ * \param dir Directory node
+ * \param scheme URL scheme
+ * \param include_http_only Whether HttpOnly cookies are included
+ * \return cache slot
+ */
+static struct cookie_cache_entry *
+urldb_cookie_cache_slot(const struct path_data *dir,
+			lwc_string *scheme,
+			bool include_http_only)
+{
+	uint32_t key = (uint32_t)((uintptr_t)dir >> 4) ^
+		(uint32_t)((uintptr_t)scheme >> 4);
+
+	key = (key * 0x9e3779b1) >> 16;
+
+	return &cookie_cache[(key ^ include_http_only) &
+			     (COOKIE_CACHE_SIZE - 1)];
+}
+
+
+/**
+ * Release the contents of a Cookie header cache slot
+ *
+ * \param entry Cache slot to clear
+ */
+static void urldb_cookie_cache_clear(struct cookie_cache_entry *entry)
+{
+	free(entry->header);
+	free(entry->cookies);
+	memset(entry, 0, sizeof(*entry));
+}
+
+
+/**
+ * Determine whether a Cookie header cache slot holds a current header
+ *
+ * \param entry Cache slot
+ * \param dir Directory node
+ * \param scheme URL scheme
+ * \param include_http_only Whether HttpOnly cookies are included
+ * \param now Current time
+ * \return true if the cached header may be used
+ */
+static bool
+urldb_cookie_cache_valid(const struct cookie_cache_entry *entry,
+			 const struct path_data *dir,
+			 lwc_string *scheme,
+			 bool include_http_only,
+			 time_t now)
+{
+	const struct host_part *h;
+
+	if (entry->dir != dir || entry->scheme != scheme ||
+	    entry->include_http_only != include_http_only)
+		return false;
+
+	if (entry->expires != -1 && entry->expires < now)
+		/* a matched cookie has since expired */
+		return false;
+
+	for (h = entry->host; h && h != &db_root; h = h->parent) {
+		if (h->cookie_generation > entry->generation)
+			return false;
+	}
+
+	return true;
+}
+
+
 /**
  * Insert a cookie into the database
  *
@@ -2302,6 +2612,8 @@ urldb_insert_cookie(struct cookie_internal_data *c,
 		}
 	}
 
+	urldb_cookies_changed(h);
+
 	/* add cookie */
 	for (d = p->cookies; d; d = d->next) {
 		if (!strcmp(d->domain, c->domain) &&
@@ -2531,8 +2843,9 @@ urldb_concat_cookie(struct cookie_internal_data *c,
  * \param path the cookie path
  * \param name The cookie name
  * \param parent The url data of the cookie
+ * \return true if the cookie was found and deleted
  */
-static void
+static bool
 urldb_delete_cookie_paths(const char *domain,
 			  const char *path,
 			  const char *name,
@@ -2562,7 +2875,7 @@ urldb_delete_cookie_paths(const char *domain,
 
 				urldb_free_cookie(c);
 
-				return;
+				return true;
 			}
 		}
 
@@ -2579,6 +2892,8 @@ urldb_delete_cookie_paths(const char *domain,
 			}
 		}
 	} while (p != parent);
+
+	return false;
 }
 
 
@@ -2599,7 +2914,8 @@ urldb_delete_cookie_hosts(const char *domain,
 	struct host_part *h;
 	assert(parent);
 
-	urldb_delete_cookie_paths(domain, path, name, &parent->paths);
+	if (urldb_delete_cookie_paths(domain, path, name, &parent->paths))
+		urldb_cookies_changed(parent);
 
 	for (h = parent->children; h; h = h->next) {
 		urldb_delete_cookie_hosts(domain, path, name, h);
@@ -2699,6 +3015,48 @@ static void urldb_destroy_cookie(struct cookie_internal_data *c)
 }
 
 
+/**
+ * Free a URL title
+ *
+ * Titles loaded from a binary database refer into the loaded file and
+ * are released with it.
+ *
+ * \param title The title to free
+ */
+static void urldb_free_title(char *title)
+{
+	if ((url_file_data != NULL) &&
+	    ((uint8_t *)title >= url_file_data) &&
+	    ((uint8_t *)title < (url_file_data + url_file_size))) {
+		return;
+	}
+	free(title);
+}
+
+
+/**
+ * Release the loaded binary URL database
+ */
+static void urldb_release_file(void)
+{
+	if (url_file_data == NULL) {
+		return;
+	}
+#ifdef HAVE_MMAP
+	if (url_file_mapped) {
+		munmap(url_file_data, url_file_size);
+	} else {
+		free(url_file_data);
+	}
+#else
+	free(url_file_data);
+#endif
+	url_file_data = NULL;
+	url_file_size = 0;
+	url_file_mapped = false;
+}
+
+
 /**
  * Destroy the contents of a path node
  *
@@ -2722,7 +3080,7 @@ static void urldb_destroy_path_node_content(struct path_data *node)
 		free(node->fragment[i]);
 	free(node->fragment);
 
-	free(node->urld.title);
+	urldb_free_title(node->urld.title);
 
 	for (a = node->cookies; a; a = b) {
 		b = a->next;
@@ -2862,16 +3220,106 @@ void urldb_destroy(void)
 	}
 	memset(&db_root, 0, sizeof(db_root));
 
+	/* And cached Cookie headers */
+	for (i = 0; i < COOKIE_CACHE_SIZE; i++) {
+		urldb_cookie_cache_clear(&cookie_cache[i]);
+	}
+
 	/* And the bloom filter */
 	if (url_bloom != NULL) {
 		bloom_destroy(url_bloom);
 		url_bloom = NULL;
 	}
+	url_bloom_passes = 0;
+	url_bloom_false_positives = 0;
+
+	/* No titles refer to the loaded file now */
+	urldb_release_file();
 }
 
 
-/* exported interface documented in netsurf/url_db.h */
-nserror urldb_load(const char *filename)
+/**
+ * Add a URL read from a saved database
+ *
+ * \param h Host tree node of the URL
+ * \param host Host name of the URL
+ * \param scheme Scheme of the URL
+ * \param port Port number of the URL, 0 for the default port
+ * \param path Path and query of the URL
+ * \return Pointer to leaf node, or NULL on failure
+ */
+static struct path_data *
+urldb_load_url(struct host_part *h,
+	       const char *host,
+	       const char *scheme,
+	       unsigned int port,
+	       const char *path)
+{
+	struct path_data *p = NULL;
+	char ports[10];
+	char url[64 + 3 + 256 + 6 + 4096 + 1 + 1];
+	bool is_file = false;
+	nsurl *nsurl;
+	lwc_string *scheme_lwc, *fragment_lwc;
+	char *path_query;
+	size_t len;
+
+	if (!strcasecmp(host, "localhost") &&
+	    !strcasecmp(scheme, "file"))
+		is_file = true;
+
+	snprintf(ports, sizeof ports, "%u", port);
+	snprintf(url, sizeof url, "%s://%s%s%s%s",
+		 scheme,
+		 /* file URLs have no host */
+		 (is_file ? "" : host),
+		 (port ? ":" : ""),
+		 (port ? ports : ""),
+		 path);
+
+	/* TODO: store URLs in pre-parsed state, and make
+	 *       a nsurl_load to generate the nsurl more
+	 *       swiftly.
+	 *       Need a nsurl_save too.
+	 */
+	if (nsurl_create(url, &nsurl) != NSERROR_OK) {
+		NSLOG(neosurf, INFO, "Failed inserting '%s'", url);
+		return NULL;
+	}
+
+	urldb_bloom_insert(nsurl);
+
+	/* Copy and merge path/query strings */
+	if (nsurl_get(nsurl, NSURL_PATH | NSURL_QUERY,
+		      &path_query, &len) != NSERROR_OK) {
+		NSLOG(neosurf, INFO, "Failed inserting '%s'", url);
+		nsurl_unref(nsurl);
+		return NULL;
+	}
+
+	scheme_lwc = nsurl_get_component(nsurl, NSURL_SCHEME);
+	fragment_lwc = nsurl_get_component(nsurl, NSURL_FRAGMENT);
+	p = urldb_add_path(scheme_lwc, port, h, path_query,
+			   fragment_lwc, nsurl);
+	if (!p) {
+		NSLOG(neosurf, INFO, "Failed inserting '%s'", url);
+	}
+	nsurl_unref(nsurl);
+	lwc_string_unref(scheme_lwc);
+	if (fragment_lwc != NULL)
+		lwc_string_unref(fragment_lwc);
+
+	return p;
+}
+
+
+/**
+ * Import a text format URL database
+ *
+ * \param filename Name of file containing data
+ * \return NSERROR_OK on success or error code on failure
+ */
+static nserror urldb_load_text(const char *filename)
 {
 #define MAXIMUM_URL_LENGTH 4096
 	char s[MAXIMUM_URL_LENGTH];
@@ -2883,13 +3331,6 @@ nserror urldb_load(const char *filename)
 	int length;
 	FILE *fp;
 
-	assert(filename);
-
-	NSLOG(neosurf, INFO, "Loading URL file %s", filename);
-
-	if (url_bloom == NULL)
-		url_bloom = bloom_create(BLOOM_SIZE);
-
 	fp = fopen(filename, "r");
 	if (!fp) {
 		NSLOG(neosurf, INFO, "Failed to open file '%s' for reading",
@@ -2969,13 +3410,7 @@ nserror urldb_load(const char *filename)
 		for (i = 0; i < urls; i++) {
 			struct path_data *p = NULL;
 			char scheme[64], ports[10];
-			char url[64 + 3 + 256 + 6 + 4096 + 1 + 1];
 			unsigned int port;
-			bool is_file = false;
-			nsurl *nsurl;
-			lwc_string *scheme_lwc, *fragment_lwc;
-			char *path_query;
-			size_t len;
 
 			if (!fgets(scheme, sizeof scheme, fp))
 				break;
@@ -2993,59 +3428,11 @@ nserror urldb_load(const char *filename)
 			length = strlen(s) - 1;
 			s[length] = '\0';
 
-			if (!strcasecmp(host, "localhost") &&
-			    !strcasecmp(scheme, "file"))
-				is_file = true;
-
-			snprintf(url, sizeof url, "%s://%s%s%s%s",
-				 scheme,
-				 /* file URLs have no host */
-				 (is_file ? "" : host),
-				 (port ? ":" : ""),
-				 (port ? ports : ""),
-				 s);
-
-			/* TODO: store URLs in pre-parsed state, and make
-			 *       a nsurl_load to generate the nsurl more
-			 *       swiftly.
-			 *       Need a nsurl_save too.
-			 */
-			if (nsurl_create(url, &nsurl) != NSERROR_OK) {
-				NSLOG(neosurf, INFO, "Failed inserting '%s'",
-				      url);
-				fclose(fp);
-				return NSERROR_NOMEM;
-			}
-
-			if (url_bloom != NULL) {
-				uint32_t hash = nsurl_hash(nsurl);
-				bloom_insert_hash(url_bloom, hash);
-			}
-
-			/* Copy and merge path/query strings */
-			if (nsurl_get(nsurl, NSURL_PATH | NSURL_QUERY,
-				      &path_query, &len) != NSERROR_OK) {
-				NSLOG(neosurf, INFO, "Failed inserting '%s'",
-				      url);
-				fclose(fp);
-				return NSERROR_NOMEM;
-			}
-
-			scheme_lwc = nsurl_get_component(nsurl, NSURL_SCHEME);
-			fragment_lwc = nsurl_get_component(nsurl,
-							   NSURL_FRAGMENT);
-			p = urldb_add_path(scheme_lwc, port, h, path_query,
-					   fragment_lwc, nsurl);
+			p = urldb_load_url(h, host, scheme, port, s);
 			if (!p) {
-				NSLOG(neosurf, INFO, "Failed inserting '%s'",
-				      url);
 				fclose(fp);
 				return NSERROR_NOMEM;
 			}
-			nsurl_unref(nsurl);
-			lwc_string_unref(scheme_lwc);
-			if (fragment_lwc != NULL)
-				lwc_string_unref(fragment_lwc);
 
 			if (!fgets(s, MAXIMUM_URL_LENGTH, fp))
 				break;
@@ -3074,6 +3461,7 @@ nserror urldb_load(const char *filename)
 			length = strlen(s) - 1;
 			if (p && length > 0) {
 				s[length] = '\0';
+				urldb_free_title(p->urld.title);
 				p->urld.title = malloc(length + 1);
 				if (p->urld.title)
 					memcpy(p->urld.title, s, length + 1);
@@ -3088,31 +3476,291 @@ nserror urldb_load(const char *filename)
 	return NSERROR_OK;
 }
 
+
+/**
+ * Read a binary format URL database
+ *
+ * The file is mapped and the trees are built directly from its
+ * records. Where possible the file is retained so titles can refer
+ * to its string table instead of being copied.
+ *
+ * \param filename Name of file containing data
+ * \return NSERROR_OK on success or error code on failure
+ */
+static nserror urldb_load_binary(const char *filename)
+{
+	const struct urldb_file_header *header;
+	const struct urldb_file_host *hosts;
+	const struct urldb_file_url *urls, *url;
+	const char *strings;
+	struct host_part *h;
+	struct path_data *p;
+	uint8_t *data = NULL;
+	bool mapped = false;
+	bool retain;
+	struct stat sb;
+	uint64_t expected;
+	uint32_t host_idx, url_idx, url_end;
+	nserror ret = NSERROR_OK;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd == -1) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	if ((fstat(fd, &sb) != 0) ||
+	    ((size_t)sb.st_size < sizeof(struct urldb_file_header))) {
+		close(fd);
+		return NSERROR_INVALID;
+	}
+
+#ifdef HAVE_MMAP
+	data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED) {
+		data = NULL;
+	} else {
+		mapped = true;
+	}
+#endif
+	if (data == NULL) {
+		data = malloc(sb.st_size);
+		if ((data == NULL) ||
+		    (nsu_pread(fd, data, sb.st_size, 0) != sb.st_size)) {
+			free(data);
+			close(fd);
+			return NSERROR_INVALID;
+		}
+	}
+	close(fd);
+
+	header = (const struct urldb_file_header *)data;
+	expected = sizeof(*header) +
+		((uint64_t)header->host_count * sizeof(*hosts)) +
+		((uint64_t)header->url_count * sizeof(*urls)) +
+		header->strings_size;
+	if ((header->magic != URLDB_FILE_MAGIC) ||
+	    (header->version != URLDB_FILE_VERSION) ||
+	    (expected != (uint64_t)sb.st_size) ||
+	    ((header->strings_size == 0) &&
+	     ((header->host_count != 0) || (header->url_count != 0)))) {
+		NSLOG(neosurf, INFO, "Invalid URL file '%s'", filename);
+		ret = NSERROR_INVALID;
+		goto out;
+	}
+
+	hosts = (const struct urldb_file_host *)(header + 1);
+	urls = (const struct urldb_file_url *)(hosts + header->host_count);
+	strings = (const char *)(urls + header->url_count);
+
+	/* every string offset is then terminated within the table; an
+	 * empty database has no strings at all
+	 */
+	if ((header->strings_size != 0) &&
+	    (strings[header->strings_size - 1] != '\0')) {
+		NSLOG(neosurf, INFO, "Invalid URL file '%s'", filename);
+		ret = NSERROR_INVALID;
+		goto out;
+	}
+
+	/* size the url filter for the whole file up front */
+	if (url_bloom == NULL && header->url_count > BLOOM_CAPACITY)
+		url_bloom = bloom_create(header->url_count, false);
+
+	/* only one file can be retained for titles to refer to */
+	retain = (url_file_data == NULL);
+	if (retain) {
+		url_file_data = data;
+		url_file_size = sb.st_size;
+		url_file_mapped = mapped;
+	}
+
+	url_idx = 0;
+	for (host_idx = 0; host_idx < header->host_count; host_idx++) {
+		const struct urldb_file_host *hrec = &hosts[host_idx];
+		const char *host;
+
+		url_end = url_idx + hrec->url_count;
+		if ((hrec->host >= header->strings_size) ||
+		    (url_end < url_idx) ||
+		    (url_end > header->url_count)) {
+			ret = NSERROR_INVALID;
+			break;
+		}
+		host = strings + hrec->host;
+
+		h = urldb_add_host(host);
+		if (!h) {
+			NSLOG(neosurf, INFO, "Failed adding host: '%s'", host);
+			ret = NSERROR_NOMEM;
+			break;
+		}
+		h->hsts.expires = hrec->hsts_expires;
+		h->hsts.include_sub_domains = hrec->hsts_include_sub_domains;
+
+		for (; url_idx < url_end; url_idx++) {
+			url = &urls[url_idx];
+			if ((url->scheme >= header->strings_size) ||
+			    (url->path >= header->strings_size) ||
+			    ((url->title != URLDB_FILE_NO_STRING) &&
+			     (url->title >= header->strings_size))) {
+				ret = NSERROR_INVALID;
+				break;
+			}
+
+			p = urldb_load_url(h, host,
+					   strings + url->scheme,
+					   url->port,
+					   strings + url->path);
+			if (!p) {
+				ret = NSERROR_NOMEM;
+				break;
+			}
+
+			p->urld.visits = url->visits;
+			p->urld.last_visit = url->last_visit;
+			p->urld.type = (content_type)url->type;
+
+			if (url->title == URLDB_FILE_NO_STRING) {
+				continue;
+			}
+			urldb_free_title(p->urld.title);
+			if (retain) {
+				p->urld.title = (char *)strings + url->title;
+			} else {
+				p->urld.title = strdup(strings + url->title);
+			}
+		}
+		if (ret != NSERROR_OK) {
+			break;
+		}
+	}
+
+	if (ret == NSERROR_OK) {
+		NSLOG(neosurf, INFO, "Successfully loaded %"PRIu32" URLs",
+		      header->url_count);
+	}
+
+	if (retain) {
+		/* titles refer to the data until urldb_destroy */
+		return ret;
+	}
+
+out:
+#ifdef HAVE_MMAP
+	if (mapped) {
+		munmap(data, sb.st_size);
+	} else {
+		free(data);
+	}
+#else
+	free(data);
+#endif
+	return ret;
+}
+
+
 /* exported interface documented in netsurf/url_db.h */
-nserror urldb_save(const char *filename)
+nserror urldb_load(const char *filename)
 {
+	uint32_t magic = 0;
 	FILE *fp;
-	int i;
 
 	assert(filename);
 
-	fp = fopen(filename, "w");
+	NSLOG(neosurf, INFO, "Loading URL file %s", filename);
+
+	fp = fopen(filename, "rb");
 	if (!fp) {
-		NSLOG(neosurf, INFO, "Failed to open file '%s' for writing",
+		NSLOG(neosurf, INFO, "Failed to open file '%s' for reading",
 		      filename);
-		return NSERROR_SAVE_FAILED;
+		return NSERROR_NOT_FOUND;
+	}
+	if (fread(&magic, sizeof(magic), 1, fp) != 1) {
+		fclose(fp);
+		return NSERROR_NEED_DATA;
+	}
+	fclose(fp);
+
+	if (magic == URLDB_FILE_MAGIC) {
+		return urldb_load_binary(filename);
 	}
 
-	/* file format version number */
-	fprintf(fp, "%d\n", URL_FILE_VERSION);
+	/* files from older versions are text */
+	return urldb_load_text(filename);
+}
+
+/* exported interface documented in netsurf/url_db.h */
+nserror urldb_save(const char *filename)
+{
+	struct urldb_save_state state;
+	struct urldb_file_header header;
+	char *tname;
+	FILE *fp;
+	bool ok;
+	int i;
+
+	assert(filename);
+
+	memset(&state, 0, sizeof(state));
+	state.expiry = time(NULL) -
+		((60 * 60 * 24) * nsoption_int(expire_url));
 
 	for (i = 0; i != NUM_SEARCH_TREES; i++) {
-		urldb_save_search_tree(search_trees[i], fp);
+		urldb_save_search_tree(search_trees[i], &state);
 	}
 
-	fclose(fp);
+	/* string offsets must fit the records */
+	if (state.strings.len >= URLDB_FILE_NO_STRING) {
+		state.failed = true;
+	}
 
-	return NSERROR_OK;
+	tname = malloc(strlen(filename) + sizeof(".tmp"));
+	if ((tname == NULL) || state.failed) {
+		free(tname);
+		free(state.hosts.data);
+		free(state.urls.data);
+		free(state.strings.data);
+		return NSERROR_NOMEM;
+	}
+	sprintf(tname, "%s.tmp", filename);
+
+	memset(&header, 0, sizeof(header));
+	header.magic = URLDB_FILE_MAGIC;
+	header.version = URLDB_FILE_VERSION;
+	header.host_count = state.hosts.len / sizeof(struct urldb_file_host);
+	header.url_count = state.urls.len / sizeof(struct urldb_file_url);
+	header.strings_size = state.strings.len;
+
+	/* write a new file and replace the old one with it as the
+	 * loaded database may still be mapped from the old file.
+	 */
+	fp = fopen(tname, "wb");
+	if (!fp) {
+		NSLOG(neosurf, INFO, "Failed to open file '%s' for writing",
+		      tname);
+		ok = false;
+	} else {
+		ok = (fwrite(&header, sizeof(header), 1, fp) == 1) &&
+			(fwrite(state.hosts.data, 1, state.hosts.len, fp) ==
+			 state.hosts.len) &&
+			(fwrite(state.urls.data, 1, state.urls.len, fp) ==
+			 state.urls.len) &&
+			(fwrite(state.strings.data, 1, state.strings.len, fp) ==
+			 state.strings.len);
+		ok = (fclose(fp) == 0) && ok;
+		ok = ok && (rename(tname, filename) == 0);
+		if (!ok) {
+			unlink(tname);
+		}
+	}
+
+	free(tname);
+	free(state.hosts.data);
+	free(state.urls.data);
+	free(state.strings.data);
+
+	return ok ? NSERROR_OK : NSERROR_SAVE_FAILED;
 }
 
 
@@ -3151,13 +3799,7 @@ bool urldb_add_url(nsurl *url)
 
 	assert(url);
 
-	if (url_bloom == NULL)
-		url_bloom = bloom_create(BLOOM_SIZE);
-
-	if (url_bloom != NULL) {
-		uint32_t hash = nsurl_hash(url);
-		bloom_insert_hash(url_bloom, hash);
-	}
+	urldb_bloom_insert(url);
 
 	/* Copy and merge path/query strings */
 	if (nsurl_get(url, NSURL_PATH | NSURL_QUERY, &path_query, &len) !=
@@ -3243,7 +3885,7 @@ nserror urldb_set_url_title(nsurl *url, const char *title)
 		temp = NULL;
 	}
 
-	free(p->urld.title);
+	urldb_free_title(p->urld.title);
 	p->urld.title = temp;
 
 	return NSERROR_OK;
@@ -3998,6 +4640,10 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 	time_t now;
 	int i;
 	bool match;
+	const struct path_data *dir;
+	struct cookie_cache_entry *entry = NULL;
+	size_t dir_len;
+	time_t expires = -1;
 
 	assert(url != NULL);
 
@@ -4011,6 +4657,26 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 		return NULL;
 
 	scheme = p->scheme;
+	dir = p->parent;
+	now = time(NULL);
+
+	if (!urldb_cookies_exact(p)) {
+		entry = urldb_cookie_cache_slot(dir, scheme, include_http_only);
+		if (urldb_cookie_cache_valid(entry, dir, scheme,
+					     include_http_only, now)) {
+			for (i = 0; i < entry->count; i++) {
+				c = entry->cookies[i];
+				if (c->last_used != now) {
+					c->last_used = now;
+					cookie_manager_add(
+						(struct cookie_data *)c);
+				}
+			}
+
+			return (entry->header != NULL) ?
+				strdup(entry->header) : NULL;
+		}
+	}
 
 	matched_cookies = malloc(matched_cookies_size *
 				 sizeof(struct cookie_internal_data *));
@@ -4053,7 +4719,9 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 	path = lwc_string_data(path_lwc);
 	lwc_string_unref(path_lwc);
 
-	now = time(NULL);
+	/* Length of the directory part of the path */
+	dir_len = strrchr(path, '/') != NULL ?
+		(size_t)(strrchr(path, '/') - path) + 1 : 0;
 
 	if (*(p->segment) != '\0') {
 		/* Match exact path, unless directory, when prefix matching
@@ -4149,6 +4817,10 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 				/* cookie has expired => ignore */
 				continue;
 
+			if (strlen(c->path) > dir_len)
+				/* match depends on more than the directory */
+				entry = NULL;
+
 			/* Ensure cookie path is a prefix of the resource */
 			if (strncmp(c->path, path, strlen(c->path)) != 0)
 				/* paths don't match => ignore */
@@ -4184,6 +4856,10 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 				/* cookie has expired => ignore */
 				continue;
 
+			if (strlen(c->path) > dir_len)
+				/* match depends on more than the directory */
+				entry = NULL;
+
 			/* Ensure cookie path is a prefix of the resource */
 			if (strncmp(c->path, path, strlen(c->path)) != 0)
 				/* paths don't match => ignore */
@@ -4213,6 +4889,15 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 		/* No cookies found */
 		free(ret);
 		free(matched_cookies);
+		if (entry != NULL) {
+			urldb_cookie_cache_clear(entry);
+			entry->dir = dir;
+			entry->scheme = scheme;
+			entry->include_http_only = include_http_only;
+			entry->host = (const struct host_part *)p;
+			entry->generation = cookie_generation;
+			entry->expires = -1;
+		}
 		return NULL;
 	}
 
@@ -4249,6 +4934,30 @@ char *urldb_get_cookie(nsurl *url, bool include_http_only)
 		ret = temp;
 	}
 
+	if (entry != NULL) {
+		/* Remember the header for the rest of the directory */
+		urldb_cookie_cache_clear(entry);
+		entry->header = strdup(ret);
+		if (entry->header != NULL) {
+			for (i = 0; i < count; i++) {
+				c = matched_cookies[i];
+				if (c->expires != -1 &&
+				    (expires == -1 || c->expires < expires))
+					expires = c->expires;
+			}
+
+			entry->dir = dir;
+			entry->scheme = scheme;
+			entry->include_http_only = include_http_only;
+			entry->host = (const struct host_part *)p;
+			entry->generation = cookie_generation;
+			entry->expires = expires;
+			entry->cookies = matched_cookies;
+			entry->count = count;
+			matched_cookies = NULL;
+		}
+	}
+
 	free(matched_cookies);
 
 	return ret;
@@ -4475,6 +5184,20 @@ void urldb_dump(void)
 	for (i = 0; i != NUM_SEARCH_TREES; i++) {
 		urldb_dump_search(search_trees[i], 0);
 	}
+
+	if (url_bloom != NULL) {
+		NSLOG(neosurf, INFO,
+		      "URL filter: %"PRIu32" URLs in %"PRIsizet" bytes, "
+		      "estimated false positive rate %.3f%%",
+		      bloom_items(url_bloom), bloom_size(url_bloom),
+		      bloom_fp_rate(url_bloom) * 100);
+		NSLOG(neosurf, INFO,
+		      "URL filter: %u of %u passed searches were false "
+		      "positives (%.3f%%)",
+		      url_bloom_false_positives, url_bloom_passes,
+		      url_bloom_passes == 0 ? 0.0 :
+		      url_bloom_false_positives * 100.0 / url_bloom_passes);
+	}
 }
 
 
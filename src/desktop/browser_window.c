@@ -3552,7 +3552,9 @@ navigate_internal_real(struct browser_window *bw,
 	}
 
 	res = hlcache_handle_retrieve(params->url,
-				      fetch_flags | HLCACHE_RETRIEVE_SNIFF_TYPE,
+				      fetch_flags |
+				      HLCACHE_RETRIEVE_SNIFF_TYPE |
+				      LLCACHE_RETRIEVE_PRIORITY_HIGH,
 				      params->referrer,
 				      fetch_is_post ? &post : NULL,
 				      browser_window_callback,
@@ -499,6 +499,11 @@ static nserror verify_fetch_register(struct gui_fetch_table *gft)
 		gft->mimetype = gui_default_mimetype;
 	}
 
+	/* file descriptor watching must be provided together */
+	if ((gft->watch_fd == NULL) != (gft->unwatch_fd == NULL)) {
+		return NSERROR_BAD_PARAMETER;
+	}
+
 	return NSERROR_OK;
 }
 
@@ -18,13 +18,40 @@
 
 /**
  * \file
- * Trivial bloom filter
+ * Scalable blocked bloom filter
+ *
+ * Each stage is an array of 512 bit blocks.  An item's hash picks one
+ * block and k bits within it, so an insert or search touches a single
+ * cache line and tests all of its bits with a branch free pass over
+ * the eight words of the block.
+ *
+ * Stages are sized for 1.75k bits per item, keeping the false positive
+ * rate of a full stage near 2^-k despite the uneven fill of blocks.
+ * Each new stage doubles the capacity and adds a hash, halving its
+ * false positive rate, so the combined rate of all stages is bounded by
+ * twice that of the first.
  */
 
 #include <stdlib.h>
+#include <string.h>
 #include "utils/bloom.h"
 #include <neosurf/utils/utils.h>
 
+/** Number of 64 bit words in a block */
+#define BLOOM_BLOCK_WORDS 8
+
+/** Number of bits in a block */
+#define BLOOM_BLOCK_BITS (BLOOM_BLOCK_WORDS * 64)
+
+/** Number of hashes used by the first stage, around 0.4% false positives */
+#define BLOOM_FIRST_K 8
+
+/** Smallest capacity of the first stage */
+#define BLOOM_MIN_CAPACITY 1024
+
+/** Maximum number of stages */
+#define BLOOM_MAX_STAGES 24
+
 /**
  * Hash a string, returning a 32bit value.  The hash algorithm used is
  * Fowler Noll Vo - a very fast and simple hash, ideal for short strings.
@@ -50,27 +77,204 @@ static inline uint32_t fnv(const char *datum, size_t len)
 	return z;
 }
 
+/**
+ * Mix the bits of a 64 bit value (the splitmix64 finaliser)
+ *
+ * \param x Value to mix
+ * \return mixed value
+ */
+static inline uint64_t bloom_mix(uint64_t x)
+{
+	x ^= x >> 30;
+	x *= 0xbf58476d1ce4e5b9ULL;
+	x ^= x >> 27;
+	x *= 0x94d049bb133111ebULL;
+	x ^= x >> 31;
+
+	return x;
+}
+
+/**
+ * Count the bits set in a 64 bit value
+ *
+ * \param x Value to examine
+ * \return number of set bits
+ */
+static inline unsigned int bloom_popcount(uint64_t x)
+{
+	x = x - ((x >> 1) & 0x5555555555555555ULL);
+	x = (x & 0x3333333333333333ULL) + ((x >> 2) & 0x3333333333333333ULL);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+
+	return (unsigned int)((x * 0x0101010101010101ULL) >> 56);
+}
+
+/**
+ * One stage of a scalable bloom filter
+ */
+struct bloom_stage {
+	uint64_t *bits; /**< blocks of filter bits */
+	uint8_t *counts; /**< four bit counter per bit, or NULL */
+	uint32_t blocks; /**< number of blocks */
+	uint32_t capacity; /**< items the stage is sized for */
+	uint32_t items; /**< items inserted into the stage */
+	uint32_t set; /**< number of bits set */
+	unsigned int k; /**< number of bits set per item */
+};
+
 struct bloom_filter {
-	size_t size;
-	uint32_t items;
-	uint8_t filter[FLEX_ARRAY_LEN_DECL];
+	bool counting; /**< stages have counters */
+	uint32_t items; /**< items inserted */
+	unsigned int stage_count; /**< number of stages in use */
+	struct bloom_stage stage[BLOOM_MAX_STAGES]; /**< the stages */
 };
 
-struct bloom_filter *bloom_create(size_t size)
+/**
+ * Compute the block and bit mask for a hash within a stage
+ *
+ * \param b Bloom filter
+ * \param idx Index of stage
+ * \param hash Hash value
+ * \param mask Updated with the bits to test within the block
+ * \return index of the block
+ */
+static uint32_t
+bloom_mask(struct bloom_filter *b,
+	   unsigned int idx,
+	   uint32_t hash,
+	   uint64_t mask[BLOOM_BLOCK_WORDS])
+{
+	const struct bloom_stage *s = &b->stage[idx];
+	uint64_t seed, x;
+	uint32_t block;
+	unsigned int i, avail;
+
+	/* Each stage places a hash independently */
+	seed = hash + (uint64_t)(idx + 1) * 0x9e3779b97f4a7c15ULL;
+	x = bloom_mix(seed);
+	block = (uint32_t)(((x >> 32) * s->blocks) >> 32);
+
+	for (i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+		mask[i] = 0;
+	}
+
+	/* Take nine bits of position at a time, seven per mix */
+	avail = 0;
+	for (i = 0; i < s->k; i++) {
+		unsigned int pos;
+
+		if (avail == 0) {
+			seed += 0x9e3779b97f4a7c15ULL;
+			x = bloom_mix(seed);
+			avail = 7;
+		}
+		pos = x & (BLOOM_BLOCK_BITS - 1);
+		x >>= 9;
+		avail--;
+
+		mask[pos >> 6] |= (uint64_t)1 << (pos & 63);
+	}
+
+	return block;
+}
+
+/**
+ * Test whether all the bits of a mask are set in a block
+ *
+ * \param s Stage to test
+ * \param block Index of block
+ * \param mask Bits to test
+ * \return true if every bit is set
+ */
+static inline bool
+bloom_stage_test(const struct bloom_stage *s,
+		 uint32_t block,
+		 const uint64_t mask[BLOOM_BLOCK_WORDS])
 {
-	struct bloom_filter *r = calloc(sizeof(*r) + size, 1);
+	const uint64_t *w = s->bits + (size_t)block * BLOOM_BLOCK_WORDS;
+	uint64_t missing = 0;
+	unsigned int i;
+
+	for (i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+		missing |= mask[i] & ~w[i];
+	}
+
+	return missing == 0;
+}
+
+/**
+ * Add a stage to a bloom filter
+ *
+ * \param b Bloom filter
+ * \param capacity Number of items the stage is sized for
+ * \param k Number of bits set per item
+ * \return true on success, false on memory exhaustion
+ */
+static bool
+bloom_add_stage(struct bloom_filter *b, uint32_t capacity, unsigned int k)
+{
+	struct bloom_stage *s = &b->stage[b->stage_count];
+	uint64_t nbits;
+
+	nbits = (uint64_t)capacity * k * 7 / 4;
+	nbits = (nbits + BLOOM_BLOCK_BITS - 1) / BLOOM_BLOCK_BITS;
+	if (nbits == 0 || nbits > UINT32_MAX / 2)
+		return false;
+
+	memset(s, 0, sizeof(*s));
+	s->blocks = (uint32_t)nbits;
+	s->capacity = capacity;
+	s->k = k;
+
+	s->bits = calloc((size_t)s->blocks * BLOOM_BLOCK_WORDS,
+			 sizeof(uint64_t));
+	if (s->bits == NULL)
+		return false;
+
+	if (b->counting) {
+		s->counts = calloc((size_t)s->blocks, BLOOM_BLOCK_BITS / 2);
+		if (s->counts == NULL) {
+			free(s->bits);
+			s->bits = NULL;
+			return false;
+		}
+	}
+
+	b->stage_count++;
+
+	return true;
+}
+
+struct bloom_filter *bloom_create(uint32_t capacity, bool counting)
+{
+	struct bloom_filter *r = calloc(sizeof(*r), 1);
         
 	if (r == NULL)
 		return NULL;
-        
-	r->size = size;
+
+	r->counting = counting;
+
+	if (capacity < BLOOM_MIN_CAPACITY)
+		capacity = BLOOM_MIN_CAPACITY;
+
+	if (!bloom_add_stage(r, capacity, BLOOM_FIRST_K)) {
+		free(r);
+		return NULL;
+	}
         
 	return r;
 }
 
 void bloom_destroy(struct bloom_filter *b)
 {
-        free(b);
+	unsigned int i;
+
+	for (i = 0; i < b->stage_count; i++) {
+		free(b->stage[i].bits);
+		free(b->stage[i].counts);
+	}
+
+	free(b);
 }
 
 void bloom_insert_str(struct bloom_filter *b, const char *s, size_t z)
@@ -81,11 +285,45 @@ void bloom_insert_str(struct bloom_filter *b, const char *s, size_t z)
 
 void bloom_insert_hash(struct bloom_filter *b, uint32_t hash)
 {
-	unsigned int index = hash % (b->size << 3);
-	unsigned int byte_index = index >> 3;
-	unsigned int bit_index = index & 7;
+	struct bloom_stage *s = &b->stage[b->stage_count - 1];
+	uint64_t mask[BLOOM_BLOCK_WORDS];
+	uint64_t *w;
+	uint32_t block;
+	unsigned int i;
+
+	if (s->items >= s->capacity && b->stage_count < BLOOM_MAX_STAGES &&
+	    s->capacity <= UINT32_MAX / 2 &&
+	    bloom_add_stage(b, s->capacity * 2, s->k + 1)) {
+		s = &b->stage[b->stage_count - 1];
+	}
+
+	block = bloom_mask(b, b->stage_count - 1, hash, mask);
+	w = s->bits + (size_t)block * BLOOM_BLOCK_WORDS;
 
-	b->filter[byte_index] |= (1 << bit_index);
+	for (i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+		s->set += bloom_popcount(mask[i] & ~w[i]);
+		w[i] |= mask[i];
+	}
+
+	if (s->counts != NULL) {
+		uint8_t *c = s->counts + (size_t)block * (BLOOM_BLOCK_BITS / 2);
+
+		for (i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+			uint64_t m;
+
+			for (m = mask[i]; m != 0; m &= m - 1) {
+				unsigned int bit = i * 64 +
+					bloom_popcount((m & -m) - 1);
+				unsigned int shift = (bit & 1) * 4;
+
+				/* Saturated counters stay put */
+				if (((c[bit >> 1] >> shift) & 0xf) != 0xf)
+					c[bit >> 1] += 1 << shift;
+			}
+		}
+	}
+
+	s->items++;
 	b->items++;
 }
 
@@ -97,11 +335,83 @@ bool bloom_search_str(struct bloom_filter *b, const char *s, size_t z)
 
 bool bloom_search_hash(struct bloom_filter *b, uint32_t hash)
 {
-	unsigned int index = hash % (b->size << 3);
-	unsigned int byte_index = index >> 3;
-	unsigned int bit_index = index & 7;
-	
-	return (b->filter[byte_index] & (1 << bit_index)) != 0;
+	uint64_t mask[BLOOM_BLOCK_WORDS];
+	unsigned int idx;
+
+	/* Newest stages hold the most items, so try them first */
+	for (idx = b->stage_count; idx > 0; idx--) {
+		uint32_t block = bloom_mask(b, idx - 1, hash, mask);
+
+		if (bloom_stage_test(&b->stage[idx - 1], block, mask))
+			return true;
+	}
+
+	return false;
+}
+
+bool bloom_remove_hash(struct bloom_filter *b, uint32_t hash)
+{
+	uint64_t mask[BLOOM_BLOCK_WORDS];
+	struct bloom_stage *s;
+	uint64_t *w;
+	uint8_t *c;
+	uint32_t block = 0;
+	unsigned int idx, i;
+
+	if (!b->counting)
+		return false;
+
+	/* The value can only safely be removed from the stage it was
+	 * inserted into.  If it matches several stages that is unknown,
+	 * so leave it be: a value left behind only costs a false
+	 * positive whereas removing it from the wrong stage could cause
+	 * false negatives for others. */
+	s = NULL;
+	for (idx = 0; idx < b->stage_count; idx++) {
+		uint64_t m[BLOOM_BLOCK_WORDS];
+		uint32_t blk = bloom_mask(b, idx, hash, m);
+
+		if (bloom_stage_test(&b->stage[idx], blk, m)) {
+			if (s != NULL)
+				return false;
+			s = &b->stage[idx];
+			block = blk;
+			memcpy(mask, m, sizeof(mask));
+		}
+	}
+	if (s == NULL)
+		return false;
+
+	w = s->bits + (size_t)block * BLOOM_BLOCK_WORDS;
+	c = s->counts + (size_t)block * (BLOOM_BLOCK_BITS / 2);
+
+	for (i = 0; i < BLOOM_BLOCK_WORDS; i++) {
+		uint64_t m;
+
+		for (m = mask[i]; m != 0; m &= m - 1) {
+			unsigned int bit = i * 64 +
+				bloom_popcount((m & -m) - 1);
+			unsigned int shift = (bit & 1) * 4;
+			unsigned int count = (c[bit >> 1] >> shift) & 0xf;
+
+			if (count == 0xf) {
+				/* Saturated counters no longer know
+				 * their count */
+				continue;
+			}
+
+			c[bit >> 1] -= 1 << shift;
+			if (count == 1) {
+				w[i] &= ~(m & -m);
+				s->set--;
+			}
+		}
+	}
+
+	s->items--;
+	b->items--;
+
+	return true;
 }
 
 uint32_t bloom_items(struct bloom_filter *b)
@@ -109,3 +419,51 @@ uint32_t bloom_items(struct bloom_filter *b)
 	return b->items;
 }
 
+size_t bloom_size(struct bloom_filter *b)
+{
+	size_t size = 0;
+	unsigned int i;
+
+	for (i = 0; i < b->stage_count; i++) {
+		size += (size_t)b->stage[i].blocks * (BLOOM_BLOCK_BITS / 8);
+		if (b->stage[i].counts != NULL)
+			size += (size_t)b->stage[i].blocks *
+				(BLOOM_BLOCK_BITS / 2);
+	}
+
+	return size;
+}
+
+double bloom_fp_rate(struct bloom_filter *b)
+{
+	double pass = 1.0;
+	unsigned int i, j, w;
+	uint32_t blk;
+
+	/* An absent item passes a stage with the probability that k
+	 * bits of its block are set, averaged over the blocks */
+	for (i = 0; i < b->stage_count; i++) {
+		const struct bloom_stage *s = &b->stage[i];
+		const uint64_t *bits = s->bits;
+		double fp = 0.0;
+
+		for (blk = 0; blk < s->blocks; blk++) {
+			unsigned int set = 0;
+			double fill, p = 1.0;
+
+			for (w = 0; w < BLOOM_BLOCK_WORDS; w++) {
+				set += bloom_popcount(*bits++);
+			}
+
+			fill = (double)set / BLOOM_BLOCK_BITS;
+			for (j = 0; j < s->k; j++) {
+				p *= fill;
+			}
+			fp += p;
+		}
+
+		pass *= 1.0 - fp / s->blocks;
+	}
+
+	return 1.0 - pass;
+}
@@ -17,7 +17,17 @@
  */
 
 /** \file
- * Trivial bloom filter */
+ * Scalable blocked bloom filter
+ *
+ * The filter is a series of stages, each a blocked bloom filter whose
+ * bits for an item all lie within one 512 bit block.  When the newest
+ * stage reaches its capacity a stage of twice the capacity and half
+ * the false positive rate is added, so the overall false positive
+ * rate stays bounded however many items are inserted.
+ *
+ * A counting filter additionally keeps a four bit counter per bit so
+ * items may be removed again.
+ */
 
 #ifndef _NETSURF_UTILS_BLOOM_H_
 #define _NETSURF_UTILS_BLOOM_H_
@@ -30,11 +40,12 @@ struct bloom_filter;
 
 /**
  * Create a new bloom filter.
- * 
- * \param size Size of bloom filter in bytes
+ *
+ * \param capacity Number of items the first stage is sized for
+ * \param counting Whether the filter supports removal of items
  * \return Handle for newly-created bloom filter, or NULL
  */
-struct bloom_filter *bloom_create(size_t size);
+struct bloom_filter *bloom_create(uint32_t capacity, bool counting);
 
 /**
  * Destroy a previously-created bloom filter
@@ -56,6 +67,10 @@ void bloom_insert_str(struct bloom_filter *b, const char *s, size_t z);
 /**
  * Insert a given hash value into the filter, should you already have
  * one to hand.
+ *
+ * The filter grows when it is full.  Should growth fail the item is
+ * added to the newest stage regardless, raising the false positive
+ * rate.
  * 
  * \param b Bloom filter to add to
  * \param hash Value to add
@@ -85,6 +100,21 @@ bool bloom_search_str(struct bloom_filter *b, const char *s, size_t z);
  */
 bool bloom_search_hash(struct bloom_filter *b, uint32_t hash);
 
+/**
+ * Remove a hash value from a counting filter.
+ *
+ * The value must previously have been added with bloom_insert_hash().
+ * Removing a value which was never added may cause false negatives.
+ *
+ * \param b Bloom filter to remove from
+ * \param hash Hash value to remove
+ *
+ * \return True if the value was removed, false if the filter is not
+ *         a counting filter, the value is not present or it matches
+ *         more than one stage so cannot be removed safely.
+ */
+bool bloom_remove_hash(struct bloom_filter *b, uint32_t hash);
+
 /**
  * Find out how many items have been added to this bloom filter.  This
  * is useful for deciding the size of a new bloom filter should you
@@ -96,4 +126,23 @@ bool bloom_search_hash(struct bloom_filter *b, uint32_t hash);
  */
 uint32_t bloom_items(struct bloom_filter *b);
 
+/**
+ * Find out how much memory a bloom filter uses.
+ *
+ * \param b Bloom filter to examine
+ *
+ * \return Size of the filter's bit and counter storage in bytes
+ */
+size_t bloom_size(struct bloom_filter *b);
+
+/**
+ * Estimate the false positive rate of a bloom filter from how full
+ * the blocks of its stages are.  This scans the whole filter.
+ *
+ * \param b Bloom filter to examine
+ *
+ * \return Probability a search for an absent item returns true
+ */
+double bloom_fp_rate(struct bloom_filter *b);
+
 #endif
@@ -22,19 +22,30 @@
 #include "utils/hashmap.h"
 
 /**
- * The default number of buckets in the hashmaps we create.
+ * The initial number of slots in the hashmaps we create, must be a
+ * power of two.
  */
-#define DEFAULT_HASHMAP_BUCKETS (4091)
+#define DEFAULT_HASHMAP_SLOTS (64)
 
 /**
- * Hashmaps have chains of entries in buckets.
+ * The number of old slots moved into the new table by each insertion
+ * while a hashmap is growing.
+ */
+#define HASHMAP_MIGRATE_STEP (16)
+
+/**
+ * Hashmaps are open addressed tables of entries using robin hood
+ * probing.
+ *
+ * An entry with a distance of zero is empty. A slot of the old table
+ * whose entry has been moved or removed while growing keeps its
+ * distance but has a NULL key so probing continues past it.
  */
 typedef struct hashmap_entry_s {
-	struct hashmap_entry_s **prevptr;
-	struct hashmap_entry_s *next;
 	void *key;
 	void *value;
 	uint32_t key_hash;
+	uint32_t distance; /**< probe distance from home slot plus one */
 } hashmap_entry_t;
 
 /**
@@ -45,16 +56,31 @@ struct hashmap_s {
 	 * The parameters to be used for this hashmap
 	 */
 	hashmap_parameters_t *params;
-	
+
+	/**
+	 * The slots of the table
+	 */
+	hashmap_entry_t *slots;
+
 	/**
-	 * The buckets for the hash chains
+	 * The number of slots in the table less one
 	 */
-	hashmap_entry_t **buckets;
-	
+	uint32_t slot_mask;
+
+	/**
+	 * The slots of the table being grown from or NULL
+	 */
+	hashmap_entry_t *old_slots;
+
 	/**
-	 * The number of buckets in this map
+	 * The number of slots in the old table less one
 	 */
-	uint32_t bucket_count;
+	uint32_t old_slot_mask;
+
+	/**
+	 * The next old slot to be moved into the table
+	 */
+	uint32_t migrate_pos;
 
 	/**
 	 * The number of entries in this map
@@ -62,6 +88,187 @@ struct hashmap_s {
 	size_t entry_count;
 };
 
+/**
+ * Find the entry for a key within a table.
+ */
+static hashmap_entry_t *
+hashmap_table_find(hashmap_t *hashmap,
+		   hashmap_entry_t *slots,
+		   uint32_t mask,
+		   uint32_t hash,
+		   void *key)
+{
+	uint32_t pos = hash & mask;
+	uint32_t distance = 1;
+	hashmap_entry_t *entry;
+
+	for (;;) {
+		entry = &slots[pos];
+		/* an entry nearer its home slot than we are means the
+		 * key would have displaced it if present.
+		 */
+		if (entry->distance < distance) {
+			return NULL;
+		}
+		if ((entry->key_hash == hash) &&
+		    (entry->key != NULL) &&
+		    hashmap->params->key_eq(key, entry->key)) {
+			return entry;
+		}
+		pos = (pos + 1) & mask;
+		distance++;
+	}
+}
+
+/**
+ * Find the entry for a key in either table.
+ */
+static hashmap_entry_t *
+hashmap_find(hashmap_t *hashmap, uint32_t hash, void *key)
+{
+	hashmap_entry_t *entry;
+
+	entry = hashmap_table_find(hashmap, hashmap->slots,
+				   hashmap->slot_mask, hash, key);
+	if ((entry == NULL) && (hashmap->old_slots != NULL)) {
+		entry = hashmap_table_find(hashmap, hashmap->old_slots,
+					   hashmap->old_slot_mask, hash, key);
+	}
+	return entry;
+}
+
+/**
+ * Place an entry whose key is not present into the table.
+ */
+static void
+hashmap_place(hashmap_t *hashmap, void *key, void *value, uint32_t hash)
+{
+	hashmap_entry_t carry = {
+		.key = key,
+		.value = value,
+		.key_hash = hash,
+		.distance = 1,
+	};
+	hashmap_entry_t swap;
+	hashmap_entry_t *entry;
+	uint32_t pos = hash & hashmap->slot_mask;
+
+	for (;;) {
+		entry = &hashmap->slots[pos];
+		if (entry->distance == 0) {
+			*entry = carry;
+			return;
+		}
+		/* take the slot from an entry nearer its home */
+		if (entry->distance < carry.distance) {
+			swap = *entry;
+			*entry = carry;
+			carry = swap;
+		}
+		pos = (pos + 1) & hashmap->slot_mask;
+		carry.distance++;
+	}
+}
+
+/**
+ * Move entries from the old table into the table.
+ *
+ * \param hashmap The hashmap being grown
+ * \param count The number of old slots to move
+ */
+static void hashmap_migrate(hashmap_t *hashmap, uint32_t count)
+{
+	hashmap_entry_t *entry;
+
+	while ((hashmap->old_slots != NULL) && (count-- > 0)) {
+		entry = &hashmap->old_slots[hashmap->migrate_pos];
+		if ((entry->distance != 0) && (entry->key != NULL)) {
+			hashmap_place(hashmap,
+				      entry->key,
+				      entry->value,
+				      entry->key_hash);
+			entry->key = NULL;
+			entry->value = NULL;
+		}
+
+		if (hashmap->migrate_pos == hashmap->old_slot_mask) {
+			free(hashmap->old_slots);
+			hashmap->old_slots = NULL;
+			hashmap->old_slot_mask = 0;
+			hashmap->migrate_pos = 0;
+		} else {
+			hashmap->migrate_pos++;
+		}
+	}
+}
+
+/**
+ * Start growing the table.
+ *
+ * The current table becomes the old table whose entries are moved
+ * into the new table a few at a time by subsequent insertions.
+ *
+ * \return true if the table was grown, false on allocation failure
+ */
+static bool hashmap_grow(hashmap_t *hashmap)
+{
+	hashmap_entry_t *slots;
+	uint32_t slot_count = (hashmap->slot_mask + 1) * 2;
+
+	if (slot_count == 0) {
+		return false;
+	}
+
+	/* only one growth can be in progress */
+	hashmap_migrate(hashmap, hashmap->old_slot_mask + 1);
+
+	slots = calloc(slot_count, sizeof(hashmap_entry_t));
+	if (slots == NULL) {
+		return false;
+	}
+
+	hashmap->old_slots = hashmap->slots;
+	hashmap->old_slot_mask = hashmap->slot_mask;
+	hashmap->migrate_pos = 0;
+	hashmap->slots = slots;
+	hashmap->slot_mask = slot_count - 1;
+
+	return true;
+}
+
+/**
+ * Remove an entry from the table keeping probe sequences intact.
+ */
+static void hashmap_erase(hashmap_t *hashmap, hashmap_entry_t *entry)
+{
+	uint32_t pos;
+	hashmap_entry_t *next;
+
+	if ((entry < hashmap->slots) ||
+	    (entry > &hashmap->slots[hashmap->slot_mask])) {
+		/* the old table is never probed for insertion so
+		 * leaving a moved slot is sufficient.
+		 */
+		entry->key = NULL;
+		entry->value = NULL;
+		return;
+	}
+
+	/* shift following displaced entries back towards home */
+	pos = entry - hashmap->slots;
+	for (;;) {
+		pos = (pos + 1) & hashmap->slot_mask;
+		next = &hashmap->slots[pos];
+		if (next->distance <= 1) {
+			break;
+		}
+		*entry = *next;
+		entry->distance--;
+		entry = next;
+	}
+	memset(entry, 0, sizeof(*entry));
+}
+
 /* Exported function, documented in hashmap.h */
 hashmap_t *
 hashmap_create(hashmap_parameters_t *params)
@@ -72,39 +279,48 @@ hashmap_create(hashmap_parameters_t *params)
 	}
 
 	ret->params = params;
-	ret->bucket_count = DEFAULT_HASHMAP_BUCKETS;
+	ret->slot_mask = DEFAULT_HASHMAP_SLOTS - 1;
+	ret->old_slots = NULL;
+	ret->old_slot_mask = 0;
+	ret->migrate_pos = 0;
 	ret->entry_count = 0;
-	ret->buckets = malloc(ret->bucket_count * sizeof(hashmap_entry_t *));
+	ret->slots = calloc(DEFAULT_HASHMAP_SLOTS, sizeof(hashmap_entry_t));
 
-	if (ret->buckets == NULL) {
+	if (ret->slots == NULL) {
 		free(ret);
 		return NULL;
 	}
 
-	memset(ret->buckets, 0, ret->bucket_count * sizeof(hashmap_entry_t *));
-
 	return ret;
 }
 
-/* Exported function, documented in hashmap.h */
-void
-hashmap_destroy(hashmap_t *hashmap)
+/**
+ * Destroy the entries of a table.
+ */
+static void
+hashmap_destroy_slots(hashmap_t *hashmap, hashmap_entry_t *slots, uint32_t mask)
 {
-	uint32_t bucket;
-	hashmap_entry_t *entry;
+	uint32_t slot;
 
-	for (bucket = 0; bucket < hashmap->bucket_count; bucket++) {
-		for (entry = hashmap->buckets[bucket];
-		     entry != NULL;) {
-			hashmap_entry_t *next = entry->next;
-			hashmap->params->value_destroy(entry->value);
-			hashmap->params->key_destroy(entry->key);
-			free(entry);
-			entry = next;
+	for (slot = 0; slot <= mask; slot++) {
+		if ((slots[slot].distance != 0) && (slots[slot].key != NULL)) {
+			hashmap->params->value_destroy(slots[slot].value);
+			hashmap->params->key_destroy(slots[slot].key);
 		}
 	}
+	free(slots);
+}
 
-	free(hashmap->buckets);
+/* Exported function, documented in hashmap.h */
+void
+hashmap_destroy(hashmap_t *hashmap)
+{
+	hashmap_destroy_slots(hashmap, hashmap->slots, hashmap->slot_mask);
+	if (hashmap->old_slots != NULL) {
+		hashmap_destroy_slots(hashmap,
+				      hashmap->old_slots,
+				      hashmap->old_slot_mask);
+	}
 	free(hashmap);
 }
 
@@ -113,17 +329,12 @@ void *
 hashmap_lookup(hashmap_t *hashmap, void *key)
 {
 	uint32_t hash = hashmap->params->key_hash(key);
-	hashmap_entry_t *entry = hashmap->buckets[hash % hashmap->bucket_count];
+	hashmap_entry_t *entry = hashmap_find(hashmap, hash, key);
 
-	for(;entry != NULL; entry = entry->next) {
-		if (entry->key_hash == hash) {
-			if (hashmap->params->key_eq(key, entry->key)) {
-				return entry->value;
-			}
-		}
+	if (entry == NULL) {
+		return NULL;
 	}
-
-	return NULL;
+	return entry->value;
 }
 
 /* Exported function, documented in hashmap.h */
@@ -131,74 +342,56 @@ void *
 hashmap_insert(hashmap_t *hashmap, void *key)
 {
 	uint32_t hash = hashmap->params->key_hash(key);
-	uint32_t bucket = hash % hashmap->bucket_count;
-	hashmap_entry_t *entry = hashmap->buckets[bucket];
+	hashmap_entry_t *entry;
 	void *new_key, *new_value;
 
-	for(;entry != NULL; entry = entry->next) {
-		if (entry->key_hash == hash) {
-			if (hashmap->params->key_eq(key, entry->key)) {
-				/* This key is already here */
-				new_key = hashmap->params->key_clone(key);
-				if (new_key == NULL) {
-					/* Allocation failed */
-					return NULL;
-				}
-				new_value = hashmap->params->value_alloc(entry->key);
-				if (new_value == NULL) {
-					/* Allocation failed */
-					hashmap->params->key_destroy(new_key);
-					return NULL;
-				}
-				hashmap->params->value_destroy(entry->value);
-				hashmap->params->key_destroy(entry->key);
-				entry->value = new_value;
-				entry->key = new_key;
-				return entry->value;
-			}
+	entry = hashmap_find(hashmap, hash, key);
+	if (entry != NULL) {
+		/* This key is already here */
+		new_key = hashmap->params->key_clone(key);
+		if (new_key == NULL) {
+			/* Allocation failed */
+			return NULL;
 		}
+		new_value = hashmap->params->value_alloc(entry->key);
+		if (new_value == NULL) {
+			/* Allocation failed */
+			hashmap->params->key_destroy(new_key);
+			return NULL;
+		}
+		hashmap->params->value_destroy(entry->value);
+		hashmap->params->key_destroy(entry->key);
+		entry->value = new_value;
+		entry->key = new_key;
+		return entry->value;
 	}
 
-	/* The key was not found in the map, so allocate a new entry */
-	entry = malloc(sizeof(*entry));
-
-	if (entry == NULL) {
-		return NULL;
-	}
-	
-	memset(entry, 0, sizeof(*entry));
-
-	entry->key = hashmap->params->key_clone(key);
-	if (entry->key == NULL) {
-		goto err;
+	/* keep the table no more than three quarters full */
+	if (((hashmap->entry_count + 1) * 4) >
+	    ((size_t)(hashmap->slot_mask + 1) * 3)) {
+		if (!hashmap_grow(hashmap)) {
+			return NULL;
+		}
 	}
-	entry->key_hash = hash;
 
-	entry->value = hashmap->params->value_alloc(entry->key);
-	if (entry->value == NULL) {
-		goto err;
+	/* The key was not found in the map, so add a new entry */
+	new_key = hashmap->params->key_clone(key);
+	if (new_key == NULL) {
+		return NULL;
 	}
 
-	entry->prevptr = &(hashmap->buckets[bucket]);
-	entry->next = hashmap->buckets[bucket];
-	if (entry->next != NULL) {
-		entry->next->prevptr = &entry->next;
+	new_value = hashmap->params->value_alloc(new_key);
+	if (new_value == NULL) {
+		hashmap->params->key_destroy(new_key);
+		return NULL;
 	}
 
-	hashmap->buckets[bucket] = entry;
+	hashmap_migrate(hashmap, HASHMAP_MIGRATE_STEP);
+	hashmap_place(hashmap, new_key, new_value, hash);
 
 	hashmap->entry_count++;
 
-	return entry->value;
-
-err:
-	if (entry->value != NULL)
-		hashmap->params->value_destroy(entry->value);
-	if (entry->key != NULL)
-		hashmap->params->key_destroy(entry->key);
-	free(entry);
-
-	return NULL;
+	return new_value;
 }
 
 /* Exported function, documented in hashmap.h */
@@ -206,23 +399,36 @@ bool
 hashmap_remove(hashmap_t *hashmap, void *key)
 {
 	uint32_t hash = hashmap->params->key_hash(key);
-	
-	hashmap_entry_t *entry = hashmap->buckets[hash % hashmap->bucket_count];
-
-	for(;entry != NULL; entry = entry->next) {
-		if (entry->key_hash == hash) {
-			if (hashmap->params->key_eq(key, entry->key)) {
-				hashmap->params->value_destroy(entry->value);
-				hashmap->params->key_destroy(entry->key);
-				if (entry->next != NULL) {
-					entry->next->prevptr = entry->prevptr;
-				}
-				*entry->prevptr = entry->next;
-				free(entry);
-				hashmap->entry_count--;
-				return true;
-			}
+	hashmap_entry_t *entry = hashmap_find(hashmap, hash, key);
+
+	if (entry == NULL) {
+		return false;
+	}
+
+	hashmap->params->value_destroy(entry->value);
+	hashmap->params->key_destroy(entry->key);
+	hashmap_erase(hashmap, entry);
+	hashmap->entry_count--;
+
+	return true;
+}
+
+/**
+ * Iterate the entries of a table.
+ */
+static bool
+hashmap_iterate_slots(hashmap_entry_t *slots,
+		      uint32_t mask,
+		      hashmap_iteration_cb_t cb,
+		      void *ctx)
+{
+	for (uint32_t slot = 0; slot <= mask; slot++) {
+		if ((slots[slot].distance == 0) || (slots[slot].key == NULL)) {
+			continue;
 		}
+		/* If the callback returns true, we early-exit */
+		if (cb(slots[slot].key, slots[slot].value, ctx))
+			return true;
 	}
 
 	return false;
@@ -232,16 +438,16 @@ hashmap_remove(hashmap_t *hashmap, void *key)
 bool
 hashmap_iterate(hashmap_t *hashmap, hashmap_iteration_cb_t cb, void *ctx)
 {
-	for (uint32_t bucket = 0;
-	     bucket < hashmap->bucket_count;
-	     bucket++) {
-		for (hashmap_entry_t *entry = hashmap->buckets[bucket];
-		     entry != NULL;
-		     entry = entry->next) {
-			/* If the callback returns true, we early-exit */
-			if (cb(entry->key, entry->value, ctx))
-				return true;
-		}
+	if (hashmap_iterate_slots(hashmap->slots,
+				  hashmap->slot_mask,
+				  cb, ctx)) {
+		return true;
+	}
+
+	if (hashmap->old_slots != NULL) {
+		return hashmap_iterate_slots(hashmap->old_slots,
+					     hashmap->old_slot_mask,
+					     cb, ctx);
 	}
 
 	return false;
@@ -28,6 +28,10 @@
  * Hashmaps take ownership of the keys inserted into them by means of a
  * clone function in their parameters.  They also manage the value memory
  * directly.
+ *
+ * The map grows as entries are added. Values are allocated separately
+ * from the table so pointers to them remain valid until the entry is
+ * removed.
  */
 typedef struct hashmap_s hashmap_t;
 
@@ -33,6 +33,9 @@ bool verbose_log = false;
 /** The stream to which logging is sent */
 static FILE *logfile;
 
+/** Time of logging initialisation, log entries are timed from here */
+static struct timeval start_tv;
+
 /** Subtract the `struct timeval' values X and Y
  *
  * \param result The timeval structure to store the result in
@@ -67,24 +70,23 @@ timeval_subtract(struct timeval *result, struct timeval *x, struct timeval *y)
 /**
  * Obtain a formatted string suitable for prepending to a log message
  *
- * \return formatted string of the time since first log call
+ * Log entries may be made from threads other than the main one so
+ * the string is formatted into a buffer owned by the caller.
+ *
+ * \param buff The buffer to format the string into.
+ * \param len The length of the buffer.
+ * \return formatted string of the time since logging was initialised
  */
-static const char *nslog_gettime(void)
+static const char *nslog_gettime(char *buff, size_t len)
 {
-	static struct timeval start_tv;
-	static char buff[32];
-
 	struct timeval tv;
 	struct timeval now_tv;
 
-	if (!timerisset(&start_tv)) {
-		gettimeofday(&start_tv, NULL);
-	}
 	gettimeofday(&now_tv, NULL);
 
 	timeval_subtract(&tv, &now_tv, &start_tv);
 
-	snprintf(buff, sizeof(buff),"(%ld.%06ld)",
+	snprintf(buff, len, "(%ld.%06ld)",
 		 (long)tv.tv_sec, (long)tv.tv_usec);
 
 	return buff;
@@ -109,9 +111,11 @@ neosurf_render_log(void *_ctx,
 		   const char *fmt,
 		   va_list args)
 {
+	char buff[32];
+
 	fprintf(logfile,
 		"%s [%s %.*s] %.*s:%i %.*s: ",
-		nslog_gettime(),
+		nslog_gettime(buff, sizeof(buff)),
 		nslog_short_level_name(ctx->level),
 		ctx->category->namelen,
 		ctx->category->name,
@@ -157,11 +161,12 @@ void
 nslog_log(const char *file, const char *func, int ln, const char *format, ...)
 {
 	va_list ap;
+	char buff[32];
 
 	if (verbose_log) {
 		fprintf(logfile,
 			"%s %s:%i %s: ",
-			nslog_gettime(),
+			nslog_gettime(buff, sizeof(buff)),
 			file,
 			ln,
 			func);
@@ -192,6 +197,9 @@ nserror nslog_init(nslog_ensure_t *ensure, int *pargc, char **argv)
 	struct utsname utsname;
 	nserror ret = NSERROR_OK;
 
+	/* set before any entry can be rendered */
+	gettimeofday(&start_tv, NULL);
+
 	if (((*pargc) > 1) &&
 	    (argv[1][0] == '-') &&
 	    (argv[1][1] == 'v') &&